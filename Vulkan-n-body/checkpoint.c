@@ -0,0 +1,283 @@
+#include "checkpoint.h"
+#include "vkinit.h"
+#include "vkTimeStep.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert(sizeof(CheckpointHeader) == 64, "CheckpointHeader is part of the file format");
+
+// Checkpoints are copied out of the newest particle buffer on the compute queue into a
+// persistently mapped buffer and written to disk by a separate thread, so neither the
+// copy nor the file write holds up the simulation. Files are written next to the
+// destination and renamed over it, a crash mid write leaves the previous checkpoint intact.
+void createCheckpointWriter(Context* context) {
+    CheckpointWriter* checkpoint = &context->checkpoint;
+    VkDeviceSize bufferSize = sizeof(Particle) * context->PARTICLE_COUNT * (context->integrator == INTEGRATOR_EULER ? 2 : 1);
+    if (context->adaptiveTimeStep) {
+        bufferSize += sizeof(TimeStepState);
+    }
+
+    createBuffer(context,
+        bufferSize,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        readbackMemoryProperties(context->physicalDevice),
+        ALLOCATION_STRATEGY_LINEAR,
+        &checkpoint->readbackBuffer,
+        &checkpoint->readbackBufferAllocation);
+    checkpoint->readbackBufferMapped = checkpoint->readbackBufferAllocation.mapped;
+
+    VkCommandBufferAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = context->computeCommandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+    VkResult result = vkAllocateCommandBuffers(context->device, &allocInfo, &checkpoint->commandBuffer);
+    checkErr(result, "failed to allocate checkpoint command buffer!");
+
+    VkFenceCreateInfo fenceInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO
+    };
+    result = vkCreateFence(context->device, &fenceInfo, NULL, &checkpoint->copyFence);
+    checkErr(result, "failed to create checkpoint fence!");
+
+    checkpoint->lastStep = context->stepIndex;
+}
+
+// Writes a last checkpoint if the state moved on since the previous one.
+void destroyCheckpointWriter(Context* context) {
+    CheckpointWriter* checkpoint = &context->checkpoint;
+    if (context->stepIndex != checkpoint->lastStep) {
+        requestCheckpoint(context);
+    }
+    finishCheckpoint(context);
+
+    vkDestroyFence(context->device, checkpoint->copyFence, NULL);
+    vkFreeCommandBuffers(context->device, context->computeCommandPool, 1, &checkpoint->commandBuffer);
+    destroyBuffer(context, checkpoint->readbackBuffer, checkpoint->readbackBufferAllocation);
+}
+
+// Called after every compute submission. Hands finished copies to the writer thread and
+// starts a new checkpoint whenever stepIndex crosses a multiple of checkpointInterval.
+void updateCheckpoints(Context* context) {
+    CheckpointWriter* checkpoint = &context->checkpoint;
+
+    if (checkpoint->copyPending && vkGetFenceStatus(context->device, checkpoint->copyFence) == VK_SUCCESS) {
+        vkResetFences(context->device, 1, &checkpoint->copyFence);
+        checkpoint->copyPending = false;
+        checkpoint->writing = true;
+        threadCreate(&checkpoint->writerThread, checkpointWriterMain, context);
+    }
+
+    if (context->stepIndex / context->checkpointInterval != checkpoint->lastStep / context->checkpointInterval) {
+        requestCheckpoint(context);
+    }
+}
+
+// Copies the particles written by the latest compute submission. Has to be called before
+// the next compute submission, which overwrites the other buffer and then this one.
+void requestCheckpoint(Context* context) {
+    CheckpointWriter* checkpoint = &context->checkpoint;
+
+    // the readback buffer holds the previous checkpoint until it is on disk
+    finishCheckpoint(context);
+
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    VkResult result = vkBeginCommandBuffer(checkpoint->commandBuffer, &beginInfo);
+    checkErr(result, "failed to begin recording checkpoint command buffer!");
+
+        // An Euler step adds to the velocity of the state before the one it reads, see shader.comp
+        bool previousState = context->integrator == INTEGRATOR_EULER;
+        recordParticleReadback(context, checkpoint->commandBuffer, checkpoint->readbackBuffer, previousState);
+        if (context->adaptiveTimeStep) {
+            recordTimeStepReadback(context, checkpoint->commandBuffer, checkpoint->readbackBuffer, sizeof(Particle) * context->PARTICLE_COUNT * (previousState ? 2 : 1));
+        }
+
+    result = vkEndCommandBuffer(checkpoint->commandBuffer);
+    checkErr(result, "failed to record checkpoint command buffer!");
+
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &checkpoint->commandBuffer
+    };
+    result = vkQueueSubmit(context->computeQueue, 1, &submitInfo, checkpoint->copyFence);
+    checkErr(result, "failed to submit checkpoint copy!");
+
+    checkpoint->header = currentCheckpointHeader(context);
+    checkpoint->header.previousState = previousState;
+    checkpoint->copyPending = true;
+    checkpoint->lastStep = context->stepIndex;
+}
+
+// Copies the newest particle buffer into a host visible buffer, readable once the submission's
+// fence signals, and with previousState the other buffer right after it. The compute
+// submission before this one wrote them on the same queue.
+void recordParticleReadback(Context* context, VkCommandBuffer commandBuffer, VkBuffer dstBuffer, bool previousState) {
+    VkMemoryBarrier computeBarrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &computeBarrier, 0, NULL, 0, NULL);
+
+    VkBufferCopy copyRegion = {
+        .size = sizeof(Particle) * context->PARTICLE_COUNT
+    };
+    vkCmdCopyBuffer(commandBuffer, context->shaderStorageBuffers[context->latestBuffer], dstBuffer, 1, &copyRegion);
+    if (previousState) {
+        uint32_t previousBuffer = (context->latestBuffer + context->MAX_FRAMES_IN_FLIGHT - 1) % context->MAX_FRAMES_IN_FLIGHT;
+        copyRegion.dstOffset = copyRegion.size;
+        vkCmdCopyBuffer(commandBuffer, context->shaderStorageBuffers[previousBuffer], dstBuffer, 1, &copyRegion);
+    }
+
+    VkMemoryBarrier hostBarrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, NULL, 0, NULL);
+}
+
+// Blocks until the pending checkpoint, if any, is on disk.
+void finishCheckpoint(Context* context) {
+    CheckpointWriter* checkpoint = &context->checkpoint;
+
+    if (checkpoint->copyPending) {
+        vkWaitForFences(context->device, 1, &checkpoint->copyFence, VK_TRUE, UINT64_MAX);
+        vkResetFences(context->device, 1, &checkpoint->copyFence);
+        checkpoint->copyPending = false;
+        checkpoint->writing = true;
+        threadCreate(&checkpoint->writerThread, checkpointWriterMain, context);
+    }
+    if (checkpoint->writing) {
+        threadJoin(&checkpoint->writerThread);
+        checkpoint->writing = false;
+    }
+}
+
+void checkpointWriterMain(void* arg) {
+    Context* context = (Context*)arg;
+    CheckpointWriter* checkpoint = &context->checkpoint;
+
+    size_t pathLength = strlen(context->checkpointPath);
+    char* tempPath = (char*)malloc(pathLength + 5);
+    memcpy(tempPath, context->checkpointPath, pathLength);
+    memcpy(tempPath + pathLength, ".tmp", 5);
+
+    readbackTimeStepState(context, &checkpoint->header, checkpoint->readbackBufferMapped);
+
+    if (writeCheckpoint(tempPath, &checkpoint->header, checkpoint->readbackBufferMapped) && replaceFile(tempPath, context->checkpointPath)) {
+        printf("Checkpoint: step %llu written to %s\n", (unsigned long long)checkpoint->header.step, context->checkpointPath);
+    }
+    else {
+        printf("failed to write checkpoint %s!\n", context->checkpointPath);
+    }
+    free(tempPath);
+}
+
+// With an adaptive time step only the GPU knows the time, recordTimeStepReadback copied it
+// and the step after the particles. Called once the readback's fence has signaled.
+void readbackTimeStepState(Context* context, CheckpointHeader* header, const void* readback) {
+    if (context->adaptiveTimeStep) {
+        size_t particleBytes = sizeof(Particle) * (size_t)context->PARTICLE_COUNT * (header->previousState ? 2 : 1);
+        const TimeStepState* state = (const TimeStepState*)((const uint8_t*)readback + particleBytes);
+        header->time = (double)state->time + (double)state->timeLow;
+        header->timeStep = state->deltaTime;
+    }
+}
+
+CheckpointHeader currentCheckpointHeader(Context* context) {
+    CheckpointHeader header = {
+        .magic = CHECKPOINT_MAGIC,
+        .version = CHECKPOINT_VERSION,
+        .layoutVersion = PARTICLE_LAYOUT_VERSION,
+        .particleSize = sizeof(Particle),
+        .particleCount = context->PARTICLE_COUNT,
+        .step = context->stepIndex,
+        .time = context->simulationTime,
+        .timeStep = context->timeStep,
+        .integrator = context->integrator
+    };
+    return header;
+}
+
+bool writeCheckpoint(const char* path, const CheckpointHeader* header, const void* particles) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    size_t particleBytes = (size_t)header->particleSize * (size_t)header->particleCount * (header->previousState ? 2 : 1);
+    bool success = fwrite(header, sizeof(CheckpointHeader), 1, file) == 1 &&
+        fwrite(particles, 1, particleBytes, file) == particleBytes;
+    return fclose(file) == 0 && success;
+}
+
+// Maps restartPath and checks it fits this run. The particles are uploaded straight out of
+// the mapped view, which stays valid until unmapCheckpoint. Also restores the step count
+// and simulated time.
+CheckpointView mapCheckpoint(Context* context) {
+    uint64_t fileSize = 0;
+    const uint8_t* file = (const uint8_t*)mapFile(context->restartPath, &fileSize);
+    if (file == NULL) {
+        printf("failed to open checkpoint %s!\n", context->restartPath);
+        exit(1);
+    }
+
+    CheckpointHeader header = { 0 };
+    if (fileSize >= sizeof(CheckpointHeader)) {
+        memcpy(&header, file, sizeof(CheckpointHeader));
+    }
+    if (header.magic != CHECKPOINT_MAGIC || header.version != CHECKPOINT_VERSION) {
+        printf("%s is not a version %u checkpoint!\n", context->restartPath, CHECKPOINT_VERSION);
+        exit(1);
+    }
+    if (header.layoutVersion != PARTICLE_LAYOUT_VERSION || header.particleSize != sizeof(Particle)) {
+        printf("checkpoint particle layout %u (%u bytes) does not match this build's layout %u (%u bytes)!\n",
+            header.layoutVersion, header.particleSize, PARTICLE_LAYOUT_VERSION, (uint32_t)sizeof(Particle));
+        exit(1);
+    }
+    if (header.particleCount != context->PARTICLE_COUNT) {
+        printf("checkpoint holds %llu particles, PARTICLE_COUNT is %u!\n", (unsigned long long)header.particleCount, context->PARTICLE_COUNT);
+        exit(1);
+    }
+    uint64_t particleBytes = (uint64_t)sizeof(Particle) * context->PARTICLE_COUNT;
+    if (fileSize < sizeof(CheckpointHeader) + particleBytes * (header.previousState ? 2 : 1)) {
+        printf("checkpoint %s is truncated!\n", context->restartPath);
+        exit(1);
+    }
+
+    if (header.timeStep != context->timeStep && !context->adaptiveTimeStep) {
+        printf("checkpoint was run with time step %g, continuing with %g\n", header.timeStep, context->timeStep);
+    }
+    // Euler velocities are displacements per step, the others velocities per unit time
+    if (header.integrator != (uint32_t)context->integrator) {
+        printf("checkpoint was run with integrator %u, continuing with %u\n", header.integrator, (uint32_t)context->integrator);
+    }
+    // Trajectory frames and checkpoints of older builds hold one state, both buffers start from it
+    if (context->integrator == INTEGRATOR_EULER && !header.previousState) {
+        printf("checkpoint has no previous state, the Euler run continues but departs from the original one\n");
+    }
+    context->stepIndex = header.step;
+    context->simulationTime = header.time;
+    printf("Restarted from %s: step %llu, time %g\n", context->restartPath, (unsigned long long)header.step, header.time);
+
+    CheckpointView view = {
+        .file = (void*)file,
+        .fileSize = fileSize,
+        .particles = (const Particle*)(file + sizeof(CheckpointHeader)),
+        .previousParticles = header.previousState ? (const Particle*)(file + sizeof(CheckpointHeader) + particleBytes) : NULL
+    };
+    return view;
+}
+
+// Once the staged copies out of the view have finished
+void unmapCheckpoint(CheckpointView* view) {
+    unmapFile(view->file, view->fileSize);
+    view->file = NULL;
+}
@@ -0,0 +1,21 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "types.h"
+
+void createCheckpointWriter(Context* context);
+void destroyCheckpointWriter(Context* context);
+
+void updateCheckpoints(Context* context);
+void requestCheckpoint(Context* context);
+void finishCheckpoint(Context* context);
+void recordParticleReadback(Context* context, VkCommandBuffer commandBuffer, VkBuffer dstBuffer, bool previousState);
+void checkpointWriterMain(void* arg);
+void readbackTimeStepState(Context* context, CheckpointHeader* header, const void* readback);
+CheckpointHeader currentCheckpointHeader(Context* context);
+bool writeCheckpoint(const char* path, const CheckpointHeader* header, const void* particles);
+
+CheckpointView mapCheckpoint(Context* context);
+void unmapCheckpoint(CheckpointView* view);
+
+#endif
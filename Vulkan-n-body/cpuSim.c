@@ -0,0 +1,167 @@
+#include "cpuSim.h"
+#include "particles.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void createCpuSimulation(CpuSimulation* sim, const Particle* initial, uint32_t particleCount, float timeStep, uint32_t threadCount, CpuKernel kernel, uint32_t fmmOrder, float fmmTheta) {
+    sim->particleCount = particleCount;
+    sim->timeStep = timeStep;
+    sim->current = 1;
+    sim->kernel = kernel;
+
+    // both buffers start from the same state, as on the GPU
+    for (uint32_t i = 0; i < 2; i++) {
+        sim->particles[i] = (Particle*)malloc(sizeof(Particle) * particleCount);
+        memcpy(sim->particles[i], initial, sizeof(Particle) * particleCount);
+    }
+
+    if (kernel == CPU_KERNEL_SIMD) {
+        sim->simdLevel = detectSimdLevel();
+        sim->simdForce = getSimdForceFunction(sim->simdLevel);
+        for (uint32_t i = 0; i < 2; i++) {
+            createParticleArrays(&sim->arrays[i], particleCount);
+            particlesToArrays(initial, &sim->arrays[i]);
+        }
+    }
+    else if (kernel == CPU_KERNEL_FMM) {
+        createFmmSolver(&sim->fmm, particleCount, fmmOrder, fmmTheta);
+        sim->accelerations = (vec2*)malloc(sizeof(vec2) * particleCount);
+    }
+
+    createThreadPool(&sim->pool, threadCount);
+
+    // enough blocks per worker that stealing can even out the load
+    uint32_t blockSize = particleCount / (sim->pool.workerCount * 8);
+    if (blockSize < 16) blockSize = 16;
+    if (blockSize > 256) blockSize = 256;
+    sim->blockSize = blockSize;
+}
+
+// Same force law and update as shader.comp: particlesIn is the latest state,
+// particlesOut the older buffer that gets advanced in place.
+void cpuForceBlock(void* arg, uint32_t begin, uint32_t end, uint32_t workerIndex) {
+    CpuSimulation* sim = (CpuSimulation*)arg;
+    const Particle* particlesIn = sim->particles[sim->current];
+    Particle* particlesOut = sim->particles[1 - sim->current];
+
+    for (uint32_t i = begin; i < end; i++) {
+        float posX = particlesIn[i].pos.x;
+        float posY = particlesIn[i].pos.y;
+        float sumX = 0;
+        float sumY = 0;
+        for (uint32_t j = 0; j < sim->particleCount; j++) {
+            float distanceX = particlesIn[j].pos.x - posX;
+            float distanceY = particlesIn[j].pos.y - posY;
+
+            float x2_y2 = distanceX * distanceX + distanceY * distanceY;
+
+            float dist = 1.0f / sqrtf(x2_y2 * x2_y2 * x2_y2 + SOFTENING);
+            float b = particlesIn[j].mss * dist;
+
+            sumX += distanceX * b;
+            sumY += distanceY * b;
+        }
+        particlesOut[i].vel.x += sumX * sim->timeStep;
+        particlesOut[i].vel.y += sumY * sim->timeStep;
+        particlesOut[i].pos.x += particlesOut[i].vel.x;
+        particlesOut[i].pos.y += particlesOut[i].vel.y;
+    }
+}
+
+void cpuSimdForceBlock(void* arg, uint32_t begin, uint32_t end, uint32_t workerIndex) {
+    CpuSimulation* sim = (CpuSimulation*)arg;
+    sim->simdForce(&sim->arrays[sim->current], &sim->arrays[1 - sim->current], begin, end, sim->timeStep);
+}
+
+void cpuFmmUpdateBlock(void* arg, uint32_t begin, uint32_t end, uint32_t workerIndex) {
+    CpuSimulation* sim = (CpuSimulation*)arg;
+    Particle* particlesOut = sim->particles[1 - sim->current];
+
+    for (uint32_t i = begin; i < end; i++) {
+        particlesOut[i].vel.x += sim->accelerations[i].x * sim->timeStep;
+        particlesOut[i].vel.y += sim->accelerations[i].y * sim->timeStep;
+        particlesOut[i].pos.x += particlesOut[i].vel.x;
+        particlesOut[i].pos.y += particlesOut[i].vel.y;
+    }
+}
+
+void stepCpuSimulation(CpuSimulation* sim) {
+    if (sim->kernel == CPU_KERNEL_FMM) {
+        fmmAccelerations(&sim->fmm, &sim->pool, sim->particles[sim->current], sim->accelerations);
+        threadPoolParallelFor(&sim->pool, sim->particleCount, sim->blockSize, cpuFmmUpdateBlock, sim);
+        sim->current = 1 - sim->current;
+        return;
+    }
+
+    RangeFunction force = sim->kernel == CPU_KERNEL_SIMD ? cpuSimdForceBlock : cpuForceBlock;
+    threadPoolParallelFor(&sim->pool, sim->particleCount, sim->blockSize, force, sim);
+    sim->current = 1 - sim->current;
+}
+
+// Latest state as Particles, converted from the arrays when the SIMD kernel is used.
+const Particle* cpuSimulationSnapshot(CpuSimulation* sim) {
+    if (sim->kernel == CPU_KERNEL_SIMD) {
+        arraysToParticles(&sim->arrays[sim->current], sim->particles[sim->current]);
+    }
+    return sim->particles[sim->current];
+}
+
+void destroyCpuSimulation(CpuSimulation* sim) {
+    destroyThreadPool(&sim->pool);
+    if (sim->kernel == CPU_KERNEL_SIMD) {
+        destroyParticleArrays(&sim->arrays[0]);
+        destroyParticleArrays(&sim->arrays[1]);
+    }
+    else if (sim->kernel == CPU_KERNEL_FMM) {
+        destroyFmmSolver(&sim->fmm);
+        free(sim->accelerations);
+    }
+    free(sim->particles[0]);
+    free(sim->particles[1]);
+}
+
+void runCpuBackend(Context* context) {
+    Particle* particles = (Particle*)malloc(context->PARTICLE_COUNT * sizeof(Particle));
+    generateParticles(particles, context->PARTICLE_COUNT, context->initialConditions);
+
+    CpuSimulation sim;
+    createCpuSimulation(&sim, particles, context->PARTICLE_COUNT, context->timeStep, context->threadCount, context->cpuKernel,
+        context->fmmOrder, context->fmmTheta);
+
+    const char* kernelName = "array-of-structs";
+    if (sim.kernel == CPU_KERNEL_SIMD) kernelName = simdLevelName(sim.simdLevel);
+    if (sim.kernel == CPU_KERNEL_FMM) kernelName = "fast multipole";
+    printf("CPU backend: %u particles, %u threads, %s kernel\n", context->PARTICLE_COUNT, sim.pool.workerCount, kernelName);
+
+    if (sim.kernel == CPU_KERNEL_FMM && context->compareWithDirect) {
+        compareFmmWithDirect(context, &sim.pool, particles);
+    }
+    free(particles);
+
+    // the FMM is counted by the direct interactions it stands in for
+    double interactionsPerStep = (double)context->PARTICLE_COUNT * (double)context->PARTICLE_COUNT;
+    double startTime = getTime();
+    double printTime = startTime;
+    uint32_t printStep = 0;
+    for (uint32_t step = 0; step < context->stepCount; step++) {
+        stepCpuSimulation(&sim);
+
+        double now = getTime();
+        if (now - printTime >= 1.0) {
+            double stepsPerSecond = (step + 1 - printStep) / (now - printTime);
+            printf("steps/s: %.1lf\t interactions/s: %.3e\n", stepsPerSecond, stepsPerSecond * interactionsPerStep);
+            printTime = now;
+            printStep = step + 1;
+        }
+    }
+    double elapsed = getTime() - startTime;
+    if (context->stepCount > 0 && elapsed > 0.0) {
+        double stepsPerSecond = context->stepCount / elapsed;
+        printf("%u steps in %.2lf s\t steps/s: %.1lf\t interactions/s: %.3e\n", context->stepCount, elapsed, stepsPerSecond, stepsPerSecond * interactionsPerStep);
+    }
+
+    destroyCpuSimulation(&sim);
+}
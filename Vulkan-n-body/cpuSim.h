@@ -0,0 +1,38 @@
+#ifndef CPUSIM_H
+#define CPUSIM_H
+
+#include "types.h"
+#include "threadPool.h"
+#include "cpuSimd.h"
+#include "fmm.h"
+
+typedef struct CpuSimulation {
+    uint32_t particleCount;
+    Particle* particles[2]; // ping-pong pair, like the two shaderStorageBuffers
+    uint32_t current;       // index of the latest state
+    float timeStep;
+    uint32_t blockSize;
+    ThreadPool pool;
+
+    // CPU_KERNEL_SIMD keeps the state in arrays and only fills particles on snapshot
+    CpuKernel kernel;
+    SimdLevel simdLevel;
+    SimdForceFunction simdForce;
+    ParticleArrays arrays[2];
+
+    // CPU_KERNEL_FMM computes the accelerations of the latest state, then updates like cpuForceBlock
+    FmmSolver fmm;
+    vec2* accelerations;
+} CpuSimulation;
+
+void createCpuSimulation(CpuSimulation* sim, const Particle* initial, uint32_t particleCount, float timeStep, uint32_t threadCount, CpuKernel kernel, uint32_t fmmOrder, float fmmTheta);
+void stepCpuSimulation(CpuSimulation* sim);
+void cpuForceBlock(void* arg, uint32_t begin, uint32_t end, uint32_t workerIndex);
+void cpuSimdForceBlock(void* arg, uint32_t begin, uint32_t end, uint32_t workerIndex);
+void cpuFmmUpdateBlock(void* arg, uint32_t begin, uint32_t end, uint32_t workerIndex);
+const Particle* cpuSimulationSnapshot(CpuSimulation* sim);
+void destroyCpuSimulation(CpuSimulation* sim);
+
+void runCpuBackend(Context* context);
+
+#endif
@@ -0,0 +1,320 @@
+#include "cpuSimd.h"
+#include "cpuSim.h"
+#include "particles.h"
+#include "platform.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SIMD_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC compiles intrinsics for any instruction set without extra flags
+#define TARGET_AVX2
+#define TARGET_AVX512
+#else
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#else
+#define SIMD_X86 0
+#endif
+
+SimdLevel detectSimdLevel(void) {
+#if SIMD_X86
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    if (maxLeaf < 7) {
+        return SIMD_SCALAR;
+    }
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool fma = (info[2] & (1 << 12)) != 0;
+    if (!osxsave) {
+        return SIMD_SCALAR;
+    }
+    unsigned long long xcr0 = _xgetbv(0);
+    bool osAvx = (xcr0 & 0x6) == 0x6;      // xmm and ymm state
+    bool osAvx512 = (xcr0 & 0xE6) == 0xE6; // plus opmask and zmm state
+    __cpuidex(info, 7, 0);
+    bool avx2 = (info[1] & (1 << 5)) != 0;
+    bool avx512f = (info[1] & (1 << 16)) != 0;
+    if (avx512f && osAvx512) {
+        return SIMD_AVX512;
+    }
+    if (avx2 && fma && osAvx) {
+        return SIMD_AVX2;
+    }
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return SIMD_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return SIMD_AVX2;
+    }
+#endif
+#endif
+    return SIMD_SCALAR;
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+    case SIMD_AVX512:
+        return "AVX-512";
+    case SIMD_AVX2:
+        return "AVX2";
+    case SIMD_SCALAR:
+    default:
+        return "scalar";
+    }
+}
+
+SimdForceFunction getSimdForceFunction(SimdLevel level) {
+    switch (level) {
+    case SIMD_AVX512:
+        return simdForceAvx512;
+    case SIMD_AVX2:
+        return simdForceAvx2;
+    case SIMD_SCALAR:
+    default:
+        return simdForceScalar;
+    }
+}
+
+float* allocateAligned(uint32_t count) {
+    size_t size = sizeof(float) * count;
+#ifdef _MSC_VER
+    float* data = (float*)_aligned_malloc(size, SIMD_ALIGNMENT);
+#else
+    float* data = (float*)aligned_alloc(SIMD_ALIGNMENT, size);
+#endif
+    if (data == NULL) {
+        printf("Failed to allocate particle arrays!\n");
+        exit(1);
+    }
+    memset(data, 0, size);
+    return data;
+}
+
+void freeAligned(float* data) {
+#ifdef _MSC_VER
+    _aligned_free(data);
+#else
+    free(data);
+#endif
+}
+
+void createParticleArrays(ParticleArrays* arrays, uint32_t count) {
+    arrays->count = count;
+    arrays->paddedCount = (count + SIMD_MAX_WIDTH - 1) / SIMD_MAX_WIDTH * SIMD_MAX_WIDTH;
+    arrays->x = allocateAligned(arrays->paddedCount);
+    arrays->y = allocateAligned(arrays->paddedCount);
+    arrays->velX = allocateAligned(arrays->paddedCount);
+    arrays->velY = allocateAligned(arrays->paddedCount);
+    arrays->mss = allocateAligned(arrays->paddedCount);
+}
+
+void destroyParticleArrays(ParticleArrays* arrays) {
+    freeAligned(arrays->x);
+    freeAligned(arrays->y);
+    freeAligned(arrays->velX);
+    freeAligned(arrays->velY);
+    freeAligned(arrays->mss);
+}
+
+void particlesToArrays(const Particle* particles, ParticleArrays* arrays) {
+    for (uint32_t i = 0; i < arrays->count; i++) {
+        arrays->x[i] = particles[i].pos.x;
+        arrays->y[i] = particles[i].pos.y;
+        arrays->velX[i] = particles[i].vel.x;
+        arrays->velY[i] = particles[i].vel.y;
+        arrays->mss[i] = particles[i].mss;
+    }
+}
+
+void arraysToParticles(const ParticleArrays* arrays, Particle* particles) {
+    for (uint32_t i = 0; i < arrays->count; i++) {
+        particles[i].pos.x = arrays->x[i];
+        particles[i].pos.y = arrays->y[i];
+        particles[i].vel.x = arrays->velX[i];
+        particles[i].vel.y = arrays->velY[i];
+        particles[i].mss = arrays->mss[i];
+    }
+}
+
+// All kernels use the force law of shader.comp and write the same update as
+// cpuForceBlock. Padding particles have zero mass and contribute nothing.
+
+void simdForceScalar(const ParticleArrays* in, ParticleArrays* out, uint32_t begin, uint32_t end, float timeStep) {
+    for (uint32_t i = begin; i < end; i++) {
+        float posX = in->x[i];
+        float posY = in->y[i];
+        float sumX = 0;
+        float sumY = 0;
+        for (uint32_t j = 0; j < in->paddedCount; j++) {
+            float distanceX = in->x[j] - posX;
+            float distanceY = in->y[j] - posY;
+            float x2_y2 = distanceX * distanceX + distanceY * distanceY;
+            float dist = 1.0f / sqrtf(x2_y2 * x2_y2 * x2_y2 + SOFTENING);
+            float b = in->mss[j] * dist;
+            sumX += distanceX * b;
+            sumY += distanceY * b;
+        }
+        out->velX[i] += sumX * timeStep;
+        out->velY[i] += sumY * timeStep;
+        out->x[i] += out->velX[i];
+        out->y[i] += out->velY[i];
+    }
+}
+
+#if SIMD_X86
+
+TARGET_AVX2 float horizontalSumAvx2(__m256 v) {
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+TARGET_AVX2 void simdForceAvx2(const ParticleArrays* in, ParticleArrays* out, uint32_t begin, uint32_t end, float timeStep) {
+    const __m256 softening = _mm256_set1_ps(SOFTENING);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 threeHalves = _mm256_set1_ps(1.5f);
+
+    for (uint32_t i = begin; i < end; i++) {
+        __m256 posX = _mm256_set1_ps(in->x[i]);
+        __m256 posY = _mm256_set1_ps(in->y[i]);
+        __m256 sumX = _mm256_setzero_ps();
+        __m256 sumY = _mm256_setzero_ps();
+        for (uint32_t j = 0; j < in->paddedCount; j += 8) {
+            __m256 distanceX = _mm256_sub_ps(_mm256_load_ps(in->x + j), posX);
+            __m256 distanceY = _mm256_sub_ps(_mm256_load_ps(in->y + j), posY);
+            __m256 x2_y2 = _mm256_fmadd_ps(distanceX, distanceX, _mm256_mul_ps(distanceY, distanceY));
+            __m256 s = _mm256_fmadd_ps(_mm256_mul_ps(x2_y2, x2_y2), x2_y2, softening);
+
+            // 12 bit estimate, one Newton step: y * (1.5 - 0.5 * s * y * y)
+            __m256 dist = _mm256_rsqrt_ps(s);
+            dist = _mm256_mul_ps(dist, _mm256_fnmadd_ps(_mm256_mul_ps(half, s), _mm256_mul_ps(dist, dist), threeHalves));
+
+            __m256 b = _mm256_mul_ps(_mm256_load_ps(in->mss + j), dist);
+            sumX = _mm256_fmadd_ps(distanceX, b, sumX);
+            sumY = _mm256_fmadd_ps(distanceY, b, sumY);
+        }
+        out->velX[i] += horizontalSumAvx2(sumX) * timeStep;
+        out->velY[i] += horizontalSumAvx2(sumY) * timeStep;
+        out->x[i] += out->velX[i];
+        out->y[i] += out->velY[i];
+    }
+}
+
+TARGET_AVX512 void simdForceAvx512(const ParticleArrays* in, ParticleArrays* out, uint32_t begin, uint32_t end, float timeStep) {
+    const __m512 softening = _mm512_set1_ps(SOFTENING);
+    const __m512 half = _mm512_set1_ps(0.5f);
+    const __m512 threeHalves = _mm512_set1_ps(1.5f);
+
+    for (uint32_t i = begin; i < end; i++) {
+        __m512 posX = _mm512_set1_ps(in->x[i]);
+        __m512 posY = _mm512_set1_ps(in->y[i]);
+        __m512 sumX = _mm512_setzero_ps();
+        __m512 sumY = _mm512_setzero_ps();
+        for (uint32_t j = 0; j < in->paddedCount; j += 16) {
+            __m512 distanceX = _mm512_sub_ps(_mm512_load_ps(in->x + j), posX);
+            __m512 distanceY = _mm512_sub_ps(_mm512_load_ps(in->y + j), posY);
+            __m512 x2_y2 = _mm512_fmadd_ps(distanceX, distanceX, _mm512_mul_ps(distanceY, distanceY));
+            __m512 s = _mm512_fmadd_ps(_mm512_mul_ps(x2_y2, x2_y2), x2_y2, softening);
+
+            // 14 bit estimate, one Newton step
+            __m512 dist = _mm512_rsqrt14_ps(s);
+            dist = _mm512_mul_ps(dist, _mm512_fnmadd_ps(_mm512_mul_ps(half, s), _mm512_mul_ps(dist, dist), threeHalves));
+
+            __m512 b = _mm512_mul_ps(_mm512_load_ps(in->mss + j), dist);
+            sumX = _mm512_fmadd_ps(distanceX, b, sumX);
+            sumY = _mm512_fmadd_ps(distanceY, b, sumY);
+        }
+        out->velX[i] += _mm512_reduce_add_ps(sumX) * timeStep;
+        out->velY[i] += _mm512_reduce_add_ps(sumY) * timeStep;
+        out->x[i] += out->velX[i];
+        out->y[i] += out->velY[i];
+    }
+}
+
+#else
+
+void simdForceAvx2(const ParticleArrays* in, ParticleArrays* out, uint32_t begin, uint32_t end, float timeStep) {
+    simdForceScalar(in, out, begin, end, timeStep);
+}
+
+void simdForceAvx512(const ParticleArrays* in, ParticleArrays* out, uint32_t begin, uint32_t end, float timeStep) {
+    simdForceScalar(in, out, begin, end, timeStep);
+}
+
+#endif
+
+// Single threaded GFLOP/s of the array-of-structs loop against every kernel
+// this processor supports, all from the same initial state.
+void runCpuKernelBenchmark(uint32_t particleCount) {
+    const double MIN_SECONDS = 0.5;
+
+    Particle* particles = (Particle*)malloc(sizeof(Particle) * particleCount);
+    Particle* particlesOut = (Particle*)malloc(sizeof(Particle) * particleCount);
+    initParticles(particles, particleCount);
+
+    ParticleArrays in, out;
+    createParticleArrays(&in, particleCount);
+    createParticleArrays(&out, particleCount);
+    particlesToArrays(particles, &in);
+
+    SimdLevel maxLevel = detectSimdLevel();
+    printf("CPU kernel benchmark: %u particles, widest instruction set %s\n", particleCount, simdLevelName(maxLevel));
+
+    double interactions = (double)particleCount * (double)particleCount;
+    double scalarGflops = 0.0;
+
+    // baseline: the array-of-structs loop of the CPU backend
+    {
+        CpuSimulation sim = {
+            .particleCount = particleCount,
+            .particles = { particles, particlesOut },
+            .current = 0,
+            .timeStep = 0.001f
+        };
+        memcpy(particlesOut, particles, sizeof(Particle) * particleCount);
+        uint32_t repetitions = 0;
+        double start = getTime();
+        double elapsed = 0.0;
+        do {
+            cpuForceBlock(&sim, 0, particleCount, 0);
+            repetitions++;
+            elapsed = getTime() - start;
+        } while (elapsed < MIN_SECONDS);
+        scalarGflops = repetitions * interactions * FLOPS_PER_INTERACTION / elapsed * 1e-9;
+        printf("%-10s %8.2lf GFLOP/s\n", "AoS loop", scalarGflops);
+    }
+
+    for (int level = SIMD_SCALAR; level <= (int)maxLevel; level++) {
+        SimdForceFunction force = getSimdForceFunction((SimdLevel)level);
+        particlesToArrays(particles, &out);
+        uint32_t repetitions = 0;
+        double start = getTime();
+        double elapsed = 0.0;
+        do {
+            force(&in, &out, 0, particleCount, 0.001f);
+            repetitions++;
+            elapsed = getTime() - start;
+        } while (elapsed < MIN_SECONDS);
+        double gflops = repetitions * interactions * FLOPS_PER_INTERACTION / elapsed * 1e-9;
+        printf("%-10s %8.2lf GFLOP/s\t %.2lfx\n", simdLevelName((SimdLevel)level), gflops, gflops / scalarGflops);
+    }
+
+    destroyParticleArrays(&in);
+    destroyParticleArrays(&out);
+    free(particles);
+    free(particlesOut);
+}
@@ -0,0 +1,49 @@
+#ifndef CPUSIMD_H
+#define CPUSIMD_H
+
+#include "types.h"
+
+// Lane width of the widest kernel, arrays are padded to a multiple of it with
+// massless particles so no kernel needs a remainder loop.
+#define SIMD_MAX_WIDTH 16
+#define SIMD_ALIGNMENT 64
+
+// Flops counted per pair interaction when reporting GFLOP/s
+#define FLOPS_PER_INTERACTION 20
+
+typedef enum SimdLevel {
+    SIMD_SCALAR,
+    SIMD_AVX2,  // 8 lanes, AVX2 + FMA
+    SIMD_AVX512 // 16 lanes, AVX-512F
+} SimdLevel;
+
+// Structure-of-arrays copy of the particle state. Only x, y and mss are
+// streamed by the force loop.
+typedef struct ParticleArrays {
+    uint32_t count;       // real particles
+    uint32_t paddedCount; // multiple of SIMD_MAX_WIDTH
+    float* x;
+    float* y;
+    float* velX;
+    float* velY;
+    float* mss;
+} ParticleArrays;
+
+typedef void (*SimdForceFunction)(const ParticleArrays* in, ParticleArrays* out, uint32_t begin, uint32_t end, float timeStep);
+
+SimdLevel detectSimdLevel(void);
+const char* simdLevelName(SimdLevel level);
+SimdForceFunction getSimdForceFunction(SimdLevel level);
+
+void createParticleArrays(ParticleArrays* arrays, uint32_t count);
+void destroyParticleArrays(ParticleArrays* arrays);
+void particlesToArrays(const Particle* particles, ParticleArrays* arrays);
+void arraysToParticles(const ParticleArrays* arrays, Particle* particles);
+
+void simdForceScalar(const ParticleArrays* in, ParticleArrays* out, uint32_t begin, uint32_t end, float timeStep);
+void simdForceAvx2(const ParticleArrays* in, ParticleArrays* out, uint32_t begin, uint32_t end, float timeStep);
+void simdForceAvx512(const ParticleArrays* in, ParticleArrays* out, uint32_t begin, uint32_t end, float timeStep);
+
+void runCpuKernelBenchmark(uint32_t particleCount);
+
+#endif
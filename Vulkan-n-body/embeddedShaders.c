@@ -0,0 +1,143 @@
+#include "embeddedShaders.h"
+
+#include <string.h>
+
+// Each .spv.inc is a brace enclosed list of SPIR-V words written by glslc -mfmt=c when
+// shaders/compile.bat (or compile.sh) runs as the pre-build step.
+const uint32_t vertSpv[] =
+#include "shaders/compiled/vert.spv.inc"
+;
+const uint32_t fragSpv[] =
+#include "shaders/compiled/frag.spv.inc"
+;
+const uint32_t compSpv[] =
+#include "shaders/compiled/comp.spv.inc"
+;
+const uint32_t compTiledSpv[] =
+#include "shaders/compiled/comp_tiled.spv.inc"
+;
+const uint32_t bhBoundsSpv[] =
+#include "shaders/compiled/bh_bounds.spv.inc"
+;
+const uint32_t bhMortonSpv[] =
+#include "shaders/compiled/bh_morton.spv.inc"
+;
+const uint32_t bhSortCountSpv[] =
+#include "shaders/compiled/bh_sort_count.spv.inc"
+;
+const uint32_t bhSortScanSpv[] =
+#include "shaders/compiled/bh_sort_scan.spv.inc"
+;
+const uint32_t bhSortScatterSpv[] =
+#include "shaders/compiled/bh_sort_scatter.spv.inc"
+;
+const uint32_t bhLeavesSpv[] =
+#include "shaders/compiled/bh_leaves.spv.inc"
+;
+const uint32_t bhUpsweepSpv[] =
+#include "shaders/compiled/bh_upsweep.spv.inc"
+;
+const uint32_t bhForceSpv[] =
+#include "shaders/compiled/bh_force.spv.inc"
+;
+const uint32_t renderPackSpv[] =
+#include "shaders/compiled/render_pack.spv.inc"
+;
+const uint32_t densitySplatSpv[] =
+#include "shaders/compiled/density_splat.spv.inc"
+;
+const uint32_t blockDriftSpv[] =
+#include "shaders/compiled/block_drift.spv.inc"
+;
+const uint32_t blockDispatchSpv[] =
+#include "shaders/compiled/block_dispatch.spv.inc"
+;
+const uint32_t blockForceSpv[] =
+#include "shaders/compiled/block_force.spv.inc"
+;
+const uint32_t timeStepReduceSpv[] =
+#include "shaders/compiled/time_step_reduce.spv.inc"
+;
+const uint32_t timeStepUpdateSpv[] =
+#include "shaders/compiled/time_step_update.spv.inc"
+;
+const uint32_t pmBoundsSpv[] =
+#include "shaders/compiled/pm_bounds.spv.inc"
+;
+const uint32_t pmPlaceSpv[] =
+#include "shaders/compiled/pm_place.spv.inc"
+;
+const uint32_t pmKernelSpv[] =
+#include "shaders/compiled/pm_kernel.spv.inc"
+;
+const uint32_t pmDepositSpv[] =
+#include "shaders/compiled/pm_deposit.spv.inc"
+;
+const uint32_t pmDeposit64Spv[] =
+#include "shaders/compiled/pm_deposit64.spv.inc"
+;
+const uint32_t pmLoadSpv[] =
+#include "shaders/compiled/pm_load.spv.inc"
+;
+const uint32_t pmLoad64Spv[] =
+#include "shaders/compiled/pm_load64.spv.inc"
+;
+const uint32_t pmFftSpv[] =
+#include "shaders/compiled/pm_fft.spv.inc"
+;
+const uint32_t pmMultiplySpv[] =
+#include "shaders/compiled/pm_multiply.spv.inc"
+;
+const uint32_t pmInterpolateSpv[] =
+#include "shaders/compiled/pm_interpolate.spv.inc"
+;
+const uint32_t fullscreenVertSpv[] =
+#include "shaders/compiled/fullscreen_vert.spv.inc"
+;
+const uint32_t densityTonemapFragSpv[] =
+#include "shaders/compiled/density_tonemap_frag.spv.inc"
+;
+
+const EmbeddedShader embeddedShaders[] = {
+    { "vert", vertSpv, sizeof(vertSpv) },
+    { "frag", fragSpv, sizeof(fragSpv) },
+    { "comp", compSpv, sizeof(compSpv) },
+    { "comp_tiled", compTiledSpv, sizeof(compTiledSpv) },
+    { "bh_bounds", bhBoundsSpv, sizeof(bhBoundsSpv) },
+    { "bh_morton", bhMortonSpv, sizeof(bhMortonSpv) },
+    { "bh_sort_count", bhSortCountSpv, sizeof(bhSortCountSpv) },
+    { "bh_sort_scan", bhSortScanSpv, sizeof(bhSortScanSpv) },
+    { "bh_sort_scatter", bhSortScatterSpv, sizeof(bhSortScatterSpv) },
+    { "bh_leaves", bhLeavesSpv, sizeof(bhLeavesSpv) },
+    { "bh_upsweep", bhUpsweepSpv, sizeof(bhUpsweepSpv) },
+    { "bh_force", bhForceSpv, sizeof(bhForceSpv) },
+    { "render_pack", renderPackSpv, sizeof(renderPackSpv) },
+    { "density_splat", densitySplatSpv, sizeof(densitySplatSpv) },
+    { "block_drift", blockDriftSpv, sizeof(blockDriftSpv) },
+    { "block_dispatch", blockDispatchSpv, sizeof(blockDispatchSpv) },
+    { "block_force", blockForceSpv, sizeof(blockForceSpv) },
+    { "time_step_reduce", timeStepReduceSpv, sizeof(timeStepReduceSpv) },
+    { "time_step_update", timeStepUpdateSpv, sizeof(timeStepUpdateSpv) },
+    { "pm_bounds", pmBoundsSpv, sizeof(pmBoundsSpv) },
+    { "pm_place", pmPlaceSpv, sizeof(pmPlaceSpv) },
+    { "pm_kernel", pmKernelSpv, sizeof(pmKernelSpv) },
+    { "pm_deposit", pmDepositSpv, sizeof(pmDepositSpv) },
+    { "pm_deposit64", pmDeposit64Spv, sizeof(pmDeposit64Spv) },
+    { "pm_load", pmLoadSpv, sizeof(pmLoadSpv) },
+    { "pm_load64", pmLoad64Spv, sizeof(pmLoad64Spv) },
+    { "pm_fft", pmFftSpv, sizeof(pmFftSpv) },
+    { "pm_multiply", pmMultiplySpv, sizeof(pmMultiplySpv) },
+    { "pm_interpolate", pmInterpolateSpv, sizeof(pmInterpolateSpv) },
+    { "fullscreen_vert", fullscreenVertSpv, sizeof(fullscreenVertSpv) },
+    { "density_tonemap_frag", densityTonemapFragSpv, sizeof(densityTonemapFragSpv) }
+};
+const uint32_t embeddedShaderCount = sizeof(embeddedShaders) / sizeof(embeddedShaders[0]);
+
+const EmbeddedShader* findEmbeddedShader(const char* name) {
+    for (uint32_t i = 0; i < embeddedShaderCount; i++) {
+        if (strcmp(embeddedShaders[i].name, name) == 0) {
+            return &embeddedShaders[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,18 @@
+#ifndef EMBEDDEDSHADERS_H
+#define EMBEDDEDSHADERS_H
+
+#include <stdint.h>
+
+// SPIR-V compiled into the binary, name is the file name in shaders/compiled without .spv
+typedef struct EmbeddedShader {
+    const char* name;
+    const uint32_t* code;
+    uint32_t codeSize; // bytes
+} EmbeddedShader;
+
+extern const EmbeddedShader embeddedShaders[];
+extern const uint32_t embeddedShaderCount;
+
+const EmbeddedShader* findEmbeddedShader(const char* name);
+
+#endif
@@ -0,0 +1,731 @@
+#include "fmm.h"
+#include "cpuSim.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The force of shader.comp, a = sum m d / sqrt(|d|^6 + SOFTENING), is the gradient of
+//   psi(z) = sum m G(|z - w|^2),  G'(s) = -h(s) / 2,  h(s) = (s^3 + SOFTENING)^(-1/2)
+// which isn't harmonic, so the Laurent series of the usual 2D FMM don't apply. Treating z
+// and conj(z) as independent variables, G(|z - w|^2) is still a Taylor series around the
+// distance D between two well separated cells:
+//   multipole  M_kl = sum m W^k conj(W)^l                     W = w - source center
+//   local      L_nm = sum_kl T_(n+k)(m+l)(D) (-1)^(k+l) M_kl / (n! m! k! l!)
+//   force      a_x + i a_y = 2 sum_nm m L_nm Y^n conj(Y)^(m-1)  Y = z - target center
+// with T_ab(D) = d^a/dD^a d^b/dconj(D)^b G(D conj(D)), truncated at total order k + l + n + m.
+// The series converges while the cells' radii add up to less than half their distance.
+
+Complex complexAdd(Complex a, Complex b) {
+    Complex result = { a.re + b.re, a.im + b.im };
+    return result;
+}
+
+Complex complexMultiply(Complex a, Complex b) {
+    Complex result = { a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re };
+    return result;
+}
+
+Complex complexScale(Complex a, double scale) {
+    Complex result = { a.re * scale, a.im * scale };
+    return result;
+}
+
+Complex complexConjugate(Complex a) {
+    Complex result = { a.re, -a.im };
+    return result;
+}
+
+// Coefficients ordered by total order k + l, then by l
+uint32_t fmmTermIndex(uint32_t k, uint32_t l) {
+    return (k + l) * (k + l + 1) / 2 + l;
+}
+
+void createFmmSolver(FmmSolver* solver, uint32_t particleCount, uint32_t order, float theta) {
+    if (order < 1 || order > FMM_MAX_ORDER) {
+        printf("fmmOrder must be from 1 to %u!\n", FMM_MAX_ORDER);
+        exit(1);
+    }
+    if (theta <= 0.0f || theta >= 0.5f) {
+        printf("fmmTheta must be between 0 and 0.5, the expansions of the softened kernel diverge beyond!\n");
+        exit(1);
+    }
+
+    memset(solver, 0, sizeof(FmmSolver));
+    solver->particleCount = particleCount;
+    solver->order = order;
+    solver->termCount = (order + 1) * (order + 2) / 2;
+    solver->theta = theta;
+
+    solver->sortedIndices = (uint32_t*)malloc(sizeof(uint32_t) * particleCount);
+    solver->keys = (uint32_t*)malloc(sizeof(uint32_t) * particleCount);
+    solver->scratchIndices = (uint32_t*)malloc(sizeof(uint32_t) * particleCount);
+    solver->scratchKeys = (uint32_t*)malloc(sizeof(uint32_t) * particleCount);
+    solver->posX = (double*)malloc(sizeof(double) * particleCount);
+    solver->posY = (double*)malloc(sizeof(double) * particleCount);
+    solver->mass = (double*)malloc(sizeof(double) * particleCount);
+    solver->accX = (double*)malloc(sizeof(double) * particleCount);
+    solver->accY = (double*)malloc(sizeof(double) * particleCount);
+}
+
+void destroyFmmSolver(FmmSolver* solver) {
+    free(solver->sortedIndices);
+    free(solver->keys);
+    free(solver->scratchIndices);
+    free(solver->scratchKeys);
+    free(solver->posX);
+    free(solver->posY);
+    free(solver->mass);
+    free(solver->accX);
+    free(solver->accY);
+
+    free(solver->cells);
+    free(solver->multipoles);
+    free(solver->locals);
+    free(solver->m2lPairs.pairs);
+    free(solver->p2pPairs.pairs);
+    FmmList* lists[3] = { &solver->m2l, &solver->p2p, &solver->m2lUsers };
+    for (uint32_t i = 0; i < 3; i++) {
+        free(lists[i]->offsets);
+        free(lists[i]->cells);
+    }
+    free((void*)solver->upwardPending);
+    free((void*)solver->m2lPending);
+    free((void*)solver->downwardPending);
+    free(solver->taskArgs);
+}
+
+uint32_t spreadMortonBits(uint32_t value) {
+    value &= 0xffff;
+    value = (value | (value << 8)) & 0x00ff00ff;
+    value = (value | (value << 4)) & 0x0f0f0f0f;
+    value = (value | (value << 2)) & 0x33333333;
+    value = (value | (value << 1)) & 0x55555555;
+    return value;
+}
+
+// Morton keys in the bounding square of the particles, radix sorted a byte per pass
+void sortFmmParticles(FmmSolver* solver, const Particle* particles) {
+    uint32_t count = solver->particleCount;
+    double minX = particles[0].pos.x, maxX = minX;
+    double minY = particles[0].pos.y, maxY = minY;
+    for (uint32_t i = 1; i < count; i++) {
+        if (particles[i].pos.x < minX) minX = particles[i].pos.x;
+        if (particles[i].pos.x > maxX) maxX = particles[i].pos.x;
+        if (particles[i].pos.y < minY) minY = particles[i].pos.y;
+        if (particles[i].pos.y > maxY) maxY = particles[i].pos.y;
+    }
+    double size = fmax(maxX - minX, maxY - minY) * 1.0001 + 1e-6;
+    double keyScale = (1 << FMM_MAX_LEVEL) / size;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t keyX = (uint32_t)((particles[i].pos.x - minX) * keyScale);
+        uint32_t keyY = (uint32_t)((particles[i].pos.y - minY) * keyScale);
+        if (keyX >= 1 << FMM_MAX_LEVEL) keyX = (1 << FMM_MAX_LEVEL) - 1;
+        if (keyY >= 1 << FMM_MAX_LEVEL) keyY = (1 << FMM_MAX_LEVEL) - 1;
+        solver->keys[i] = spreadMortonBits(keyX) | (spreadMortonBits(keyY) << 1);
+        solver->sortedIndices[i] = i;
+    }
+
+    for (uint32_t shift = 0; shift < 32; shift += 8) {
+        uint32_t offsets[256] = { 0 };
+        for (uint32_t i = 0; i < count; i++) {
+            offsets[(solver->keys[i] >> shift) & 0xff]++;
+        }
+        uint32_t sum = 0;
+        for (uint32_t digit = 0; digit < 256; digit++) {
+            uint32_t digitCount = offsets[digit];
+            offsets[digit] = sum;
+            sum += digitCount;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t slot = offsets[(solver->keys[i] >> shift) & 0xff]++;
+            solver->scratchKeys[slot] = solver->keys[i];
+            solver->scratchIndices[slot] = solver->sortedIndices[i];
+        }
+        uint32_t* swap = solver->keys;
+        solver->keys = solver->scratchKeys;
+        solver->scratchKeys = swap;
+        swap = solver->sortedIndices;
+        solver->sortedIndices = solver->scratchIndices;
+        solver->scratchIndices = swap;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const Particle* particle = &particles[solver->sortedIndices[i]];
+        solver->posX[i] = particle->pos.x;
+        solver->posY[i] = particle->pos.y;
+        solver->mass[i] = particle->mss;
+    }
+
+    solver->cellCount = 0;
+    buildFmmCell(solver, 0, count, 0, minX, minY, size, -1);
+}
+
+// Cells are stored parents first, a cell's children are split off the sorted range
+// by the two key bits of their level.
+uint32_t buildFmmCell(FmmSolver* solver, uint32_t begin, uint32_t end, uint32_t level, double lowerX, double lowerY, double size, int32_t parent) {
+    if (solver->cellCount == solver->cellCapacity) {
+        solver->cellCapacity = solver->cellCapacity ? solver->cellCapacity * 2 : 1024;
+        solver->cells = (FmmCell*)realloc(solver->cells, sizeof(FmmCell) * solver->cellCapacity);
+    }
+    uint32_t index = solver->cellCount++;
+    FmmCell cell = {
+        .centerX = lowerX + 0.5 * size,
+        .centerY = lowerY + 0.5 * size,
+        .halfSize = 0.5 * size,
+        .radius = 0.0,
+        .begin = begin,
+        .end = end,
+        .parent = parent,
+        .children = { -1, -1, -1, -1 },
+        .level = level
+    };
+
+    if (end - begin > FMM_LEAF_SIZE && level < FMM_MAX_LEVEL) {
+        uint32_t shift = 2 * (FMM_MAX_LEVEL - 1 - level);
+        uint32_t childBegin = begin;
+        for (uint32_t quadrant = 0; quadrant < 4; quadrant++) {
+            uint32_t childEnd = childBegin;
+            while (childEnd < end && ((solver->keys[childEnd] >> shift) & 3) == quadrant) {
+                childEnd++;
+            }
+            if (childEnd > childBegin) {
+                uint32_t child = buildFmmCell(solver, childBegin, childEnd, level + 1,
+                    lowerX + (quadrant & 1) * 0.5 * size, lowerY + (quadrant >> 1) * 0.5 * size, 0.5 * size, (int32_t)index);
+                const FmmCell* childCell = &solver->cells[child];
+                double offset = hypot(childCell->centerX - cell.centerX, childCell->centerY - cell.centerY);
+                cell.radius = fmax(cell.radius, offset + childCell->radius);
+                cell.children[quadrant] = (int32_t)child;
+            }
+            childBegin = childEnd;
+        }
+    }
+    else {
+        for (uint32_t i = begin; i < end; i++) {
+            cell.radius = fmax(cell.radius, hypot(solver->posX[i] - cell.centerX, solver->posY[i] - cell.centerY));
+        }
+    }
+
+    solver->cells[index] = cell;
+    return index;
+}
+
+void addFmmPair(FmmPairs* pairs, uint32_t target, uint32_t source) {
+    if (pairs->count == pairs->capacity) {
+        pairs->capacity = pairs->capacity ? pairs->capacity * 2 : 4096;
+        pairs->pairs = (uint32_t*)realloc(pairs->pairs, sizeof(uint32_t) * 2 * pairs->capacity);
+    }
+    pairs->pairs[2 * pairs->count] = target;
+    pairs->pairs[2 * pairs->count + 1] = source;
+    pairs->count++;
+}
+
+// Dual tree walk: well separated pairs become M2L, touching leaves P2P, otherwise
+// the bigger of the two cells is opened.
+void traverseFmmCells(FmmSolver* solver, uint32_t target, uint32_t source) {
+    const FmmCell* targetCell = &solver->cells[target];
+    const FmmCell* sourceCell = &solver->cells[source];
+    double distance = hypot(targetCell->centerX - sourceCell->centerX, targetCell->centerY - sourceCell->centerY);
+
+    if (targetCell->radius + sourceCell->radius < solver->theta * distance) {
+        addFmmPair(&solver->m2lPairs, target, source);
+        return;
+    }
+
+    bool targetLeaf = targetCell->children[0] < 0 && targetCell->children[1] < 0 && targetCell->children[2] < 0 && targetCell->children[3] < 0;
+    bool sourceLeaf = sourceCell->children[0] < 0 && sourceCell->children[1] < 0 && sourceCell->children[2] < 0 && sourceCell->children[3] < 0;
+    if (targetLeaf && sourceLeaf) {
+        addFmmPair(&solver->p2pPairs, target, source);
+        return;
+    }
+
+    bool splitTarget = sourceLeaf || (!targetLeaf && targetCell->radius >= sourceCell->radius);
+    int32_t children[4];
+    memcpy(children, splitTarget ? targetCell->children : sourceCell->children, sizeof(children));
+    for (uint32_t quadrant = 0; quadrant < 4; quadrant++) {
+        if (children[quadrant] < 0) continue;
+        if (splitTarget) {
+            traverseFmmCells(solver, (uint32_t)children[quadrant], source);
+        }
+        else {
+            traverseFmmCells(solver, target, (uint32_t)children[quadrant]);
+        }
+    }
+}
+
+// Counting sort of the pairs by target, or by source for the reverse list
+void fillFmmList(FmmList* list, uint32_t cellCount, const FmmPairs* pairs, bool bySource) {
+    list->offsets = (uint32_t*)realloc(list->offsets, sizeof(uint32_t) * (cellCount + 1));
+    if (pairs->count > list->capacity) {
+        list->capacity = pairs->count;
+        list->cells = (uint32_t*)realloc(list->cells, sizeof(uint32_t) * list->capacity);
+    }
+    list->count = pairs->count;
+
+    uint32_t key = bySource ? 1 : 0;
+    memset(list->offsets, 0, sizeof(uint32_t) * (cellCount + 1));
+    for (uint32_t i = 0; i < pairs->count; i++) {
+        list->offsets[pairs->pairs[2 * i + key] + 1]++;
+    }
+    for (uint32_t cell = 0; cell < cellCount; cell++) {
+        list->offsets[cell + 1] += list->offsets[cell];
+    }
+    for (uint32_t i = 0; i < pairs->count; i++) {
+        uint32_t owner = pairs->pairs[2 * i + key];
+        uint32_t slot = list->offsets[owner]++;
+        list->cells[slot] = pairs->pairs[2 * i + 1 - key];
+    }
+    // the fill loop advanced every offset to the start of the next cell
+    for (uint32_t cell = cellCount; cell > 0; cell--) {
+        list->offsets[cell] = list->offsets[cell - 1];
+    }
+    list->offsets[0] = 0;
+}
+
+void buildFmmInteractionLists(FmmSolver* solver) {
+    solver->m2lPairs.count = 0;
+    solver->p2pPairs.count = 0;
+    traverseFmmCells(solver, 0, 0);
+
+    fillFmmList(&solver->m2l, solver->cellCount, &solver->m2lPairs, false);
+    fillFmmList(&solver->p2p, solver->cellCount, &solver->p2pPairs, false);
+    fillFmmList(&solver->m2lUsers, solver->cellCount, &solver->m2lPairs, true);
+}
+
+// G^(n)(s) for n < count. G' = -h / 2 and the Taylor coefficients of h = u^(-1/2), with
+// u = s^3 + SOFTENING a cubic in s, follow from the power series recurrence
+//   n u_0 h_n = sum_k (k / 2 - n) u_k h_(n-k)
+// G itself only shifts the potential and is left at 0.
+void kernelDerivatives(double s, uint32_t count, double* derivatives) {
+    double u[4] = { s * s * s + SOFTENING, 3.0 * s * s, 3.0 * s, 1.0 };
+    double h[2 * FMM_MAX_ORDER + 1];
+    h[0] = 1.0 / sqrt(u[0]);
+    derivatives[0] = 0.0;
+    double factorial = 1.0;
+    for (uint32_t n = 1; n < count; n++) {
+        if (n > 1) factorial *= n - 1;
+        derivatives[n] = -0.5 * factorial * h[n - 1];
+
+        double sum = 0.0;
+        for (uint32_t k = 1; k <= n && k <= 3; k++) {
+            sum += (0.5 * k - n) * u[k] * h[n - k];
+        }
+        h[n] = sum / (n * u[0]);
+    }
+}
+
+void fmmParticleToMultipole(FmmSolver* solver, uint32_t cell) {
+    const FmmCell* fmmCell = &solver->cells[cell];
+    Complex* multipole = &solver->multipoles[(size_t)cell * solver->termCount];
+    memset(multipole, 0, sizeof(Complex) * solver->termCount);
+
+    Complex powers[FMM_MAX_ORDER + 1];
+    Complex conjugatePowers[FMM_MAX_ORDER + 1];
+    for (uint32_t i = fmmCell->begin; i < fmmCell->end; i++) {
+        Complex offset = { solver->posX[i] - fmmCell->centerX, solver->posY[i] - fmmCell->centerY };
+        powers[0].re = solver->mass[i];
+        powers[0].im = 0.0;
+        conjugatePowers[0].re = 1.0;
+        conjugatePowers[0].im = 0.0;
+        for (uint32_t k = 1; k <= solver->order; k++) {
+            powers[k] = complexMultiply(powers[k - 1], offset);
+            conjugatePowers[k] = complexMultiply(conjugatePowers[k - 1], complexConjugate(offset));
+        }
+        for (uint32_t k = 0; k <= solver->order; k++) {
+            for (uint32_t l = 0; k + l <= solver->order; l++) {
+                Complex* term = &multipole[fmmTermIndex(k, l)];
+                *term = complexAdd(*term, complexMultiply(powers[k], conjugatePowers[l]));
+            }
+        }
+    }
+}
+
+// Moves every child's multipole to the cell's center, W = W_child + delta
+void fmmMultipoleToMultipole(FmmSolver* solver, uint32_t cell) {
+    const FmmCell* fmmCell = &solver->cells[cell];
+    Complex* multipole = &solver->multipoles[(size_t)cell * solver->termCount];
+    memset(multipole, 0, sizeof(Complex) * solver->termCount);
+
+    double binomials[FMM_MAX_ORDER + 1][FMM_MAX_ORDER + 1];
+    for (uint32_t n = 0; n <= solver->order; n++) {
+        binomials[n][0] = 1.0;
+        binomials[n][n] = 1.0;
+        for (uint32_t k = 1; k < n; k++) {
+            binomials[n][k] = binomials[n - 1][k - 1] + binomials[n - 1][k];
+        }
+    }
+
+    for (uint32_t quadrant = 0; quadrant < 4; quadrant++) {
+        int32_t child = fmmCell->children[quadrant];
+        if (child < 0) continue;
+        const FmmCell* childCell = &solver->cells[child];
+        const Complex* childMultipole = &solver->multipoles[(size_t)child * solver->termCount];
+
+        Complex delta = { childCell->centerX - fmmCell->centerX, childCell->centerY - fmmCell->centerY };
+        Complex powers[FMM_MAX_ORDER + 1] = { { 1.0, 0.0 } };
+        Complex conjugatePowers[FMM_MAX_ORDER + 1] = { { 1.0, 0.0 } };
+        for (uint32_t k = 1; k <= solver->order; k++) {
+            powers[k] = complexMultiply(powers[k - 1], delta);
+            conjugatePowers[k] = complexMultiply(conjugatePowers[k - 1], complexConjugate(delta));
+        }
+
+        for (uint32_t k = 0; k <= solver->order; k++) {
+            for (uint32_t l = 0; k + l <= solver->order; l++) {
+                Complex sum = { 0.0, 0.0 };
+                for (uint32_t i = 0; i <= k; i++) {
+                    for (uint32_t j = 0; j <= l; j++) {
+                        Complex shift = complexScale(complexMultiply(powers[k - i], conjugatePowers[l - j]), binomials[k][i] * binomials[l][j]);
+                        sum = complexAdd(sum, complexMultiply(shift, childMultipole[fmmTermIndex(i, j)]));
+                    }
+                }
+                Complex* term = &multipole[fmmTermIndex(k, l)];
+                *term = complexAdd(*term, sum);
+            }
+        }
+    }
+}
+
+void fmmMultipoleToLocal(FmmSolver* solver, uint32_t target, uint32_t source) {
+    const FmmCell* targetCell = &solver->cells[target];
+    const FmmCell* sourceCell = &solver->cells[source];
+    const Complex* multipole = &solver->multipoles[(size_t)source * solver->termCount];
+    Complex* local = &solver->locals[(size_t)target * solver->termCount];
+    uint32_t order = solver->order;
+
+    double factorials[FMM_MAX_ORDER + 1];
+    factorials[0] = 1.0;
+    for (uint32_t n = 1; n <= order; n++) {
+        factorials[n] = factorials[n - 1] * n;
+    }
+
+    Complex distance = { targetCell->centerX - sourceCell->centerX, targetCell->centerY - sourceCell->centerY };
+    Complex powers[FMM_MAX_ORDER + 1] = { { 1.0, 0.0 } };
+    Complex conjugatePowers[FMM_MAX_ORDER + 1] = { { 1.0, 0.0 } };
+    for (uint32_t k = 1; k <= order; k++) {
+        powers[k] = complexMultiply(powers[k - 1], distance);
+        conjugatePowers[k] = complexMultiply(conjugatePowers[k - 1], complexConjugate(distance));
+    }
+    double derivatives[FMM_MAX_ORDER + 1];
+    kernelDerivatives(distance.re * distance.re + distance.im * distance.im, order + 1, derivatives);
+
+    // T_ab = sum_j C(a, j) b! / (b - j)! D^(b-j) conj(D)^(a-j) G^(a+b-j)
+    Complex tensor[FMM_MAX_TERMS];
+    for (uint32_t a = 0; a <= order; a++) {
+        for (uint32_t b = 0; a + b <= order; b++) {
+            Complex sum = { 0.0, 0.0 };
+            for (uint32_t j = 0; j <= a && j <= b; j++) {
+                double scale = factorials[a] / (factorials[j] * factorials[a - j]) * factorials[b] / factorials[b - j] * derivatives[a + b - j];
+                sum = complexAdd(sum, complexScale(complexMultiply(powers[b - j], conjugatePowers[a - j]), scale));
+            }
+            tensor[fmmTermIndex(a, b)] = sum;
+        }
+    }
+
+    Complex scaledMultipole[FMM_MAX_TERMS];
+    for (uint32_t k = 0; k <= order; k++) {
+        for (uint32_t l = 0; k + l <= order; l++) {
+            double sign = (k + l) & 1 ? -1.0 : 1.0;
+            scaledMultipole[fmmTermIndex(k, l)] = complexScale(multipole[fmmTermIndex(k, l)], sign / (factorials[k] * factorials[l]));
+        }
+    }
+
+    for (uint32_t n = 0; n <= order; n++) {
+        for (uint32_t m = 0; n + m <= order; m++) {
+            Complex sum = { 0.0, 0.0 };
+            for (uint32_t k = 0; n + m + k <= order; k++) {
+                for (uint32_t l = 0; n + m + k + l <= order; l++) {
+                    sum = complexAdd(sum, complexMultiply(tensor[fmmTermIndex(n + k, m + l)], scaledMultipole[fmmTermIndex(k, l)]));
+                }
+            }
+            Complex* term = &local[fmmTermIndex(n, m)];
+            *term = complexAdd(*term, complexScale(sum, 1.0 / (factorials[n] * factorials[m])));
+        }
+    }
+}
+
+// Adds the parent's local expansion moved to the cell's center, Y_parent = Y + delta
+void fmmLocalToLocal(FmmSolver* solver, uint32_t cell) {
+    const FmmCell* fmmCell = &solver->cells[cell];
+    const FmmCell* parentCell = &solver->cells[fmmCell->parent];
+    const Complex* parentLocal = &solver->locals[(size_t)fmmCell->parent * solver->termCount];
+    Complex* local = &solver->locals[(size_t)cell * solver->termCount];
+    uint32_t order = solver->order;
+
+    double binomials[FMM_MAX_ORDER + 1][FMM_MAX_ORDER + 1];
+    for (uint32_t n = 0; n <= order; n++) {
+        binomials[n][0] = 1.0;
+        binomials[n][n] = 1.0;
+        for (uint32_t k = 1; k < n; k++) {
+            binomials[n][k] = binomials[n - 1][k - 1] + binomials[n - 1][k];
+        }
+    }
+
+    Complex delta = { fmmCell->centerX - parentCell->centerX, fmmCell->centerY - parentCell->centerY };
+    Complex powers[FMM_MAX_ORDER + 1] = { { 1.0, 0.0 } };
+    Complex conjugatePowers[FMM_MAX_ORDER + 1] = { { 1.0, 0.0 } };
+    for (uint32_t k = 1; k <= order; k++) {
+        powers[k] = complexMultiply(powers[k - 1], delta);
+        conjugatePowers[k] = complexMultiply(conjugatePowers[k - 1], complexConjugate(delta));
+    }
+
+    for (uint32_t n = 0; n <= order; n++) {
+        for (uint32_t m = 0; n + m <= order; m++) {
+            Complex sum = { 0.0, 0.0 };
+            for (uint32_t i = n; i <= order; i++) {
+                for (uint32_t j = m; i + j <= order; j++) {
+                    Complex shift = complexScale(complexMultiply(powers[i - n], conjugatePowers[j - m]), binomials[i][n] * binomials[j][m]);
+                    sum = complexAdd(sum, complexMultiply(shift, parentLocal[fmmTermIndex(i, j)]));
+                }
+            }
+            Complex* term = &local[fmmTermIndex(n, m)];
+            *term = complexAdd(*term, sum);
+        }
+    }
+}
+
+void fmmLocalToParticle(FmmSolver* solver, uint32_t cell) {
+    const FmmCell* fmmCell = &solver->cells[cell];
+    const Complex* local = &solver->locals[(size_t)cell * solver->termCount];
+    uint32_t order = solver->order;
+
+    Complex powers[FMM_MAX_ORDER + 1];
+    Complex conjugatePowers[FMM_MAX_ORDER + 1];
+    for (uint32_t i = fmmCell->begin; i < fmmCell->end; i++) {
+        Complex offset = { solver->posX[i] - fmmCell->centerX, solver->posY[i] - fmmCell->centerY };
+        powers[0].re = 1.0;
+        powers[0].im = 0.0;
+        conjugatePowers[0] = powers[0];
+        for (uint32_t k = 1; k <= order; k++) {
+            powers[k] = complexMultiply(powers[k - 1], offset);
+            conjugatePowers[k] = complexMultiply(conjugatePowers[k - 1], complexConjugate(offset));
+        }
+
+        Complex acceleration = { 0.0, 0.0 };
+        for (uint32_t n = 0; n < order; n++) {
+            for (uint32_t m = 1; n + m <= order; m++) {
+                Complex term = complexMultiply(local[fmmTermIndex(n, m)], complexMultiply(powers[n], conjugatePowers[m - 1]));
+                acceleration = complexAdd(acceleration, complexScale(term, 2.0 * m));
+            }
+        }
+        solver->accX[i] += acceleration.re;
+        solver->accY[i] += acceleration.im;
+    }
+}
+
+// Same force law as cpuForceBlock, accumulated into the target leaf's particles
+void fmmParticleToParticle(FmmSolver* solver, uint32_t target, uint32_t source) {
+    const FmmCell* targetCell = &solver->cells[target];
+    const FmmCell* sourceCell = &solver->cells[source];
+    for (uint32_t i = targetCell->begin; i < targetCell->end; i++) {
+        double sumX = 0.0;
+        double sumY = 0.0;
+        for (uint32_t j = sourceCell->begin; j < sourceCell->end; j++) {
+            double distanceX = solver->posX[j] - solver->posX[i];
+            double distanceY = solver->posY[j] - solver->posY[i];
+            double x2_y2 = distanceX * distanceX + distanceY * distanceY;
+            double b = solver->mass[j] / sqrt(x2_y2 * x2_y2 * x2_y2 + SOFTENING);
+            sumX += distanceX * b;
+            sumY += distanceY * b;
+        }
+        solver->accX[i] += sumX;
+        solver->accY[i] += sumY;
+    }
+}
+
+// Upward pass: a cell's multipole is ready once all its children's are. Finishing it
+// releases the M2L of every target listing it and possibly the parent's M2M.
+void fmmUpwardTask(void* arg, uint32_t workerIndex) {
+    FmmTaskArg* task = (FmmTaskArg*)arg;
+    FmmSolver* solver = task->solver;
+    uint32_t cell = task->cell;
+    const FmmCell* fmmCell = &solver->cells[cell];
+
+    if (fmmCell->children[0] < 0 && fmmCell->children[1] < 0 && fmmCell->children[2] < 0 && fmmCell->children[3] < 0) {
+        fmmParticleToMultipole(solver, cell);
+    }
+    else {
+        fmmMultipoleToMultipole(solver, cell);
+    }
+
+    for (uint32_t i = solver->m2lUsers.offsets[cell]; i < solver->m2lUsers.offsets[cell + 1]; i++) {
+        uint32_t target = solver->m2lUsers.cells[i];
+        if (atomicAdd(&solver->m2lPending[target], -1) == 0) {
+            threadPoolSubmit(solver->pool, workerIndex, fmmM2LTask, &solver->taskArgs[target]);
+        }
+    }
+    if (fmmCell->parent >= 0 && atomicAdd(&solver->upwardPending[fmmCell->parent], -1) == 0) {
+        threadPoolSubmit(solver->pool, workerIndex, fmmUpwardTask, &solver->taskArgs[fmmCell->parent]);
+    }
+}
+
+void fmmM2LTask(void* arg, uint32_t workerIndex) {
+    FmmTaskArg* task = (FmmTaskArg*)arg;
+    FmmSolver* solver = task->solver;
+    uint32_t cell = task->cell;
+
+    memset(&solver->locals[(size_t)cell * solver->termCount], 0, sizeof(Complex) * solver->termCount);
+    for (uint32_t i = solver->m2l.offsets[cell]; i < solver->m2l.offsets[cell + 1]; i++) {
+        fmmMultipoleToLocal(solver, cell, solver->m2l.cells[i]);
+    }
+    fmmDownwardReady(solver, cell, workerIndex);
+}
+
+// Near field of a leaf, independent of the expansions so it starts right away
+void fmmP2PTask(void* arg, uint32_t workerIndex) {
+    FmmTaskArg* task = (FmmTaskArg*)arg;
+    FmmSolver* solver = task->solver;
+    uint32_t cell = task->cell;
+    const FmmCell* fmmCell = &solver->cells[cell];
+
+    for (uint32_t i = fmmCell->begin; i < fmmCell->end; i++) {
+        solver->accX[i] = 0.0;
+        solver->accY[i] = 0.0;
+    }
+    for (uint32_t i = solver->p2p.offsets[cell]; i < solver->p2p.offsets[cell + 1]; i++) {
+        fmmParticleToParticle(solver, cell, solver->p2p.cells[i]);
+    }
+    fmmDownwardReady(solver, cell, workerIndex);
+}
+
+// Downward pass: the parent's local expansion is added to the cell's own M2L result,
+// then handed on to the children or evaluated at a leaf's particles.
+void fmmDownwardTask(void* arg, uint32_t workerIndex) {
+    FmmTaskArg* task = (FmmTaskArg*)arg;
+    FmmSolver* solver = task->solver;
+    uint32_t cell = task->cell;
+    const FmmCell* fmmCell = &solver->cells[cell];
+
+    if (fmmCell->parent >= 0) {
+        fmmLocalToLocal(solver, cell);
+    }
+
+    bool leaf = true;
+    for (uint32_t quadrant = 0; quadrant < 4; quadrant++) {
+        int32_t child = fmmCell->children[quadrant];
+        if (child < 0) continue;
+        leaf = false;
+        fmmDownwardReady(solver, (uint32_t)child, workerIndex);
+    }
+    if (leaf) {
+        fmmLocalToParticle(solver, cell);
+    }
+}
+
+void fmmDownwardReady(FmmSolver* solver, uint32_t cell, uint32_t workerIndex) {
+    if (atomicAdd(&solver->downwardPending[cell], -1) == 0) {
+        threadPoolSubmit(solver->pool, workerIndex, fmmDownwardTask, &solver->taskArgs[cell]);
+    }
+}
+
+// Builds the tree and interaction lists on the calling thread, then runs the passes
+// as a task graph on the pool: P2M/M2M up the tree, each M2L as soon as its sources
+// are done, L2L/L2P down the tree and the P2P of every leaf alongside.
+void fmmAccelerations(FmmSolver* solver, ThreadPool* pool, const Particle* particles, vec2* accelerations) {
+    sortFmmParticles(solver, particles);
+    buildFmmInteractionLists(solver);
+
+    uint32_t cellCount = solver->cellCount;
+    free((void*)solver->upwardPending);
+    free((void*)solver->m2lPending);
+    free((void*)solver->downwardPending);
+    free(solver->taskArgs);
+    free(solver->multipoles);
+    free(solver->locals);
+    solver->upwardPending = (volatile int32_t*)malloc(sizeof(int32_t) * cellCount);
+    solver->m2lPending = (volatile int32_t*)malloc(sizeof(int32_t) * cellCount);
+    solver->downwardPending = (volatile int32_t*)malloc(sizeof(int32_t) * cellCount);
+    solver->taskArgs = (FmmTaskArg*)malloc(sizeof(FmmTaskArg) * cellCount);
+    solver->multipoles = (Complex*)malloc(sizeof(Complex) * solver->termCount * cellCount);
+    solver->locals = (Complex*)malloc(sizeof(Complex) * solver->termCount * cellCount);
+    solver->pool = pool;
+
+    for (uint32_t cell = 0; cell < cellCount; cell++) {
+        const FmmCell* fmmCell = &solver->cells[cell];
+        int32_t children = 0;
+        for (uint32_t quadrant = 0; quadrant < 4; quadrant++) {
+            children += fmmCell->children[quadrant] >= 0;
+        }
+        solver->upwardPending[cell] = children;
+        solver->m2lPending[cell] = (int32_t)(solver->m2l.offsets[cell + 1] - solver->m2l.offsets[cell]);
+        solver->downwardPending[cell] = 1 + (fmmCell->parent >= 0) + (children == 0);
+        solver->taskArgs[cell].solver = solver;
+        solver->taskArgs[cell].cell = cell;
+    }
+
+    // the counters change as soon as the first task runs, so the starting tasks are picked from the tree
+    for (uint32_t cell = 0; cell < cellCount; cell++) {
+        const FmmCell* fmmCell = &solver->cells[cell];
+        if (fmmCell->children[0] < 0 && fmmCell->children[1] < 0 && fmmCell->children[2] < 0 && fmmCell->children[3] < 0) {
+            threadPoolSubmit(pool, THREAD_POOL_ANY_WORKER, fmmUpwardTask, &solver->taskArgs[cell]);
+            threadPoolSubmit(pool, THREAD_POOL_ANY_WORKER, fmmP2PTask, &solver->taskArgs[cell]);
+        }
+        if (solver->m2l.offsets[cell + 1] == solver->m2l.offsets[cell]) {
+            threadPoolSubmit(pool, THREAD_POOL_ANY_WORKER, fmmM2LTask, &solver->taskArgs[cell]);
+        }
+    }
+    threadPoolWait(pool);
+
+    for (uint32_t i = 0; i < solver->particleCount; i++) {
+        accelerations[solver->sortedIndices[i]].x = (float)solver->accX[i];
+        accelerations[solver->sortedIndices[i]].y = (float)solver->accY[i];
+    }
+}
+
+// Relative force error against direct summation at every even order up to fmmOrder.
+// The direct sum is only taken for a sample of the particles to keep large runs cheap.
+void compareFmmWithDirect(Context* context, ThreadPool* pool, const Particle* particles) {
+    uint32_t count = context->PARTICLE_COUNT;
+    uint32_t sampleCount = count < 1024 ? count : 1024;
+    double* directX = (double*)malloc(sizeof(double) * sampleCount);
+    double* directY = (double*)malloc(sizeof(double) * sampleCount);
+    vec2* accelerations = (vec2*)malloc(sizeof(vec2) * count);
+
+    double startTime = getTime();
+    for (uint32_t sample = 0; sample < sampleCount; sample++) {
+        uint32_t i = (uint32_t)((uint64_t)sample * count / sampleCount);
+        double sumX = 0.0;
+        double sumY = 0.0;
+        for (uint32_t j = 0; j < count; j++) {
+            double distanceX = (double)particles[j].pos.x - particles[i].pos.x;
+            double distanceY = (double)particles[j].pos.y - particles[i].pos.y;
+            double x2_y2 = distanceX * distanceX + distanceY * distanceY;
+            double b = particles[j].mss / sqrt(x2_y2 * x2_y2 * x2_y2 + SOFTENING);
+            sumX += distanceX * b;
+            sumY += distanceY * b;
+        }
+        directX[sample] = sumX;
+        directY[sample] = sumY;
+    }
+    double directTime = (getTime() - startTime) * count / sampleCount;
+    printf("direct: %.3f ms per step, single threaded, estimated from %u particles\n", directTime * 1000.0, sampleCount);
+
+    for (uint32_t order = 2; order <= context->fmmOrder + 1; order += 2) {
+        if (order > context->fmmOrder) order = context->fmmOrder;
+
+        FmmSolver solver;
+        createFmmSolver(&solver, count, order, context->fmmTheta);
+        startTime = getTime();
+        fmmAccelerations(&solver, pool, particles, accelerations);
+        double fmmTime = getTime() - startTime;
+
+        double errorSquared = 0.0;
+        double normSquared = 0.0;
+        for (uint32_t sample = 0; sample < sampleCount; sample++) {
+            uint32_t i = (uint32_t)((uint64_t)sample * count / sampleCount);
+            double errorX = accelerations[i].x - directX[sample];
+            double errorY = accelerations[i].y - directY[sample];
+            errorSquared += errorX * errorX + errorY * errorY;
+            normSquared += directX[sample] * directX[sample] + directY[sample] * directY[sample];
+        }
+        printf("FMM order %u, theta %.2f: relative force error %.3e\t %.3f ms per step, %u cells, %u M2L, %u P2P\n", order, context->fmmTheta,
+            normSquared > 0.0 ? sqrt(errorSquared / normSquared) : 0.0, fmmTime * 1000.0, solver.cellCount, solver.m2l.count, solver.p2p.count);
+        destroyFmmSolver(&solver);
+
+        if (order == context->fmmOrder) break;
+    }
+
+    free(directX);
+    free(directY);
+    free(accelerations);
+}
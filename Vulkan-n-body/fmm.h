@@ -0,0 +1,119 @@
+#ifndef FMM_H
+#define FMM_H
+
+#include "types.h"
+#include "threadPool.h"
+
+// Fast multipole method for the CPU backend, in double precision.
+// The softened kernel of shader.comp isn't harmonic, so instead of Laurent series in z
+// the expansions are Taylor series of the potential in z and conj(z), see fmm.c.
+
+#define FMM_MAX_ORDER 16
+#define FMM_MAX_TERMS ((FMM_MAX_ORDER + 1) * (FMM_MAX_ORDER + 2) / 2)
+#define FMM_LEAF_SIZE 32 // particles a cell holds before it is split
+#define FMM_MAX_LEVEL 16 // 16 bits of the Morton key per axis
+
+typedef struct FmmCell {
+    double centerX, centerY; // expansion center, the middle of the quadtree square
+    double halfSize;
+    double radius;           // farthest particle from the center
+    uint32_t begin, end;     // range in the Morton sorted particles
+    int32_t parent;          // -1 for the root
+    int32_t children[4];     // -1 when absent, all -1 for a leaf
+    uint32_t level;
+} FmmCell;
+
+// Cells sharing an interaction list, indexed by a per cell offset
+typedef struct FmmList {
+    uint32_t* offsets; // cellCount + 1
+    uint32_t* cells;
+    uint32_t count;
+    uint32_t capacity;
+} FmmList;
+
+// (target, source) pairs collected by traverseFmmCells
+typedef struct FmmPairs {
+    uint32_t* pairs;
+    uint32_t count;
+    uint32_t capacity;
+} FmmPairs;
+
+typedef struct FmmSolver FmmSolver;
+
+typedef struct FmmTaskArg {
+    FmmSolver* solver;
+    uint32_t cell;
+} FmmTaskArg;
+
+struct FmmSolver {
+    uint32_t particleCount;
+    uint32_t order;
+    uint32_t termCount; // coefficients per expansion, (order + 1)(order + 2) / 2
+    double theta;
+
+    // particles in Morton order
+    uint32_t* sortedIndices;
+    uint32_t* keys;
+    uint32_t* scratchIndices;
+    uint32_t* scratchKeys;
+    double* posX;
+    double* posY;
+    double* mass;
+    double* accX;
+    double* accY;
+
+    FmmCell* cells;
+    uint32_t cellCount;
+    uint32_t cellCapacity;
+    Complex* multipoles; // termCount per cell
+    Complex* locals;
+
+    FmmPairs m2lPairs;
+    FmmPairs p2pPairs;
+    FmmList m2l;       // per target, cells whose multipoles give its local expansion
+    FmmList p2p;       // per target leaf, leaves summed directly
+    FmmList m2lUsers;  // per source, targets waiting on its multipole
+
+    // task graph counters, see fmmAccelerations
+    volatile int32_t* upwardPending;   // children without a multipole yet
+    volatile int32_t* m2lPending;      // m2l sources without a multipole yet
+    volatile int32_t* downwardPending; // own M2L, parent's local expansion and own P2P
+    FmmTaskArg* taskArgs;
+    ThreadPool* pool;
+};
+
+Complex complexAdd(Complex a, Complex b);
+Complex complexMultiply(Complex a, Complex b);
+Complex complexScale(Complex a, double scale);
+Complex complexConjugate(Complex a);
+uint32_t fmmTermIndex(uint32_t k, uint32_t l);
+
+void createFmmSolver(FmmSolver* solver, uint32_t particleCount, uint32_t order, float theta);
+void destroyFmmSolver(FmmSolver* solver);
+
+uint32_t spreadMortonBits(uint32_t value);
+void sortFmmParticles(FmmSolver* solver, const Particle* particles);
+uint32_t buildFmmCell(FmmSolver* solver, uint32_t begin, uint32_t end, uint32_t level, double lowerX, double lowerY, double size, int32_t parent);
+void buildFmmInteractionLists(FmmSolver* solver);
+void traverseFmmCells(FmmSolver* solver, uint32_t target, uint32_t source);
+void addFmmPair(FmmPairs* pairs, uint32_t target, uint32_t source);
+void fillFmmList(FmmList* list, uint32_t cellCount, const FmmPairs* pairs, bool bySource);
+
+void kernelDerivatives(double s, uint32_t count, double* derivatives);
+void fmmParticleToMultipole(FmmSolver* solver, uint32_t cell);
+void fmmMultipoleToMultipole(FmmSolver* solver, uint32_t cell);
+void fmmMultipoleToLocal(FmmSolver* solver, uint32_t target, uint32_t source);
+void fmmLocalToLocal(FmmSolver* solver, uint32_t cell);
+void fmmLocalToParticle(FmmSolver* solver, uint32_t cell);
+void fmmParticleToParticle(FmmSolver* solver, uint32_t target, uint32_t source);
+
+void fmmUpwardTask(void* arg, uint32_t workerIndex);
+void fmmM2LTask(void* arg, uint32_t workerIndex);
+void fmmP2PTask(void* arg, uint32_t workerIndex);
+void fmmDownwardTask(void* arg, uint32_t workerIndex);
+void fmmDownwardReady(FmmSolver* solver, uint32_t cell, uint32_t workerIndex);
+
+void fmmAccelerations(FmmSolver* solver, ThreadPool* pool, const Particle* particles, vec2* accelerations);
+void compareFmmWithDirect(Context* context, ThreadPool* pool, const Particle* particles);
+
+#endif
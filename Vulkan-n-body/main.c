@@ -1,13 +1,27 @@
 #include "main.h"
 #include "vkinit.h"
+#include "vkAllocator.h"
+#include "vkStaging.h"
+#include "vkAutotune.h"
+#include "vkPipelineCache.h"
 #include "vkDraw.h"
+#include "vkBarnesHut.h"
+#include "vkBlockSteps.h"
+#include "vkParticleMesh.h"
+#include "vkTimeStep.h"
+#include "vkRenderStream.h"
+#include "vkDensity.h"
+#include "vkOwnership.h"
+#include "vkHeadless.h"
+#include "cpuSim.h"
+#include "platform.h"
+#include "profiler.h"
+#include "checkpoint.h"
+#include "trajectory.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
-
-#define FRAMES_PER_PRINT 3000
 
 int main(void) {
     Context context = {
@@ -16,13 +30,70 @@ int main(void) {
         .currentFrame = 0,
         .framebufferResized = false,
         .PARTICLE_COUNT = 256 * 1,
-        .timeStep = 0.001f
+        .initialConditions = INITIAL_CONDITIONS_UNIFORM,
+        .backend = BACKEND_VULKAN,
+        .cpuKernel = CPU_KERNEL_SIMD,
+        .cpuBenchmark = false,
+        .threadCount = 0,
+        .stepCount = 1000,
+        .fmmOrder = 8,
+        .fmmTheta = 0.4f,
+        .headless = false,
+        .snapshotInterval = 0,
+        .substeps = 1,
+        .reuseCommandBuffers = true,
+        .printStats = false,
+        .shaderOverrideDir = NULL,
+        .pipelineCachePath = "pipeline_cache.bin",
+        .restartPath = NULL,
+        .checkpointPath = "checkpoint.bin",
+        .checkpointInterval = 0,
+        .trajectoryPath = "trajectory.bin",
+        .trajectoryInterval = 0,
+        .compressTrajectory = false,
+        .trajectoryTolerance = 1e-5f,
+        .computeKernel = COMPUTE_KERNEL_TILED,
+        .computeTuning = { .workgroupSize = 256, .tileSize = 256, .unroll = 1 },
+        .autotune = false,
+        .autotunePath = "autotune.txt",
+        .integrator = INTEGRATOR_EULER,
+        .theta = 0.5f,
+        .compareWithDirect = false,
+        .blockStepLevels = 4,
+        .blockStepAccuracy = 0.025f,
+        .pmGridSize = 256,
+        .pmPeriodic = false,
+        .pmBoxSize = 1.0f,
+        .renderStreamStride = 0,
+        .renderMode = RENDER_MODE_POINTS,
+        .densityExposure = 0.25f,
+        .timeStep = 0.001f,
+        .adaptiveTimeStep = false,
+        .timeStepAccuracy = 0.05f,
+        .minTimeStep = 1e-6f
     };
     uint32_t WIN_WIDTH = 800;
     uint32_t WIN_HEIGHT = 600;
 
     srand(0);
 
+    if (context.backend == BACKEND_CPU) {
+        if (context.cpuBenchmark) {
+            runCpuKernelBenchmark(context.PARTICLE_COUNT);
+        }
+        else {
+            runCpuBackend(&context);
+        }
+        return 0;
+    }
+
+    if (context.headless) {
+        initVulkanHeadless(&context);
+        runHeadless(&context);
+        cleanup(&context);
+        return 0;
+    }
+
     initWindow(&context, WIN_WIDTH, WIN_HEIGHT);
     initVulkan(&context);
     mainLoop(&context);
@@ -45,68 +116,160 @@ void framebufferResizeCallback(Context* context) {
 }
 
 void initVulkan(Context* context) {
+    context->startTime = getTime();
     createInstance(context);
     setupDebugMessenger(context);
     createSurface(context);
     pickPhysicalDevice(context);
     createLogicalDevice(context);
+    createAllocator(context);
+    if (context->pipelineCachePath != NULL) {
+        createPipelineCache(context);
+    }
     createSwapChain(context);
     createImageViews(context);
     createRenderPass(context);
     createComputeDescriptorSetLayout(context);
     createGraphicsPipeline(context);
-    createComputePipeline(context);
     createFramebuffers(context);
     createCommandPool(context);
+    createStagingRing(context);
     createShaderStorageBuffers(context);
     createUniformBuffers(context);
+    if (context->adaptiveTimeStep) {
+        createTimeStepResources(context);
+    }
+    if (context->autotune && (context->computeKernel == COMPUTE_KERNEL_REFERENCE || context->computeKernel == COMPUTE_KERNEL_TILED)) {
+        autotuneComputeKernel(context);
+    }
+    createComputePipeline(context);
     createDescriptorPool(context);
     createComputeDescriptorSets(context);
     createCommandBuffers(context);
     createComputeCommandBuffers(context);
+    if (context->integrator != INTEGRATOR_EULER) {
+        initializeAccelerations(context);
+    }
     createSyncObjects(context);
+    createProfiler(context);
+    if (context->checkpointInterval > 0) {
+        createCheckpointWriter(context);
+    }
+    if (context->trajectoryInterval > 0) {
+        createTrajectoryWriter(context);
+    }
+
+    // before the density descriptor sets, which read the draw copies
+    createOwnershipResources(context);
+    if (context->renderStreamStride > 0) {
+        createRenderStreamResources(context);
+    }
+    if (context->renderMode == RENDER_MODE_DENSITY) {
+        createDensityResources(context);
+    }
+
+    if (context->computeKernel == COMPUTE_KERNEL_BARNES_HUT) {
+        createBarnesHutResources(context);
+        if (context->compareWithDirect) {
+            compareBarnesHutWithDirect(context);
+        }
+    }
+    if (context->computeKernel == COMPUTE_KERNEL_BLOCK_STEPS) {
+        createBlockStepResources(context);
+    }
+    if (context->computeKernel == COMPUTE_KERNEL_PARTICLE_MESH) {
+        createParticleMeshResources(context);
+        if (context->compareWithDirect) {
+            compareParticleMeshWithDirect(context);
+        }
+    }
+
+    if (context->printStats) {
+        printAllocatorStats(&context->allocator);
+    }
 }
 
 void mainLoop(Context* context) {
-    bool printFrameTime = false;
-    int frames = 0;
-    double times[FRAMES_PER_PRINT] = { 0 };
-    clock_t oa_tim_strt = 0, oa_tim_end = 0;
     while (!glfwWindowShouldClose(context->window)) {
-        oa_tim_strt = clock();
+        // wall clock: with vsync most of the frame is spent blocked, which clock() doesn't count
+        double frameStart = getTime();
+        context->recordSubmitTime = 0.0;
 
         glfwPollEvents();
         drawFrame(context);
-
-        oa_tim_end = clock();
-        double elapsedTime_s = ((double)(oa_tim_end - oa_tim_strt)) / CLOCKS_PER_SEC;
-        times[frames] = elapsedTime_s;
-        if (frames >= FRAMES_PER_PRINT - 1 && printFrameTime) {
-            double avg_elapsedTime_s = DoubleArraySum(times, FRAMES_PER_PRINT) / (double)FRAMES_PER_PRINT;
-            printf("time: ms %d\t fps: %.1lf\n", (int)(avg_elapsedTime_s * 1000), 1.0 / avg_elapsedTime_s);
-            frames = 0;
+        if (context->printStats && context->startTime > 0.0 && context->submissionCount > 0) {
+            profilerFirstStep(context);
         }
-        else if (printFrameTime) {
-            frames++;
+        if (context->checkpointInterval > 0) {
+            updateCheckpoints(context);
+        }
+        if (context->trajectoryInterval > 0) {
+            updateTrajectory(context);
+        }
+
+        double frameEnd = getTime();
+        if (context->printStats) {
+            rollingStatsAdd(&context->profiler.frameTime, (frameEnd - frameStart) * 1000.0);
+            rollingStatsAdd(&context->profiler.recordSubmitTime, context->recordSubmitTime * 1000.0);
+            profilerPrint(context, frameEnd);
         }
     }
     vkDeviceWaitIdle(context->device);
 }
 
 void cleanup(Context* context) {
-    cleanupSwapChain(context);
+    if (context->trajectoryInterval > 0) {
+        destroyTrajectoryWriter(context);
+    }
+    if (context->checkpointInterval > 0) {
+        destroyCheckpointWriter(context);
+    }
+
+    if (!context->headless) {
+        cleanupSwapChain(context);
 
-    vkDestroyPipeline(context->device, context->graphicsPipeline, NULL);
-    vkDestroyPipelineLayout(context->device, context->pipelineLayout, NULL);
+        vkDestroyPipeline(context->device, context->graphicsPipeline, NULL);
+        vkDestroyPipelineLayout(context->device, context->pipelineLayout, NULL);
+    }
 
     vkDestroyPipeline(context->device, context->computePipeline, NULL);
     vkDestroyPipelineLayout(context->device, context->computePipelineLayout, NULL);
 
-    vkDestroyRenderPass(context->device, context->renderPass, NULL);
+    if (context->computeKernel == COMPUTE_KERNEL_BARNES_HUT) {
+        cleanupBarnesHut(context);
+    }
+    if (context->computeKernel == COMPUTE_KERNEL_BLOCK_STEPS) {
+        if (context->printStats) {
+            printBlockStepStats(context);
+        }
+        cleanupBlockSteps(context);
+    }
+    if (context->computeKernel == COMPUTE_KERNEL_PARTICLE_MESH) {
+        cleanupParticleMesh(context);
+    }
+    if (context->adaptiveTimeStep) {
+        if (context->printStats) {
+            printTimeStepStats(context);
+        }
+        cleanupTimeStep(context);
+    }
+
+    if (!context->headless) {
+        destroyOwnershipResources(context);
+    }
+    if (!context->headless && context->renderStreamStride > 0) {
+        cleanupRenderStream(context);
+    }
+    if (!context->headless && context->renderMode == RENDER_MODE_DENSITY) {
+        cleanupDensity(context);
+    }
+
+    if (!context->headless) {
+        vkDestroyRenderPass(context->device, context->renderPass, NULL);
+    }
 
     for (size_t i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroyBuffer(context->device, context->uniformBuffers[i], NULL);
-        vkFreeMemory(context->device, context->uniformBuffersMemory[i], NULL);
+        destroyBuffer(context, context->uniformBuffers[i], context->uniformBufferAllocations[i]);
     }
 
     vkDestroyDescriptorPool(context->device, context->descriptorPool, NULL);
@@ -114,19 +277,30 @@ void cleanup(Context* context) {
     vkDestroyDescriptorSetLayout(context->device, context->computeDescriptorSetLayout, NULL);
 
     for (size_t i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroyBuffer(context->device, context->shaderStorageBuffers[i], NULL);
-        vkFreeMemory(context->device, context->shaderStorageBuffersMemory[i], NULL);
+        destroyBuffer(context, context->shaderStorageBuffers[i], context->shaderStorageBufferAllocations[i]);
+        destroyBuffer(context, context->accelerationBuffers[i], context->accelerationBufferAllocations[i]);
+    }
+    if (context->integrator == INTEGRATOR_YOSHIDA) {
+        destroyBuffer(context, context->scratchParticleBuffer, context->scratchParticleBufferAllocation);
+        destroyBuffer(context, context->scratchAccelerationBuffer, context->scratchAccelerationBufferAllocation);
     }
 
     for (uint32_t i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
         vkDestroySemaphore(context->device, context->imageAvailableSemaphores[i], NULL);
         vkDestroySemaphore(context->device, context->renderFinishedSemaphores[i], NULL);
-        vkDestroySemaphore(context->device, context->computeFinishedSemaphores[i], NULL);
-        vkDestroyFence(context->device, context->inFlightFences[i], NULL);
-        vkDestroyFence(context->device, context->computeInFlightFences[i], NULL);
+    }
+    vkDestroySemaphore(context->device, context->computeTimeline, NULL);
+    vkDestroySemaphore(context->device, context->graphicsTimeline, NULL);
+
+    destroyProfiler(context);
+    destroyStagingRing(context);
+    destroyAllocator(context);
+    if (context->pipelineCachePath != NULL) {
+        destroyPipelineCache(context);
     }
 
     vkDestroyCommandPool(context->device, context->commandPool, NULL);
+    vkDestroyCommandPool(context->device, context->computeCommandPool, NULL);
 
     vkDestroyDevice(context->device, NULL);
 
@@ -134,20 +308,25 @@ void cleanup(Context* context) {
         DestroyDebugUtilsMessengerEXT(context->instance, context->debugMessenger, NULL);
     }
 
-    vkDestroySurfaceKHR(context->instance, context->surface, NULL);
+    if (!context->headless) {
+        vkDestroySurfaceKHR(context->instance, context->surface, NULL);
+    }
     vkDestroyInstance(context->instance, NULL);
 
-    glfwDestroyWindow(context->window);
-    glfwTerminate();
+    if (!context->headless) {
+        glfwDestroyWindow(context->window);
+        glfwTerminate();
+    }
 
     free(context->swapChainImages);
     free(context->commandBuffers);
+    free(context->commandBuffersRecorded);
+    free(context->computeCommandBuffers);
+    free(context->computeCommandBufferSteps);
     free(context->imageAvailableSemaphores);
     free(context->renderFinishedSemaphores);
-    free(context->computeFinishedSemaphores);
-    free(context->inFlightFences);
-    free(context->computeInFlightFences);
     free(context->computeDescriptorSets);
+    free(context->substepDescriptorSets);
 }
 
 void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger, const VkAllocationCallbacks* pAllocator) {
@@ -155,12 +334,4 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT
     if (func != NULL) {
         func(instance, debugMessenger, pAllocator);
     }
-}
-
-double DoubleArraySum(double* array, int len) {
-    double sum = 0;
-    for (int i = 0; i < len; i++) {
-        sum += array[i];
-    }
-    return sum;
 }
\ No newline at end of file
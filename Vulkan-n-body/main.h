@@ -3,8 +3,6 @@
 
 #include "types.h"
 
-uint32_t readFile(const char* filename, char** buffer);
-
 void initWindow(Context* app, uint32_t WIN_WIDTH, uint32_t WIN_HEIGHT);
 void initVulkan(Context* app);
 void mainLoop(Context* app);
@@ -16,11 +14,8 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT
 
 void cleanupSwapChain(Context* app);
 
-double DoubleArraySum(double* array, int len);
-
 #endif
 
 // copyBuffer uses separate command pool for performance
 // copyBuffer uses fences instead of vkQueueWaitIdle for performance
-// https://vulkan-tutorial.com/en/Vertex_buffers/Staging_buffer
-// create custom allocator that splits up a single allocation among many different objects because maxMemoryAllocationCount is limited to 4096
\ No newline at end of file
+// https://vulkan-tutorial.com/en/Vertex_buffers/Staging_buffer
\ No newline at end of file
@@ -0,0 +1,61 @@
+#ifndef PARTICLELAYOUT_H
+#define PARTICLELAYOUT_H
+
+// The one definition of a particle in the storage buffers, included by types.h and by the
+// compute shaders (glslc defines VULKAN). The buffers are std430, where this struct is laid out
+// exactly like the C one: 16 byte alignment from the vec4, no implicit padding.
+//
+//  0  pos, mss   read for every interaction, one 16 byte load
+// 16  vel        read and written once per particle per step
+// 24  col        RGBA8 with red in the low byte, only read by the vertex stage
+//
+// col stays in the record on purpose. A std430 struct holding a vec4 is 16 byte aligned, so
+// without col the stride still rounds up to 32 bytes and col only fills what would be padding.
+// The force loops never load it, so a separate colour buffer would add a binding and an upload
+// without taking a byte out of the hot path; that would need posMss split from vel instead.
+//
+// The same buffers are bound as the vertex buffer, so the attribute offsets come from here too.
+
+// Force law of every kernel, CPU and GPU: a = sum m d / sqrt(|d|^6 + SOFTENING)
+#define SOFTENING 0.0001f
+// SOFTENING^(1/6), the distance below which the softening takes over
+#define SOFTENING_LENGTH 0.2154f
+
+// Stored in checkpoints, bump whenever Particle changes
+#define PARTICLE_LAYOUT_VERSION 2
+
+#ifdef VULKAN
+
+struct Particle {
+    vec4 posMss;    // xy = position, w = mass
+    vec2 vel;
+    uint col;
+    uint pad;
+};
+
+#else
+
+#include <stddef.h>
+#include <stdint.h>
+
+// vec2 comes from types.h
+typedef struct {
+    vec2 pos;
+    float mss;
+    float pad0;
+    vec2 vel;
+    uint32_t col;
+    uint32_t pad1;
+} Particle;
+
+// bytes a direct kernel loads per interaction, everything from vel on stays out of the inner loop
+#define PARTICLE_INTERACTION_BYTES offsetof(Particle, vel)
+
+_Static_assert(sizeof(Particle) == 32, "Particle must match the std430 stride of the shader struct");
+_Static_assert(offsetof(Particle, pos) == 0 && offsetof(Particle, mss) == 8, "pos and mss form posMss");
+_Static_assert(offsetof(Particle, vel) == 16, "vel must follow the posMss vec4");
+_Static_assert(offsetof(Particle, col) == 24, "col must follow vel");
+
+#endif
+
+#endif
@@ -0,0 +1,164 @@
+#include "particleMesh.h"
+#include "cpuSim.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+// In place radix-2 FFT of size samples spaced stride apart, size a power of two.
+// The inverse is scaled by 1 / size, so fft followed by its inverse is the identity.
+void fft(Complex* data, uint32_t size, uint32_t stride, bool inverse) {
+    for (uint32_t i = 1, j = 0; i < size; i++) {
+        uint32_t bit = size >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j |= bit;
+        if (i < j) {
+            Complex swap = data[i * stride];
+            data[i * stride] = data[j * stride];
+            data[j * stride] = swap;
+        }
+    }
+
+    const double pi = 3.14159265358979323846;
+    for (uint32_t half = 1; half < size; half <<= 1) {
+        double angle = (inverse ? pi : -pi) / half;
+        for (uint32_t start = 0; start < size; start += 2 * half) {
+            for (uint32_t k = 0; k < half; k++) {
+                Complex w = { cos(angle * k), sin(angle * k) };
+                Complex* a = &data[(start + k) * stride];
+                Complex* b = &data[(start + k + half) * stride];
+                Complex t = { w.re * b->re - w.im * b->im, w.re * b->im + w.im * b->re };
+                b->re = a->re - t.re;
+                b->im = a->im - t.im;
+                a->re += t.re;
+                a->im += t.im;
+            }
+        }
+    }
+
+    if (inverse) {
+        for (uint32_t i = 0; i < size; i++) {
+            data[i * stride].re /= size;
+            data[i * stride].im /= size;
+        }
+    }
+}
+
+// Rows, then columns of a row-major size x size grid
+void fft2d(Complex* grid, uint32_t size, bool inverse) {
+    for (uint32_t row = 0; row < size; row++) {
+        fft(grid + row * size, size, 1, inverse);
+    }
+    for (uint32_t column = 0; column < size; column++) {
+        fft(grid + column, size, size, inverse);
+    }
+}
+
+// Isolated boundaries convolve on a grid twice the size of the mesh, so the kernel never
+// wraps around onto another particle. Periodic boundaries wrap on purpose.
+uint32_t particleMeshFftSize(uint32_t gridSize, bool periodic) {
+    return periodic ? gridSize : 2 * gridSize;
+}
+
+// A periodic mesh covers [-boxSize, boxSize) in both directions. An isolated one is the
+// square around all particles, with room for the cell past the last particle.
+MeshBounds particleMeshBounds(const Particle* particles, uint32_t count, uint32_t gridSize, bool periodic, float boxSize) {
+    MeshBounds bounds;
+    if (periodic) {
+        bounds.lowerX = -boxSize;
+        bounds.lowerY = -boxSize;
+        bounds.cellSize = 2.0 * boxSize / gridSize;
+        return bounds;
+    }
+
+    double loX = 1e30, loY = 1e30, hiX = -1e30, hiY = -1e30;
+    for (uint32_t i = 0; i < count; i++) {
+        loX = fmin(loX, particles[i].pos.x);
+        loY = fmin(loY, particles[i].pos.y);
+        hiX = fmax(hiX, particles[i].pos.x);
+        hiY = fmax(hiY, particles[i].pos.y);
+    }
+    bounds.lowerX = loX;
+    bounds.lowerY = loY;
+    bounds.cellSize = (fmax(hiX - loX, hiY - loY) * 1.0001 + 1e-6) / (gridSize - 1);
+    return bounds;
+}
+
+// Acceleration at offset 0 caused by unit mass at every cell offset, x + iy, offsets
+// past half the grid wrap to negative ones. The odd kernel has no Nyquist term.
+void fillParticleMeshKernel(Complex* kernel, uint32_t fftSize, double cellSize) {
+    for (uint32_t y = 0; y < fftSize; y++) {
+        for (uint32_t x = 0; x < fftSize; x++) {
+            int32_t offsetX = x < fftSize / 2 ? (int32_t)x : (int32_t)x - (int32_t)fftSize;
+            int32_t offsetY = y < fftSize / 2 ? (int32_t)y : (int32_t)y - (int32_t)fftSize;
+            // the source sits at -offset from the cell that feels it
+            double distanceX = -offsetX * cellSize;
+            double distanceY = -offsetY * cellSize;
+            double x2_y2 = distanceX * distanceX + distanceY * distanceY;
+            double dist = 1.0 / sqrt(x2_y2 * x2_y2 * x2_y2 + SOFTENING);
+
+            Complex* k = &kernel[y * fftSize + x];
+            k->re = x == fftSize / 2 ? 0.0 : distanceX * dist;
+            k->im = y == fftSize / 2 ? 0.0 : distanceY * dist;
+        }
+    }
+}
+
+// Cloud-in-cell deposit, FFT convolution with the softened force law and cloud-in-cell
+// interpolation, the same steps as the pm_*.comp passes.
+void particleMeshAccelerations(const Particle* particles, uint32_t count, uint32_t gridSize, bool periodic, float boxSize, vec2* accelerations) {
+    uint32_t fftSize = particleMeshFftSize(gridSize, periodic);
+    MeshBounds bounds = particleMeshBounds(particles, count, gridSize, periodic, boxSize);
+
+    Complex* field = (Complex*)calloc((size_t)fftSize * fftSize, sizeof(Complex));
+    Complex* kernel = (Complex*)malloc(sizeof(Complex) * fftSize * fftSize);
+
+    uint32_t* cells = (uint32_t*)malloc(sizeof(uint32_t) * 4 * count);
+    double* weights = (double*)malloc(sizeof(double) * 4 * count);
+    for (uint32_t i = 0; i < count; i++) {
+        double u = (particles[i].pos.x - bounds.lowerX) / bounds.cellSize;
+        double v = (particles[i].pos.y - bounds.lowerY) / bounds.cellSize;
+        if (periodic) {
+            u -= gridSize * floor(u / gridSize);
+            v -= gridSize * floor(v / gridSize);
+        }
+        int32_t cellX = (int32_t)floor(u);
+        int32_t cellY = (int32_t)floor(v);
+        double fracX = u - cellX;
+        double fracY = v - cellY;
+        for (uint32_t c = 0; c < 4; c++) {
+            uint32_t x = (uint32_t)(cellX + (c & 1)) % fftSize;
+            uint32_t y = (uint32_t)(cellY + (c >> 1)) % fftSize;
+            cells[4 * i + c] = y * fftSize + x;
+            weights[4 * i + c] = ((c & 1) ? fracX : 1.0 - fracX) * ((c >> 1) ? fracY : 1.0 - fracY);
+            field[y * fftSize + x].re += particles[i].mss * weights[4 * i + c];
+        }
+    }
+
+    fillParticleMeshKernel(kernel, fftSize, bounds.cellSize);
+    fft2d(field, fftSize, false);
+    fft2d(kernel, fftSize, false);
+    for (uint32_t c = 0; c < fftSize * fftSize; c++) {
+        Complex a = field[c];
+        Complex b = kernel[c];
+        field[c].re = a.re * b.re - a.im * b.im;
+        field[c].im = a.re * b.im + a.im * b.re;
+    }
+    fft2d(field, fftSize, true);
+
+    for (uint32_t i = 0; i < count; i++) {
+        double sumX = 0.0, sumY = 0.0;
+        for (uint32_t c = 0; c < 4; c++) {
+            sumX += weights[4 * i + c] * field[cells[4 * i + c]].re;
+            sumY += weights[4 * i + c] * field[cells[4 * i + c]].im;
+        }
+        accelerations[i].x = (float)sumX;
+        accelerations[i].y = (float)sumY;
+    }
+
+    free(field);
+    free(kernel);
+    free(cells);
+    free(weights);
+}
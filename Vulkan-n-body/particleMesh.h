@@ -0,0 +1,24 @@
+#ifndef PARTICLEMESH_H
+#define PARTICLEMESH_H
+
+#include "types.h"
+
+// CPU reference of the particle-mesh solver in vkParticleMesh.c, in double precision.
+// Used to check the GPU passes and as the baseline of their accuracy.
+
+// Mesh placement shared with shaders/pm_place.comp
+typedef struct MeshBounds {
+    double lowerX;
+    double lowerY;
+    double cellSize;
+} MeshBounds;
+
+void fft(Complex* data, uint32_t size, uint32_t stride, bool inverse);
+void fft2d(Complex* grid, uint32_t size, bool inverse);
+
+uint32_t particleMeshFftSize(uint32_t gridSize, bool periodic);
+MeshBounds particleMeshBounds(const Particle* particles, uint32_t count, uint32_t gridSize, bool periodic, float boxSize);
+void fillParticleMeshKernel(Complex* kernel, uint32_t fftSize, double cellSize);
+void particleMeshAccelerations(const Particle* particles, uint32_t count, uint32_t gridSize, bool periodic, float boxSize, vec2* accelerations);
+
+#endif
@@ -0,0 +1,60 @@
+#include "particles.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+void generateParticles(Particle* particles, uint32_t count, InitialConditions conditions) {
+    if (conditions == INITIAL_CONDITIONS_CLUSTERED) {
+        initClusteredParticles(particles, count, 8);
+    }
+    else {
+        initParticles(particles, count);
+    }
+}
+
+void initParticles(Particle* particles, uint32_t count) {
+    #define frand ((float)rand() / (float)RAND_MAX)
+    #define rands(x) (rand() > RAND_MAX / 2 ? -x : x)
+    for (uint32_t i = 0; i < count; i++) {
+        particles[i].pos.x = rands(frand);
+        particles[i].pos.y = rands(frand);
+        particles[i].vel.x = rands(frand);
+        particles[i].vel.y = rands(frand);
+        particles[i].mss = rands(frand);
+        particles[i].pad0 = 0.0f;
+        // opaque magenta
+        particles[i].col = 0xFFFF00FF;
+        particles[i].pad1 = 0;
+    }
+}
+
+// Projected Plummer spheres of scale radius PLUMMER_RADIUS around random centers, cold so
+// they collapse. The density contrast between the cores and the outskirts spreads the
+// particles over many block time step levels.
+#define PLUMMER_RADIUS 0.02f
+void initClusteredParticles(Particle* particles, uint32_t count, uint32_t clusterCount) {
+    const float pi = 3.14159265f;
+    for (uint32_t i = 0; i < count; i++) {
+        // clusters are seeded from their index, so each one keeps its center whatever count is
+        uint32_t cluster = i % clusterCount;
+        float centerX = 0.6f * sinf(12.9898f * (cluster + 1));
+        float centerY = 0.6f * cosf(78.233f * (cluster + 1));
+
+        // inverse of the Plummer cumulative mass, the far tail is cut off at 10 scale radii
+        float radius;
+        do {
+            float u = ((float)rand() + 1.0f) / ((float)RAND_MAX + 2.0f);
+            radius = PLUMMER_RADIUS / sqrtf(powf(u, -2.0f / 3.0f) - 1.0f);
+        } while (radius > 10.0f * PLUMMER_RADIUS);
+        float angle = 2.0f * pi * (float)rand() / (float)RAND_MAX;
+
+        particles[i].pos.x = centerX + radius * cosf(angle);
+        particles[i].pos.y = centerY + radius * sinf(angle);
+        particles[i].vel.x = 0.0f;
+        particles[i].vel.y = 0.0f;
+        particles[i].mss = (float)rand() / (float)RAND_MAX;
+        particles[i].pad0 = 0.0f;
+        particles[i].col = 0xFFFF00FF;
+        particles[i].pad1 = 0;
+    }
+}
@@ -0,0 +1,10 @@
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include "types.h"
+
+void generateParticles(Particle* particles, uint32_t count, InitialConditions conditions);
+void initParticles(Particle* particles, uint32_t count);
+void initClusteredParticles(Particle* particles, uint32_t count, uint32_t clusterCount);
+
+#endif
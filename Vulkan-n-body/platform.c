@@ -0,0 +1,235 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+typedef struct ThreadStart {
+    ThreadFunction function;
+    void* arg;
+} ThreadStart;
+
+#ifdef _WIN32
+
+unsigned __stdcall threadTrampoline(void* arg) {
+    ThreadStart start = *(ThreadStart*)arg;
+    free(arg);
+    start.function(start.arg);
+    return 0;
+}
+
+void threadCreate(Thread* thread, ThreadFunction function, void* arg) {
+    ThreadStart* start = (ThreadStart*)malloc(sizeof(ThreadStart));
+    start->function = function;
+    start->arg = arg;
+    thread->handle = (void*)_beginthreadex(NULL, 0, threadTrampoline, start, 0, NULL);
+    if (thread->handle == NULL) {
+        printf("failed to create thread!\n");
+        exit(1);
+    }
+}
+
+void threadJoin(Thread* thread) {
+    WaitForSingleObject((HANDLE)thread->handle, INFINITE);
+    CloseHandle((HANDLE)thread->handle);
+}
+
+void mutexInit(Mutex* mutex) {
+    InitializeSRWLock((PSRWLOCK)&mutex->handle);
+}
+
+void mutexDestroy(Mutex* mutex) {
+}
+
+void mutexLock(Mutex* mutex) {
+    AcquireSRWLockExclusive((PSRWLOCK)&mutex->handle);
+}
+
+void mutexUnlock(Mutex* mutex) {
+    ReleaseSRWLockExclusive((PSRWLOCK)&mutex->handle);
+}
+
+void conditionInit(ConditionVariable* condition) {
+    InitializeConditionVariable((PCONDITION_VARIABLE)&condition->handle);
+}
+
+void conditionDestroy(ConditionVariable* condition) {
+}
+
+void conditionWait(ConditionVariable* condition, Mutex* mutex) {
+    SleepConditionVariableSRW((PCONDITION_VARIABLE)&condition->handle, (PSRWLOCK)&mutex->handle, INFINITE, 0);
+}
+
+void conditionBroadcast(ConditionVariable* condition) {
+    WakeAllConditionVariable((PCONDITION_VARIABLE)&condition->handle);
+}
+
+int32_t atomicAdd(volatile int32_t* value, int32_t amount) {
+    return InterlockedExchangeAdd((volatile LONG*)value, amount) + amount;
+}
+
+int32_t atomicLoad(volatile int32_t* value) {
+    return InterlockedCompareExchange((volatile LONG*)value, 0, 0);
+}
+
+uint32_t getProcessorCount(void) {
+    return GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+}
+
+double getTime(void) {
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+void* mapFile(const char* path, uint64_t* size) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return NULL;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    void* data = mapping != NULL ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    // the view keeps the file mapped after both handles are closed
+    if (mapping != NULL) {
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+
+    *size = (uint64_t)fileSize.QuadPart;
+    return data;
+}
+
+void unmapFile(void* data, uint64_t size) {
+    UnmapViewOfFile(data);
+}
+
+bool replaceFile(const char* source, const char* destination) {
+    return MoveFileExA(source, destination, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+#else
+
+void* threadTrampoline(void* arg) {
+    ThreadStart start = *(ThreadStart*)arg;
+    free(arg);
+    start.function(start.arg);
+    return NULL;
+}
+
+void threadCreate(Thread* thread, ThreadFunction function, void* arg) {
+    ThreadStart* start = (ThreadStart*)malloc(sizeof(ThreadStart));
+    start->function = function;
+    start->arg = arg;
+    if (pthread_create(&thread->handle, NULL, threadTrampoline, start) != 0) {
+        printf("failed to create thread!\n");
+        exit(1);
+    }
+}
+
+void threadJoin(Thread* thread) {
+    pthread_join(thread->handle, NULL);
+}
+
+void mutexInit(Mutex* mutex) {
+    pthread_mutex_init(&mutex->handle, NULL);
+}
+
+void mutexDestroy(Mutex* mutex) {
+    pthread_mutex_destroy(&mutex->handle);
+}
+
+void mutexLock(Mutex* mutex) {
+    pthread_mutex_lock(&mutex->handle);
+}
+
+void mutexUnlock(Mutex* mutex) {
+    pthread_mutex_unlock(&mutex->handle);
+}
+
+void conditionInit(ConditionVariable* condition) {
+    pthread_cond_init(&condition->handle, NULL);
+}
+
+void conditionDestroy(ConditionVariable* condition) {
+    pthread_cond_destroy(&condition->handle);
+}
+
+void conditionWait(ConditionVariable* condition, Mutex* mutex) {
+    pthread_cond_wait(&condition->handle, &mutex->handle);
+}
+
+void conditionBroadcast(ConditionVariable* condition) {
+    pthread_cond_broadcast(&condition->handle);
+}
+
+int32_t atomicAdd(volatile int32_t* value, int32_t amount) {
+    return __atomic_add_fetch(value, amount, __ATOMIC_ACQ_REL);
+}
+
+int32_t atomicLoad(volatile int32_t* value) {
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+uint32_t getProcessorCount(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (uint32_t)count : 1;
+}
+
+double getTime(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+void* mapFile(const char* path, uint64_t* size) {
+    int file = open(path, O_RDONLY);
+    if (file < 0) {
+        return NULL;
+    }
+    struct stat fileStat;
+    if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0) {
+        close(file);
+        return NULL;
+    }
+    void* data = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    // read ahead, the whole file is copied out front to back
+    posix_madvise(data, (size_t)fileStat.st_size, POSIX_MADV_SEQUENTIAL);
+
+    *size = (uint64_t)fileStat.st_size;
+    return data;
+}
+
+void unmapFile(void* data, uint64_t size) {
+    munmap(data, (size_t)size);
+}
+
+bool replaceFile(const char* source, const char* destination) {
+    return rename(source, destination) == 0;
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Thin wrappers over Win32 and pthreads so the CPU backend builds on both.
+// The Win32 handles (SRWLOCK, CONDITION_VARIABLE) are pointer sized, which keeps
+// windows.h out of every file that includes this header.
+
+#ifdef _WIN32
+typedef struct Thread { void* handle; } Thread;
+typedef struct Mutex { void* handle; } Mutex;
+typedef struct ConditionVariable { void* handle; } ConditionVariable;
+#else
+#include <pthread.h>
+typedef struct Thread { pthread_t handle; } Thread;
+typedef struct Mutex { pthread_mutex_t handle; } Mutex;
+typedef struct ConditionVariable { pthread_cond_t handle; } ConditionVariable;
+#endif
+
+typedef void (*ThreadFunction)(void* arg);
+
+void threadCreate(Thread* thread, ThreadFunction function, void* arg);
+void threadJoin(Thread* thread);
+
+void mutexInit(Mutex* mutex);
+void mutexDestroy(Mutex* mutex);
+void mutexLock(Mutex* mutex);
+void mutexUnlock(Mutex* mutex);
+
+void conditionInit(ConditionVariable* condition);
+void conditionDestroy(ConditionVariable* condition);
+void conditionWait(ConditionVariable* condition, Mutex* mutex);
+void conditionBroadcast(ConditionVariable* condition);
+
+// returns the new value
+int32_t atomicAdd(volatile int32_t* value, int32_t amount);
+int32_t atomicLoad(volatile int32_t* value);
+
+uint32_t getProcessorCount(void);
+
+// monotonic wall clock in seconds
+double getTime(void);
+
+// Read only view of a whole file, NULL if it can't be opened
+void* mapFile(const char* path, uint64_t* size);
+void unmapFile(void* data, uint64_t size);
+// Renames source over destination, replacing it if it exists
+bool replaceFile(const char* source, const char* destination);
+
+#endif
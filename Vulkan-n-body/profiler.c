@@ -0,0 +1,170 @@
+#include "profiler.h"
+#include "vkinit.h"
+#include "vkDraw.h"
+#include "platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// One query pool per queue, with a begin and end timestamp for every frame slot. Results are
+// only read once the slot's timeline value has been waited for anyway before reusing its
+// command buffers, so reading them never stalls.
+void createProfiler(Context* context) {
+    Profiler* profiler = &context->profiler;
+
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(context->physicalDevice, &deviceProperties);
+    profiler->timestampPeriod = deviceProperties.limits.timestampPeriod;
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(context->physicalDevice, &queueFamilyCount, NULL);
+    VkQueueFamilyProperties* queueFamilyProperties = (VkQueueFamilyProperties*)malloc(sizeof(VkQueueFamilyProperties) * queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(context->physicalDevice, &queueFamilyCount, queueFamilyProperties);
+
+    uint32_t families[PROFILER_STAGE_COUNT] = { context->queueFamilyIndices.computeFamily, context->queueFamilyIndices.graphicsFamily };
+    for (uint32_t stage = 0; stage < PROFILER_STAGE_COUNT; stage++) {
+        profiler->pending[stage] = (bool*)calloc(context->MAX_FRAMES_IN_FLIGHT, sizeof(bool));
+        profiler->queryPools[stage] = VK_NULL_HANDLE;
+
+        uint32_t validBits = queueFamilyProperties[families[stage]].timestampValidBits;
+        if ((stage == PROFILER_STAGE_RENDER && context->headless) || validBits == 0) {
+            continue;
+        }
+        profiler->timestampMask[stage] = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+
+        VkQueryPoolCreateInfo poolInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = 2 * context->MAX_FRAMES_IN_FLIGHT
+        };
+        VkResult result = vkCreateQueryPool(context->device, &poolInfo, NULL, &profiler->queryPools[stage]);
+        checkErr(result, "failed to create timestamp query pool!");
+    }
+    free(queueFamilyProperties);
+
+    if (profiler->queryPools[PROFILER_STAGE_COMPUTE] == VK_NULL_HANDLE) {
+        printf("Compute queue has no timestamps, GPU compute time not reported\n");
+    }
+
+    profiler->printTime = getTime();
+    profiler->printStep = context->stepIndex;
+}
+
+void destroyProfiler(Context* context) {
+    Profiler* profiler = &context->profiler;
+    for (uint32_t stage = 0; stage < PROFILER_STAGE_COUNT; stage++) {
+        vkDestroyQueryPool(context->device, profiler->queryPools[stage], NULL);
+        free(profiler->pending[stage]);
+    }
+}
+
+// Must be recorded outside a render pass, the queries are reset here.
+void profilerBegin(Context* context, VkCommandBuffer commandBuffer, ProfilerStage stage, uint32_t frame, VkPipelineStageFlagBits pipelineStage) {
+    VkQueryPool queryPool = context->profiler.queryPools[stage];
+    if (queryPool == VK_NULL_HANDLE) {
+        return;
+    }
+    vkCmdResetQueryPool(commandBuffer, queryPool, 2 * frame, 2);
+    vkCmdWriteTimestamp(commandBuffer, pipelineStage, queryPool, 2 * frame);
+}
+
+void profilerEnd(Context* context, VkCommandBuffer commandBuffer, ProfilerStage stage, uint32_t frame) {
+    VkQueryPool queryPool = context->profiler.queryPools[stage];
+    if (queryPool == VK_NULL_HANDLE) {
+        return;
+    }
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 2 * frame + 1);
+}
+
+void profilerSubmitted(Context* context, ProfilerStage stage, uint32_t frame) {
+    context->profiler.pending[stage][frame] = true;
+}
+
+// Reads the slot's timestamps without waiting, results that aren't available yet are dropped.
+void profilerCollect(Context* context, ProfilerStage stage, uint32_t frame) {
+    Profiler* profiler = &context->profiler;
+    if (profiler->queryPools[stage] == VK_NULL_HANDLE || !profiler->pending[stage][frame]) {
+        return;
+    }
+    profiler->pending[stage][frame] = false;
+
+    uint64_t timestamps[2];
+    VkResult result = vkGetQueryPoolResults(context->device, profiler->queryPools[stage], 2 * frame, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) {
+        return;
+    }
+    uint64_t ticks = (timestamps[1] - timestamps[0]) & profiler->timestampMask[stage];
+    rollingStatsAdd(&profiler->gpuTime[stage], ticks * (double)profiler->timestampPeriod * 1e-6);
+}
+
+void rollingStatsAdd(RollingStats* stats, double value) {
+    stats->samples[stats->next] = value;
+    stats->next = (stats->next + 1) % PROFILER_WINDOW;
+    if (stats->count < PROFILER_WINDOW) {
+        stats->count++;
+    }
+}
+
+int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+double rollingStatsPercentile(const RollingStats* stats, double percentile) {
+    if (stats->count == 0) {
+        return 0.0;
+    }
+    double sorted[PROFILER_WINDOW];
+    memcpy(sorted, stats->samples, stats->count * sizeof(double));
+    qsort(sorted, stats->count, sizeof(double), compareDoubles);
+    return sorted[(uint32_t)(percentile * (stats->count - 1) + 0.5)];
+}
+
+void printRollingStats(const char* name, const RollingStats* stats) {
+    if (stats->count == 0) {
+        return;
+    }
+    printf("  %-14s ms  p50 %8.3lf  p95 %8.3lf  p99 %8.3lf\n", name,
+        rollingStatsPercentile(stats, 0.50), rollingStatsPercentile(stats, 0.95), rollingStatsPercentile(stats, 0.99));
+}
+
+// Prints throughput and the percentiles over the last PROFILER_WINDOW samples once every
+// PROFILER_PRINT_INTERVAL seconds.
+void profilerPrint(Context* context, double now) {
+    Profiler* profiler = &context->profiler;
+    if (now - profiler->printTime < PROFILER_PRINT_INTERVAL) {
+        return;
+    }
+
+    double stepsPerSecond = (context->stepIndex - profiler->printStep) / (now - profiler->printTime);
+    double interactionsPerStep = (double)context->PARTICLE_COUNT * (double)context->PARTICLE_COUNT;
+    printf("steps/s: %.1lf\t interactions/s: %.3e\n", stepsPerSecond, stepsPerSecond * interactionsPerStep);
+    printRollingStats(context->headless ? "submission" : "frame", &profiler->frameTime);
+    printRollingStats("record+submit", &profiler->recordSubmitTime);
+    printRollingStats("gpu compute", &profiler->gpuTime[PROFILER_STAGE_COMPUTE]);
+    printRollingStats(context->renderMode == RENDER_MODE_DENSITY ? "gpu density" : "gpu points", &profiler->gpuTime[PROFILER_STAGE_RENDER]);
+
+    // what the direct kernels' inner loop streams per submission, against the measured compute time.
+    // Only the all-pairs kernels do N^2 interactions, for the others the figure would be made up.
+    const RollingStats* computeTime = &profiler->gpuTime[PROFILER_STAGE_COMPUTE];
+    bool allPairs = context->computeKernel == COMPUTE_KERNEL_REFERENCE || context->computeKernel == COMPUTE_KERNEL_TILED;
+    if (allPairs && computeTime->count > 0) {
+        double loadedBytes = (double)PARTICLE_INTERACTION_BYTES * interactionsPerStep * context->substeps;
+        printf("  particle loads  B/interaction %u  GB/s %8.1lf\n", (uint32_t)PARTICLE_INTERACTION_BYTES,
+            loadedBytes / (rollingStatsPercentile(computeTime, 0.50) * 1e-3) * 1e-9);
+    }
+
+    profiler->printTime = now;
+    profiler->printStep = context->stepIndex;
+}
+
+// Startup latency from the start of initialization until the first compute submission of
+// the run has finished, including pipeline creation, which the pipeline cache shortens.
+void profilerFirstStep(Context* context) {
+    waitTimeline(context->device, context->computeTimeline, context->submissionCount);
+    const char* cacheState = context->pipelineCachePath == NULL ? "off" : context->pipelineCacheWarm ? "warm" : "cold";
+    printf("Time to first step: %.1lf ms\t pipeline cache: %s\n", (getTime() - context->startTime) * 1000.0, cacheState);
+    context->startTime = 0.0;
+}
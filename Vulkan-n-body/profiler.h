@@ -0,0 +1,23 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "types.h"
+
+#define PROFILER_PRINT_INTERVAL 1.0 // seconds
+
+void createProfiler(Context* context);
+void destroyProfiler(Context* context);
+
+void profilerBegin(Context* context, VkCommandBuffer commandBuffer, ProfilerStage stage, uint32_t frame, VkPipelineStageFlagBits pipelineStage);
+void profilerEnd(Context* context, VkCommandBuffer commandBuffer, ProfilerStage stage, uint32_t frame);
+void profilerSubmitted(Context* context, ProfilerStage stage, uint32_t frame);
+void profilerCollect(Context* context, ProfilerStage stage, uint32_t frame);
+
+void rollingStatsAdd(RollingStats* stats, double value);
+int compareDoubles(const void* a, const void* b);
+double rollingStatsPercentile(const RollingStats* stats, double percentile);
+void printRollingStats(const char* name, const RollingStats* stats);
+void profilerPrint(Context* context, double now);
+void profilerFirstStep(Context* context);
+
+#endif
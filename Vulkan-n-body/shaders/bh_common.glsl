@@ -0,0 +1,69 @@
+// Shared declarations for the Barnes-Hut passes (bh_*.comp).
+// TREE_DEPTH and BLOCK_SIZE must match BH_TREE_DEPTH and BH_BLOCK_SIZE in vkBarnesHut.h.
+
+#define TREE_DEPTH 8
+#define LEAF_COUNT (1u << (2u * TREE_DEPTH))
+#define SORT_BITS 4
+#define SORT_BUCKETS (1u << SORT_BITS)
+#define BLOCK_SIZE 256
+
+#include "../particleLayout.h"
+
+// Positive and negative masses are summed separately so that a cell with a
+// near-zero total mass still has well defined centers of mass.
+// xy = sum of |m| * pos, z = sum of |m|
+struct Node {
+    vec4 positive;
+    vec4 negative;
+};
+
+layout (binding = 0) uniform ParameterUBO {
+    float deltaTime;
+} ubo;
+
+layout(std430, binding = 1) readonly buffer ParticleSSBOIn {
+   Particle particlesIn[ ];
+};
+
+layout(std430, binding = 2) buffer ParticleSSBOOut {
+   Particle particlesOut[ ];
+};
+
+// x = morton code, y = particle index. Two halves of PARTICLE_COUNT entries
+// are used as ping-pong buffers by the radix sort.
+layout(std430, binding = 3) buffer KeySSBO {
+   uvec2 keys[ ];
+};
+
+// Per block digit histograms, stored digit-major, turned into scatter offsets by the scan.
+layout(std430, binding = 4) buffer DigitCountSSBO {
+   uint digitCounts[ ];
+};
+
+// [first, last) range of sorted keys in every leaf cell
+layout(std430, binding = 5) buffer LeafRangeSSBO {
+   uvec2 leafRanges[ ];
+};
+
+layout(std430, binding = 6) buffer NodeSSBO {
+   Node nodes[ ];
+};
+
+// xy = lower corner of the root cell, z = side length
+layout(std430, binding = 7) buffer BoundsSSBO {
+   vec4 bounds;
+};
+
+layout(push_constant) uniform PushConstants {
+    uint particleCount;
+    uint shift;
+    uint level;
+    uint keysIn;
+    uint keysOut;
+    float theta;
+} pc;
+
+// Nodes are stored level by level, level l holds 4^l cells indexed by morton prefix.
+uint levelOffset(uint level) {
+    return ((1u << (2u * level)) - 1u) / 3u;
+}
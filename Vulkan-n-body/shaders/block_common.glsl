@@ -0,0 +1,58 @@
+// Shared declarations for the block time step passes (block_*.comp).
+// BLOCK_SIZE must match BLOCK_STEP_BLOCK_SIZE in vkBlockSteps.h.
+//
+// A particle on level l steps with deltaTime / 2^l, so it is due every 2^(levelCount - 1 - l)
+// ticks of the finest level. Velocities are kept half a step ahead (kick-drift-kick): every
+// tick drifts all particles, then the due ones get their closing and next opening kick.
+
+#define BLOCK_SIZE 256
+
+#include "../particleLayout.h"
+
+layout (binding = 0) uniform ParameterUBO {
+    float deltaTime;
+} ubo;
+
+layout(std430, binding = 1) readonly buffer ParticleSSBOIn {
+   Particle particlesIn[ ];
+};
+
+layout(std430, binding = 2) buffer ParticleSSBOOut {
+   Particle particlesOut[ ];
+};
+
+layout(std430, binding = 3) buffer LevelSSBO {
+   uint levels[ ];
+};
+
+// Particles due this tick, in no particular order
+layout(std430, binding = 4) buffer ActiveIndexSSBO {
+   uint activeIndices[ ];
+};
+
+// The first three words are the indirect dispatch of the force pass
+layout(std430, binding = 5) buffer StateSSBO {
+    uint dispatchX;
+    uint dispatchY;
+    uint dispatchZ;
+    uint activeCount;       // particles in activeIndices
+    uint appendCount;       // bumped by the drift pass, moved to activeCount by the dispatch pass
+    uint deepestLevel;      // finest level assigned since the last step boundary
+    uvec2 evaluations;      // 64 bit, low word first
+    uvec2 globalEvaluations;
+} state;
+
+layout(push_constant) uniform PushConstants {
+    uint particleCount;
+    uint levelCount;
+    uint tick;
+    float accuracy;
+} pc;
+
+bool levelDue(uint level, uint tick) {
+    return (tick & ((1u << (pc.levelCount - 1u - level)) - 1u)) == 0u;
+}
+
+float levelTimeStep(uint level) {
+    return ubo.deltaTime / float(1u << level);
+}
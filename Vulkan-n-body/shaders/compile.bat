@@ -1,4 +1,48 @@
-C:/VulkanSDK/1.3.239.0/Bin/glslc.exe shader.vert -o compiled/vert.spv
-C:/VulkanSDK/1.3.239.0/Bin/glslc.exe shader.frag -o compiled/frag.spv
-C:/VulkanSDK/1.3.239.0/Bin/glslc.exe shader.comp -o compiled/comp.spv
-pause
\ No newline at end of file
+@echo off
+rem Writes compiled/<name>.spv, loaded at runtime when shaderOverrideDir is set, and
+rem compiled/<name>.spv.inc, the SPIR-V words embeddedShaders.c compiles into the binary.
+rem Runs as the project pre-build step with nopause.
+cd /d "%~dp0"
+if defined VULKAN_SDK (set GLSLC="%VULKAN_SDK%/Bin/glslc.exe") else (set GLSLC=C:/VulkanSDK/1.3.239.0/Bin/glslc.exe)
+if not exist compiled mkdir compiled
+
+call :compile shader.vert vert || exit /b 1
+call :compile shader.frag frag || exit /b 1
+call :compile shader.comp comp || exit /b 1
+call :compile shader_tiled.comp comp_tiled || exit /b 1
+call :compile bh_bounds.comp bh_bounds || exit /b 1
+call :compile bh_morton.comp bh_morton || exit /b 1
+call :compile bh_sort_count.comp bh_sort_count || exit /b 1
+call :compile bh_sort_scan.comp bh_sort_scan || exit /b 1
+call :compile bh_sort_scatter.comp bh_sort_scatter || exit /b 1
+call :compile bh_leaves.comp bh_leaves || exit /b 1
+call :compile bh_upsweep.comp bh_upsweep || exit /b 1
+call :compile bh_force.comp bh_force || exit /b 1
+call :compile render_pack.comp render_pack || exit /b 1
+call :compile density_splat.comp density_splat || exit /b 1
+call :compile block_drift.comp block_drift || exit /b 1
+call :compile block_dispatch.comp block_dispatch || exit /b 1
+call :compile block_force.comp block_force || exit /b 1
+call :compile time_step_reduce.comp time_step_reduce || exit /b 1
+call :compile time_step_update.comp time_step_update || exit /b 1
+call :compile pm_bounds.comp pm_bounds || exit /b 1
+call :compile pm_place.comp pm_place || exit /b 1
+call :compile pm_kernel.comp pm_kernel || exit /b 1
+call :compile pm_deposit.comp pm_deposit || exit /b 1
+call :compile pm_deposit.comp pm_deposit64 -DDEPOSIT_INT64 || exit /b 1
+call :compile pm_load.comp pm_load || exit /b 1
+call :compile pm_load.comp pm_load64 -DDEPOSIT_INT64 || exit /b 1
+call :compile pm_fft.comp pm_fft || exit /b 1
+call :compile pm_multiply.comp pm_multiply || exit /b 1
+call :compile pm_interpolate.comp pm_interpolate || exit /b 1
+call :compile fullscreen.vert fullscreen_vert || exit /b 1
+call :compile density_tonemap.frag density_tonemap_frag || exit /b 1
+
+if not "%1"=="nopause" pause
+exit /b 0
+
+:compile
+rem %3 optionally defines a macro for a variant of the same source
+%GLSLC% %1 %3 -o compiled/%2.spv || exit /b 1
+%GLSLC% %1 %3 -mfmt=c -o compiled/%2.spv.inc || exit /b 1
+exit /b 0
@@ -0,0 +1,45 @@
+#!/bin/sh
+# Same as compile.bat: compiled/<name>.spv for shaderOverrideDir and compiled/<name>.spv.inc
+# for embeddedShaders.c. Uses glslc from VULKAN_SDK or the PATH.
+set -e
+cd "$(dirname "$0")"
+GLSLC="${VULKAN_SDK:+$VULKAN_SDK/bin/}glslc"
+mkdir -p compiled
+
+# $3 optionally defines a macro for a variant of the same source
+compile() {
+    "$GLSLC" "$1" ${3:+-D$3} -o "compiled/$2.spv"
+    "$GLSLC" "$1" ${3:+-D$3} -mfmt=c -o "compiled/$2.spv.inc"
+}
+
+compile shader.vert vert
+compile shader.frag frag
+compile shader.comp comp
+compile shader_tiled.comp comp_tiled
+compile bh_bounds.comp bh_bounds
+compile bh_morton.comp bh_morton
+compile bh_sort_count.comp bh_sort_count
+compile bh_sort_scan.comp bh_sort_scan
+compile bh_sort_scatter.comp bh_sort_scatter
+compile bh_leaves.comp bh_leaves
+compile bh_upsweep.comp bh_upsweep
+compile bh_force.comp bh_force
+compile render_pack.comp render_pack
+compile density_splat.comp density_splat
+compile block_drift.comp block_drift
+compile block_dispatch.comp block_dispatch
+compile block_force.comp block_force
+compile time_step_reduce.comp time_step_reduce
+compile time_step_update.comp time_step_update
+compile pm_bounds.comp pm_bounds
+compile pm_place.comp pm_place
+compile pm_kernel.comp pm_kernel
+compile pm_deposit.comp pm_deposit
+compile pm_deposit.comp pm_deposit64 DEPOSIT_INT64
+compile pm_load.comp pm_load
+compile pm_load.comp pm_load64 DEPOSIT_INT64
+compile pm_fft.comp pm_fft
+compile pm_multiply.comp pm_multiply
+compile pm_interpolate.comp pm_interpolate
+compile fullscreen.vert fullscreen_vert
+compile density_tonemap.frag density_tonemap_frag
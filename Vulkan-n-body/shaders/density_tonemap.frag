@@ -0,0 +1,25 @@
+#version 450
+
+layout(push_constant) uniform PushConstants {
+    uint width;
+    uint height;
+    uint particleCount;
+    float exposure;
+} pc;
+
+layout(std430, binding = 1) readonly buffer DensitySSBO {
+   uint density[ ];
+};
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    uvec2 pixel = uvec2(gl_FragCoord.xy);
+    float count = float(density[pixel.y * pc.width + pixel.x]);
+
+    // saturates smoothly instead of clipping dense regions
+    float v = 1.0 - exp(-pc.exposure * count);
+    outColor = vec4(v, v * v, v, 1.0);
+}
+
+// REMEMBER TO MANUALLY COMPILE!!
@@ -0,0 +1,38 @@
+// Leapfrog integration for shader_tiled.comp, included after
+// the uniform and particle buffer declarations.
+//
+// With KICK_DRIFT_KICK every dispatch is one leapfrog (sub)step of h = deltaTime * stepScale:
+//   v' = v + a h/2,  x' = x + v' h,  a' = a(x'),  v'' = v' + a' h/2
+// a is the acceleration stored by the previous (sub)step, so a step evaluates the forces once.
+// A drifted position only depends on the particle's own x, v and a, so the tiled kernel
+// drifts the other particles once per tile load instead of in a separate pass.
+
+layout (constant_id = 4) const bool KICK_DRIFT_KICK = false;
+
+layout(std430, binding = 3) readonly buffer AccelerationSSBOIn {
+   vec2 accelerationsIn[ ];
+};
+
+layout(std430, binding = 4) writeonly buffer AccelerationSSBOOut {
+   vec2 accelerationsOut[ ];
+};
+
+// stepScale = 0 leaves the particles where they are and only computes their accelerations
+layout(push_constant) uniform PushConstants {
+    float stepScale;
+} pc;
+
+vec2 halfKickVelocity(uint j, float h) {
+    return particlesIn[j].vel + accelerationsIn[j] * (0.5 * h);
+}
+
+vec2 driftedPosition(uint j, float h) {
+    return particlesIn[j].posMss.xy + halfKickVelocity(j, h) * h;
+}
+
+// Closing half kick, stores everything the next (sub)step reads
+void finishKickDriftKick(uint i, vec2 pos, vec2 acceleration, float h) {
+    particlesOut[i].posMss = vec4(pos, particlesIn[i].posMss.w);
+    particlesOut[i].vel = halfKickVelocity(i, h) + acceleration * (0.5 * h);
+    accelerationsOut[i] = acceleration;
+}
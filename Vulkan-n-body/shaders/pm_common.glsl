@@ -0,0 +1,99 @@
+// Shared declarations for the particle-mesh passes (pm_*.comp).
+// BLOCK_SIZE and MAX_FFT_SIZE must match PM_BLOCK_SIZE and PM_MAX_FFT_SIZE in vkParticleMesh.h.
+//
+// Masses are deposited to a gridSize^2 mesh and convolved with the force law sampled at every
+// cell offset, the x and y components as the real and imaginary part of one complex kernel:
+//   accelerations = IFFT(FFT(masses) * FFT(kernel.x + i kernel.y))
+// The FFT grid is twice the mesh per side unless the mesh is periodic, so an isolated mesh's
+// convolution never wraps around.
+//
+// The deposit is fixed point so that the sum doesn't depend on the order of the atomics.
+// DEPOSIT_INT64 (pm_deposit64, pm_load64) accumulates 64 bit integers on devices with
+// shaderBufferInt64Atomics, otherwise 32 bit ones are the fallback, see initializeParticleMesh
+// for what that costs in precision.
+
+#ifdef DEPOSIT_INT64
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+#extension GL_EXT_shader_atomic_int64 : require
+#define DEPOSIT_TYPE int64_t
+#else
+#define DEPOSIT_TYPE int
+#endif
+
+#define BLOCK_SIZE 256
+#define MAX_FFT_SIZE 1024
+
+#include "../particleLayout.h"
+
+layout (binding = 0) uniform ParameterUBO {
+    float deltaTime;
+} ubo;
+
+layout(std430, binding = 1) readonly buffer ParticleSSBOIn {
+   Particle particlesIn[ ];
+};
+
+layout(std430, binding = 2) buffer ParticleSSBOOut {
+   Particle particlesOut[ ];
+};
+
+// Fixed point masses, integer atomics work everywhere float ones do not
+layout(std430, binding = 3) buffer DepositSSBO {
+   DEPOSIT_TYPE deposit[ ];
+};
+
+// fftSize^2 masses, turned into accelerations in place, then fftSize^2 of kernel spectrum
+layout(std430, binding = 4) buffer GridSSBO {
+   vec2 grids[ ];
+};
+
+// bounds: xy = lower corner of the mesh, z = cell size.
+// extent: the particles' min x, min y, -max x, -max y as orderedKey, collected by pm_bounds
+// with atomicMin and reset to PM_EXTENT_CLEAR (vkParticleMesh.h) by pm_place.
+layout(std430, binding = 5) buffer BoundsSSBO {
+   vec4 bounds;
+   ivec4 extent;
+};
+
+layout(push_constant) uniform PushConstants {
+    uint particleCount;
+    uint gridSize;
+    uint fftSize;
+    uint logFftSize;
+    uint periodic;
+    float boxSize;
+    float massScale;
+    uint gridOffset;
+    uint sampleStride;
+    uint lineStride;
+    float direction;
+} pc;
+
+// An int that orders like the float, so integer atomicMin finds the smallest float
+int orderedKey(float f) {
+    int bits = floatBitsToInt(f);
+    return bits >= 0 ? bits : bits ^ 0x7FFFFFFF;
+}
+
+float orderedValue(int key) {
+    return intBitsToFloat(key >= 0 ? key : key ^ 0x7FFFFFFF);
+}
+
+// Position in cells from the lower corner, wrapped into the box when periodic
+vec2 meshCoordinates(vec2 pos) {
+    vec2 u = (pos - bounds.xy) / bounds.z;
+    if (pc.periodic != 0) {
+        u -= float(pc.gridSize) * floor(u / float(pc.gridSize));
+    }
+    return u;
+}
+
+// Grid index and weight of corner c (0..3) of the cloud-in-cell square at u
+uint cloudCell(vec2 u, uint c, out float weight) {
+    vec2 cell = floor(u);
+    vec2 frac = u - cell;
+    uvec2 corner = uvec2(c & 1u, c >> 1);
+    weight = (corner.x == 1u ? frac.x : 1.0 - frac.x) * (corner.y == 1u ? frac.y : 1.0 - frac.y);
+    uvec2 xy = (uvec2(ivec2(cell)) + corner) % pc.fftSize;
+    return xy.y * pc.fftSize + xy.x;
+}
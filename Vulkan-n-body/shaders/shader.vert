@@ -1,7 +1,8 @@
 #version 450
 
 layout(location = 0) in vec2 inPosition;
-layout(location = 1) in vec3 inColor;
+// RGBA8 UNORM, unpacked by the vertex fetch
+layout(location = 1) in vec4 inColor;
 
 layout(location = 0) out vec3 fragColor;
 
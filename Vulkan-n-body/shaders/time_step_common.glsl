@@ -0,0 +1,40 @@
+// Shared declarations for the adaptive time step passes (time_step_*.comp).
+// REDUCE_SIZE must match TIME_STEP_REDUCE_SIZE in vkTimeStep.h.
+//
+// After every step the reduce pass finds the largest acceleration and speed, then a single
+// invocation picks the next step as
+//   accuracy * min(sqrt(SOFTENING_LENGTH / |a|max), SOFTENING_LENGTH / |v|max)
+// clamped to [minTimeStep, maxTimeStep] and to twice the previous step. Below the softening
+// length the force law levels off, so no particle has to resolve anything smaller.
+
+#define REDUCE_SIZE 256
+
+#include "../particleLayout.h"
+
+// The compute kernels bind the same buffer as their uniform buffer, deltaTime comes first
+layout(std430, binding = 0) buffer TimeStepSSBO {
+    float deltaTime;
+    uint maxAcceleration2;
+    uint maxSpeed2;
+    float time;
+    float timeLow;
+    float smallestTimeStep;
+    float largestTimeStep;
+    uint reserved;
+} state;
+
+layout(std430, binding = 1) readonly buffer ParticleSSBO {
+   Particle particles[ ];
+};
+
+layout(std430, binding = 2) readonly buffer AccelerationSSBO {
+   vec2 accelerations[ ];
+};
+
+layout(push_constant) uniform PushConstants {
+    uint particleCount;
+    uint advance;
+    float accuracy;
+    float minTimeStep;
+    float maxTimeStep;
+} pc;
@@ -0,0 +1,211 @@
+#include "threadPool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void pushTask(TaskDeque* deque, Task task) {
+    mutexLock(&deque->mutex);
+    if (deque->count == deque->capacity) {
+        uint32_t capacity = deque->capacity * 2;
+        Task* tasks = (Task*)malloc(sizeof(Task) * capacity);
+        for (uint32_t i = 0; i < deque->count; i++) {
+            tasks[i] = deque->tasks[(deque->head + i) % deque->capacity];
+        }
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->capacity = capacity;
+        deque->head = 0;
+    }
+    deque->tasks[(deque->head + deque->count) % deque->capacity] = task;
+    deque->count++;
+    mutexUnlock(&deque->mutex);
+}
+
+bool popTask(TaskDeque* deque, Task* task) {
+    bool found = false;
+    mutexLock(&deque->mutex);
+    if (deque->count > 0) {
+        deque->count--;
+        *task = deque->tasks[(deque->head + deque->count) % deque->capacity];
+        found = true;
+    }
+    mutexUnlock(&deque->mutex);
+    return found;
+}
+
+bool stealTask(TaskDeque* deque, Task* task) {
+    bool found = false;
+    mutexLock(&deque->mutex);
+    if (deque->count > 0) {
+        *task = deque->tasks[deque->head];
+        deque->head = (deque->head + 1) % deque->capacity;
+        deque->count--;
+        found = true;
+    }
+    mutexUnlock(&deque->mutex);
+    return found;
+}
+
+bool findTask(ThreadPool* pool, uint32_t workerIndex, Task* task) {
+    if (popTask(&pool->deques[workerIndex], task)) {
+        return true;
+    }
+    for (uint32_t i = 1; i < pool->workerCount; i++) {
+        if (stealTask(&pool->deques[(workerIndex + i) % pool->workerCount], task)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void workerMain(void* arg) {
+    Worker* worker = (Worker*)arg;
+    ThreadPool* pool = worker->pool;
+
+    while (true) {
+        Task task;
+        if (findTask(pool, worker->index, &task)) {
+            atomicAdd(&pool->queuedTasks, -1);
+            task.function(task.arg, worker->index);
+            if (atomicAdd(&pool->pendingTasks, -1) == 0) {
+                mutexLock(&pool->mutex);
+                conditionBroadcast(&pool->workDone);
+                mutexUnlock(&pool->mutex);
+            }
+            continue;
+        }
+
+        mutexLock(&pool->mutex);
+        while (atomicLoad(&pool->queuedTasks) == 0 && !pool->shuttingDown) {
+            conditionWait(&pool->workAvailable, &pool->mutex);
+        }
+        bool exit = pool->shuttingDown && atomicLoad(&pool->queuedTasks) == 0;
+        mutexUnlock(&pool->mutex);
+        if (exit) {
+            return;
+        }
+    }
+}
+
+void createThreadPool(ThreadPool* pool, uint32_t workerCount) {
+    memset(pool, 0, sizeof(ThreadPool));
+    pool->workerCount = workerCount > 0 ? workerCount : getProcessorCount();
+
+    mutexInit(&pool->mutex);
+    conditionInit(&pool->workAvailable);
+    conditionInit(&pool->workDone);
+
+    pool->deques = (TaskDeque*)malloc(sizeof(TaskDeque) * pool->workerCount);
+    for (uint32_t i = 0; i < pool->workerCount; i++) {
+        mutexInit(&pool->deques[i].mutex);
+        pool->deques[i].capacity = 64;
+        pool->deques[i].tasks = (Task*)malloc(sizeof(Task) * pool->deques[i].capacity);
+        pool->deques[i].head = 0;
+        pool->deques[i].count = 0;
+    }
+
+    pool->workers = (Worker*)malloc(sizeof(Worker) * pool->workerCount);
+    for (uint32_t i = 0; i < pool->workerCount; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        threadCreate(&pool->workers[i].thread, workerMain, &pool->workers[i]);
+    }
+}
+
+void destroyThreadPool(ThreadPool* pool) {
+    threadPoolWait(pool);
+
+    mutexLock(&pool->mutex);
+    pool->shuttingDown = true;
+    conditionBroadcast(&pool->workAvailable);
+    mutexUnlock(&pool->mutex);
+
+    for (uint32_t i = 0; i < pool->workerCount; i++) {
+        threadJoin(&pool->workers[i].thread);
+    }
+    for (uint32_t i = 0; i < pool->workerCount; i++) {
+        mutexDestroy(&pool->deques[i].mutex);
+        free(pool->deques[i].tasks);
+    }
+    free(pool->deques);
+    free(pool->workers);
+
+    conditionDestroy(&pool->workDone);
+    conditionDestroy(&pool->workAvailable);
+    mutexDestroy(&pool->mutex);
+}
+
+void wakeWorkers(ThreadPool* pool) {
+    // taking the lock orders the wakeup after a sleeping worker's last check of queuedTasks
+    mutexLock(&pool->mutex);
+    conditionBroadcast(&pool->workAvailable);
+    mutexUnlock(&pool->mutex);
+}
+
+void threadPoolSubmit(ThreadPool* pool, uint32_t workerIndex, TaskFunction function, void* arg) {
+    if (workerIndex == THREAD_POOL_ANY_WORKER) {
+        workerIndex = pool->nextDeque;
+        pool->nextDeque = (pool->nextDeque + 1) % pool->workerCount;
+    }
+
+    Task task = { function, arg };
+    atomicAdd(&pool->pendingTasks, 1);
+    atomicAdd(&pool->queuedTasks, 1);
+    pushTask(&pool->deques[workerIndex], task);
+
+    wakeWorkers(pool);
+}
+
+void threadPoolWait(ThreadPool* pool) {
+    mutexLock(&pool->mutex);
+    while (atomicLoad(&pool->pendingTasks) != 0) {
+        conditionWait(&pool->workDone, &pool->mutex);
+    }
+    mutexUnlock(&pool->mutex);
+}
+
+typedef struct RangeTask {
+    RangeFunction function;
+    void* arg;
+    uint32_t begin;
+    uint32_t end;
+} RangeTask;
+
+void runRangeTask(void* arg, uint32_t workerIndex) {
+    RangeTask* range = (RangeTask*)arg;
+    range->function(range->arg, range->begin, range->end, workerIndex);
+}
+
+void threadPoolParallelFor(ThreadPool* pool, uint32_t count, uint32_t blockSize, RangeFunction function, void* arg) {
+    if (count == 0) {
+        return;
+    }
+    uint32_t blockCount = (count + blockSize - 1) / blockSize;
+    RangeTask* ranges = (RangeTask*)malloc(sizeof(RangeTask) * blockCount);
+
+    for (uint32_t block = 0; block < blockCount; block++) {
+        ranges[block].function = function;
+        ranges[block].arg = arg;
+        ranges[block].begin = block * blockSize;
+        ranges[block].end = ranges[block].begin + blockSize < count ? ranges[block].begin + blockSize : count;
+    }
+
+    atomicAdd(&pool->pendingTasks, (int32_t)blockCount);
+    atomicAdd(&pool->queuedTasks, (int32_t)blockCount);
+
+    // worker w owns blocks [w * blockCount / workerCount, (w + 1) * blockCount / workerCount),
+    // pushed in reverse so it pops them front to back
+    for (uint32_t worker = 0; worker < pool->workerCount; worker++) {
+        uint32_t first = (uint32_t)((uint64_t)worker * blockCount / pool->workerCount);
+        uint32_t last = (uint32_t)((uint64_t)(worker + 1) * blockCount / pool->workerCount);
+        for (uint32_t block = last; block > first; block--) {
+            Task task = { runRangeTask, &ranges[block - 1] };
+            pushTask(&pool->deques[worker], task);
+        }
+    }
+    wakeWorkers(pool);
+
+    threadPoolWait(pool);
+    free(ranges);
+}
@@ -0,0 +1,69 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "platform.h"
+
+#define THREAD_POOL_ANY_WORKER UINT32_MAX
+
+typedef void (*TaskFunction)(void* arg, uint32_t workerIndex);
+typedef void (*RangeFunction)(void* arg, uint32_t begin, uint32_t end, uint32_t workerIndex);
+
+typedef struct Task {
+    TaskFunction function;
+    void* arg;
+} Task;
+
+// Ring buffer of tasks. The owning worker pushes and pops at the tail,
+// other workers steal from the head.
+typedef struct TaskDeque {
+    Mutex mutex;
+    Task* tasks;
+    uint32_t capacity;
+    uint32_t head;
+    uint32_t count;
+} TaskDeque;
+
+typedef struct ThreadPool ThreadPool;
+
+typedef struct Worker {
+    ThreadPool* pool;
+    uint32_t index;
+    Thread thread;
+} Worker;
+
+struct ThreadPool {
+    uint32_t workerCount;
+    Worker* workers;
+    TaskDeque* deques;
+    uint32_t nextDeque;
+
+    volatile int32_t queuedTasks;  // tasks sitting in a deque
+    volatile int32_t pendingTasks; // tasks submitted but not finished
+    bool shuttingDown;
+
+    Mutex mutex;
+    ConditionVariable workAvailable;
+    ConditionVariable workDone;
+};
+
+void pushTask(TaskDeque* deque, Task task);
+bool popTask(TaskDeque* deque, Task* task);
+bool stealTask(TaskDeque* deque, Task* task);
+bool findTask(ThreadPool* pool, uint32_t workerIndex, Task* task);
+void workerMain(void* arg);
+
+// workerCount 0 uses one worker per processor
+void createThreadPool(ThreadPool* pool, uint32_t workerCount);
+void destroyThreadPool(ThreadPool* pool);
+
+// Tasks submitted from a running task should pass its workerIndex so they land
+// in that worker's own deque.
+void threadPoolSubmit(ThreadPool* pool, uint32_t workerIndex, TaskFunction function, void* arg);
+void threadPoolWait(ThreadPool* pool);
+void wakeWorkers(ThreadPool* pool);
+
+// Splits [0, count) into blocks of blockSize, hands every worker a contiguous
+// run of blocks and lets idle workers steal the rest. Blocks until done.
+void threadPoolParallelFor(ThreadPool* pool, uint32_t count, uint32_t blockSize, RangeFunction function, void* arg);
+
+#endif
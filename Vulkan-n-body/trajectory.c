@@ -0,0 +1,211 @@
+#include "trajectory.h"
+#include "checkpoint.h"
+#include "trajectoryCodec.h"
+#include "vkinit.h"
+#include "vkTimeStep.h"
+#include "platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TRAJECTORY_FILE_BUFFER (8 * 1024 * 1024)
+
+// Every trajectoryInterval steps the newest particle buffer is copied on the compute queue into
+// the next slot of a ring of persistently mapped buffers. A writer thread appends the slots to
+// one file in order. When the disk falls behind and every slot is still queued the frame is
+// dropped rather than stalling the simulation.
+void createTrajectoryWriter(Context* context) {
+    TrajectoryWriter* trajectory = &context->trajectory;
+    VkDeviceSize bufferSize = sizeof(Particle) * context->PARTICLE_COUNT;
+    if (context->adaptiveTimeStep) {
+        bufferSize += sizeof(TimeStepState);
+    }
+
+    trajectory->file = fopen(context->trajectoryPath, "wb");
+    if (trajectory->file == NULL) {
+        printf("failed to open trajectory file %s!\n", context->trajectoryPath);
+        exit(1);
+    }
+    setvbuf(trajectory->file, NULL, _IOFBF, TRAJECTORY_FILE_BUFFER);
+
+    VkCommandBufferAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = context->computeCommandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+    VkFenceCreateInfo fenceInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO
+    };
+    VkMemoryPropertyFlags memoryProperties = readbackMemoryProperties(context->physicalDevice);
+
+    for (uint32_t i = 0; i < TRAJECTORY_RING_SIZE; i++) {
+        TrajectorySlot* slot = &trajectory->slots[i];
+        createBuffer(context,
+            bufferSize,
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            memoryProperties,
+            ALLOCATION_STRATEGY_LINEAR,
+            &slot->readbackBuffer,
+            &slot->readbackBufferAllocation);
+        slot->readbackBufferMapped = slot->readbackBufferAllocation.mapped;
+
+        VkResult result = vkAllocateCommandBuffers(context->device, &allocInfo, &slot->commandBuffer);
+        checkErr(result, "failed to allocate trajectory command buffer!");
+        result = vkCreateFence(context->device, &fenceInfo, NULL, &slot->copyFence);
+        checkErr(result, "failed to create trajectory fence!");
+    }
+
+    if (context->compressTrajectory) {
+        trajectory->encoder = (TrajectoryEncoder*)malloc(sizeof(TrajectoryEncoder));
+        createTrajectoryEncoder(trajectory->encoder, context->PARTICLE_COUNT, context->trajectoryTolerance, context->threadCount);
+    }
+
+    mutexInit(&trajectory->mutex);
+    conditionInit(&trajectory->condition);
+    trajectory->lastStep = context->stepIndex;
+    trajectory->startTime = getTime();
+    threadCreate(&trajectory->writerThread, trajectoryWriterMain, context);
+}
+
+// Drains the ring, then reports the write rate and dropped frames.
+void destroyTrajectoryWriter(Context* context) {
+    TrajectoryWriter* trajectory = &context->trajectory;
+
+    mutexLock(&trajectory->mutex);
+    trajectory->shuttingDown = true;
+    conditionBroadcast(&trajectory->condition);
+    mutexUnlock(&trajectory->mutex);
+    threadJoin(&trajectory->writerThread);
+
+    double writeStart = getTime();
+    fclose(trajectory->file);
+    trajectory->writeTime += getTime() - writeStart;
+
+    double elapsed = getTime() - trajectory->startTime;
+    double gigabytes = trajectory->bytesWritten / 1e9;
+    printf("Trajectory: %u frames, %.3lf GB to %s\t GB/s: %.3lf while writing, %.3lf sustained\t dropped: %u\n",
+        trajectory->framesWritten, gigabytes, context->trajectoryPath,
+        trajectory->writeTime > 0.0 ? gigabytes / trajectory->writeTime : 0.0,
+        elapsed > 0.0 ? gigabytes / elapsed : 0.0,
+        trajectory->framesDropped);
+    if (trajectory->encoder != NULL) {
+        TrajectoryEncoder* encoder = trajectory->encoder;
+        printf("  compression ratio %.2lf\t encode GB/s: %.3lf\t max error: position %.3e, velocity %.3e\n",
+            encoder->encodedBytes > 0 ? (double)encoder->rawBytes / encoder->encodedBytes : 0.0,
+            encoder->encodeTime > 0.0 ? encoder->rawBytes / 1e9 / encoder->encodeTime : 0.0,
+            encoder->maxError[0], encoder->maxError[1]);
+        destroyTrajectoryEncoder(encoder);
+        free(encoder);
+    }
+
+    for (uint32_t i = 0; i < TRAJECTORY_RING_SIZE; i++) {
+        TrajectorySlot* slot = &trajectory->slots[i];
+        vkDestroyFence(context->device, slot->copyFence, NULL);
+        vkFreeCommandBuffers(context->device, context->computeCommandPool, 1, &slot->commandBuffer);
+        destroyBuffer(context, slot->readbackBuffer, slot->readbackBufferAllocation);
+    }
+    conditionDestroy(&trajectory->condition);
+    mutexDestroy(&trajectory->mutex);
+}
+
+// Called after every compute submission, before the next one can overwrite the latest buffer.
+void updateTrajectory(Context* context) {
+    TrajectoryWriter* trajectory = &context->trajectory;
+    if (context->stepIndex / context->trajectoryInterval == trajectory->lastStep / context->trajectoryInterval) {
+        return;
+    }
+    trajectory->lastStep = context->stepIndex;
+
+    mutexLock(&trajectory->mutex);
+    bool full = trajectory->queued == TRAJECTORY_RING_SIZE;
+    mutexUnlock(&trajectory->mutex);
+    if (full) {
+        trajectory->framesDropped++;
+        return;
+    }
+
+    // the writer is done with the slot, its fence can be reused
+    TrajectorySlot* slot = &trajectory->slots[trajectory->head];
+    vkResetFences(context->device, 1, &slot->copyFence);
+
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    VkResult result = vkBeginCommandBuffer(slot->commandBuffer, &beginInfo);
+    checkErr(result, "failed to begin recording trajectory command buffer!");
+
+        recordParticleReadback(context, slot->commandBuffer, slot->readbackBuffer, false);
+        if (context->adaptiveTimeStep) {
+            recordTimeStepReadback(context, slot->commandBuffer, slot->readbackBuffer, sizeof(Particle) * context->PARTICLE_COUNT);
+        }
+
+    result = vkEndCommandBuffer(slot->commandBuffer);
+    checkErr(result, "failed to record trajectory command buffer!");
+
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &slot->commandBuffer
+    };
+    result = vkQueueSubmit(context->computeQueue, 1, &submitInfo, slot->copyFence);
+    checkErr(result, "failed to submit trajectory copy!");
+    slot->header = currentCheckpointHeader(context);
+
+    trajectory->head = (trajectory->head + 1) % TRAJECTORY_RING_SIZE;
+    mutexLock(&trajectory->mutex);
+    trajectory->queued++;
+    conditionBroadcast(&trajectory->condition);
+    mutexUnlock(&trajectory->mutex);
+}
+
+// Writes queued slots oldest first. Waiting on a slot's fence happens here, so the main
+// thread only ever checks whether a slot is free.
+void trajectoryWriterMain(void* arg) {
+    Context* context = (Context*)arg;
+    TrajectoryWriter* trajectory = &context->trajectory;
+    uint32_t tail = 0;
+
+    for (;;) {
+        mutexLock(&trajectory->mutex);
+        while (trajectory->queued == 0 && !trajectory->shuttingDown) {
+            conditionWait(&trajectory->condition, &trajectory->mutex);
+        }
+        bool done = trajectory->queued == 0;
+        mutexUnlock(&trajectory->mutex);
+        if (done) {
+            break;
+        }
+
+        TrajectorySlot* slot = &trajectory->slots[tail];
+        vkWaitForFences(context->device, 1, &slot->copyFence, VK_TRUE, UINT64_MAX);
+        readbackTimeStepState(context, &slot->header, slot->readbackBufferMapped);
+
+        double writeStart = getTime();
+        uint64_t frameBytes = 0;
+        if (trajectory->encoder != NULL) {
+            frameBytes = encodeTrajectoryFrame(trajectory->encoder, &slot->header, (const Particle*)slot->readbackBufferMapped, trajectory->file);
+        }
+        else {
+            size_t particleBytes = sizeof(Particle) * (size_t)context->PARTICLE_COUNT;
+            if (fwrite(&slot->header, sizeof(CheckpointHeader), 1, trajectory->file) == 1 &&
+                fwrite(slot->readbackBufferMapped, 1, particleBytes, trajectory->file) == particleBytes) {
+                frameBytes = sizeof(CheckpointHeader) + particleBytes;
+            }
+        }
+        trajectory->writeTime += getTime() - writeStart;
+        if (frameBytes > 0) {
+            trajectory->framesWritten++;
+            trajectory->bytesWritten += frameBytes;
+        }
+        else {
+            printf("failed to write trajectory frame at step %llu!\n", (unsigned long long)slot->header.step);
+        }
+        tail = (tail + 1) % TRAJECTORY_RING_SIZE;
+
+        mutexLock(&trajectory->mutex);
+        trajectory->queued--;
+        mutexUnlock(&trajectory->mutex);
+    }
+}
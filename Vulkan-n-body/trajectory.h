@@ -0,0 +1,12 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include "types.h"
+
+void createTrajectoryWriter(Context* context);
+void destroyTrajectoryWriter(Context* context);
+
+void updateTrajectory(Context* context);
+void trajectoryWriterMain(void* arg);
+
+#endif
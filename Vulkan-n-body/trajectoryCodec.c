@@ -0,0 +1,320 @@
+#include "trajectoryCodec.h"
+#include "platform.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert(sizeof(CompressedFrameHeader) == 40, "CompressedFrameHeader is part of the file format");
+
+// largest quantized delta, keeps the zigzag code within 32 bits
+#define QUANTIZED_DELTA_LIMIT 1073741824.0f
+
+void createTrajectoryEncoder(TrajectoryEncoder* encoder, uint32_t particleCount, float tolerance, uint32_t threadCount) {
+    memset(encoder, 0, sizeof(TrajectoryEncoder));
+    encoder->particleCount = particleCount;
+    encoder->chunkCount = (particleCount + TRAJECTORY_CHUNK_SIZE - 1) / TRAJECTORY_CHUNK_SIZE;
+    encoder->tolerance = tolerance;
+    encoder->reconstructed = (float*)malloc(sizeof(float) * TRAJECTORY_CHANNELS * particleCount);
+    encoder->zigzag = (uint32_t*)malloc(sizeof(uint32_t) * TRAJECTORY_CHUNK_SIZE * encoder->chunkCount);
+    encoder->chunks = (TrajectoryChunk*)calloc(encoder->chunkCount, sizeof(TrajectoryChunk));
+    // worst case is an escaped code for every value
+    for (uint32_t i = 0; i < encoder->chunkCount; i++) {
+        encoder->chunks[i].data = (uint8_t*)malloc(TRAJECTORY_CHANNELS * TRAJECTORY_CHUNK_SIZE * 8 + 8);
+    }
+    createThreadPool(&encoder->pool, threadCount);
+}
+
+void destroyTrajectoryEncoder(TrajectoryEncoder* encoder) {
+    destroyThreadPool(&encoder->pool);
+    for (uint32_t i = 0; i < encoder->chunkCount; i++) {
+        free(encoder->chunks[i].data);
+    }
+    free(encoder->chunks);
+    free(encoder->zigzag);
+    free(encoder->reconstructed);
+}
+
+float channelValue(const Particle* particle, uint32_t channel) {
+    switch (channel) {
+    case 0: return particle->pos.x;
+    case 1: return particle->pos.y;
+    case 2: return particle->vel.x;
+    default: return particle->vel.y;
+    }
+}
+
+uint64_t encodeTrajectoryFrame(TrajectoryEncoder* encoder, const CheckpointHeader* header, const Particle* particles, FILE* file) {
+    uint64_t particleBytes = (uint64_t)sizeof(Particle) * encoder->particleCount;
+    double encodeStart = getTime();
+
+    if (encoder->framesEncoded == 0) {
+        for (uint32_t i = 0; i < encoder->particleCount; i++) {
+            for (uint32_t channel = 0; channel < TRAJECTORY_CHANNELS; channel++) {
+                encoder->reconstructed[i * TRAJECTORY_CHANNELS + channel] = channelValue(&particles[i], channel);
+            }
+        }
+        encoder->encodeTime += getTime() - encodeStart;
+
+        if (fwrite(header, sizeof(CheckpointHeader), 1, file) != 1 || fwrite(particles, 1, (size_t)particleBytes, file) != particleBytes) {
+            return 0;
+        }
+        encoder->framesEncoded++;
+        encoder->rawBytes += particleBytes;
+        encoder->encodedBytes += sizeof(CheckpointHeader) + particleBytes;
+        return sizeof(CheckpointHeader) + particleBytes;
+    }
+
+    // the quantum follows the bounding box of the frame being encoded
+    encoder->particles = particles;
+    threadPoolParallelFor(&encoder->pool, encoder->chunkCount, 1, measureChunks, encoder);
+    for (uint32_t group = 0; group < 2; group++) {
+        float extent = 0.0f;
+        float magnitude = 0.0f;
+        for (uint32_t i = 0; i < encoder->chunkCount; i++) {
+            for (uint32_t channel = 2 * group; channel < 2 * group + 2; channel++) {
+                const float* bounds = encoder->chunks[i].bounds[channel];
+                extent = fmaxf(extent, bounds[1] - bounds[0]);
+                magnitude = fmaxf(magnitude, fmaxf(fabsf(bounds[0]), fabsf(bounds[1])));
+            }
+        }
+        // all values equal, fall back to their magnitude
+        float scale = extent > 0.0f ? extent : magnitude > 0.0f ? magnitude : 1.0f;
+        encoder->quantum[group] = encoder->tolerance * scale;
+    }
+    threadPoolParallelFor(&encoder->pool, encoder->chunkCount, 1, encodeChunks, encoder);
+
+    CompressedFrameHeader frameHeader = {
+        .magic = TRAJECTORY_FRAME_MAGIC,
+        .chunkCount = encoder->chunkCount,
+        .step = header->step,
+        .time = header->time,
+        .quantum = { encoder->quantum[0], encoder->quantum[1] }
+    };
+    uint32_t* chunkSizes = (uint32_t*)malloc(sizeof(uint32_t) * encoder->chunkCount);
+    for (uint32_t i = 0; i < encoder->chunkCount; i++) {
+        chunkSizes[i] = encoder->chunks[i].size;
+        frameHeader.payloadSize += chunkSizes[i];
+        for (uint32_t group = 0; group < 2; group++) {
+            encoder->maxError[group] = fmaxf(encoder->maxError[group], encoder->chunks[i].maxError[group]);
+        }
+    }
+    encoder->encodeTime += getTime() - encodeStart;
+
+    bool success = fwrite(&frameHeader, sizeof(CompressedFrameHeader), 1, file) == 1 &&
+        fwrite(chunkSizes, sizeof(uint32_t), encoder->chunkCount, file) == encoder->chunkCount;
+    for (uint32_t i = 0; i < encoder->chunkCount && success; i++) {
+        success = fwrite(encoder->chunks[i].data, 1, chunkSizes[i], file) == chunkSizes[i];
+    }
+    free(chunkSizes);
+    if (!success) {
+        return 0;
+    }
+
+    uint64_t frameBytes = sizeof(CompressedFrameHeader) + sizeof(uint32_t) * encoder->chunkCount + frameHeader.payloadSize;
+    encoder->framesEncoded++;
+    encoder->rawBytes += particleBytes;
+    encoder->encodedBytes += frameBytes;
+    return frameBytes;
+}
+
+void measureChunks(void* arg, uint32_t begin, uint32_t end, uint32_t workerIndex) {
+    TrajectoryEncoder* encoder = (TrajectoryEncoder*)arg;
+    for (uint32_t chunkIndex = begin; chunkIndex < end; chunkIndex++) {
+        TrajectoryChunk* chunk = &encoder->chunks[chunkIndex];
+        uint32_t first = chunkIndex * TRAJECTORY_CHUNK_SIZE;
+        uint32_t last = first + TRAJECTORY_CHUNK_SIZE < encoder->particleCount ? first + TRAJECTORY_CHUNK_SIZE : encoder->particleCount;
+
+        for (uint32_t channel = 0; channel < TRAJECTORY_CHANNELS; channel++) {
+            chunk->bounds[channel][0] = INFINITY;
+            chunk->bounds[channel][1] = -INFINITY;
+        }
+        for (uint32_t i = first; i < last; i++) {
+            for (uint32_t channel = 0; channel < TRAJECTORY_CHANNELS; channel++) {
+                float value = channelValue(&encoder->particles[i], channel);
+                chunk->bounds[channel][0] = fminf(chunk->bounds[channel][0], value);
+                chunk->bounds[channel][1] = fmaxf(chunk->bounds[channel][1], value);
+            }
+        }
+    }
+}
+
+// Quantizes against the reconstruction rather than the previous exact values, so the
+// error stays within half a quantum instead of accumulating over frames.
+void encodeChunks(void* arg, uint32_t begin, uint32_t end, uint32_t workerIndex) {
+    TrajectoryEncoder* encoder = (TrajectoryEncoder*)arg;
+    for (uint32_t chunkIndex = begin; chunkIndex < end; chunkIndex++) {
+        TrajectoryChunk* chunk = &encoder->chunks[chunkIndex];
+        uint32_t first = chunkIndex * TRAJECTORY_CHUNK_SIZE;
+        uint32_t count = encoder->particleCount - first < TRAJECTORY_CHUNK_SIZE ? encoder->particleCount - first : TRAJECTORY_CHUNK_SIZE;
+        uint32_t* values = encoder->zigzag + first;
+        BitWriter writer = { .data = chunk->data };
+        chunk->maxError[0] = 0.0f;
+        chunk->maxError[1] = 0.0f;
+
+        for (uint32_t channel = 0; channel < TRAJECTORY_CHANNELS; channel++) {
+            uint32_t group = channel / 2;
+            float quantum = encoder->quantum[group];
+            for (uint32_t j = 0; j < count; j++) {
+                float value = channelValue(&encoder->particles[first + j], channel);
+                float* reconstructed = &encoder->reconstructed[(first + j) * TRAJECTORY_CHANNELS + channel];
+
+                float delta = (value - *reconstructed) / quantum;
+                if (!(delta >= -QUANTIZED_DELTA_LIMIT)) {
+                    delta = -QUANTIZED_DELTA_LIMIT;
+                }
+                if (delta > QUANTIZED_DELTA_LIMIT) {
+                    delta = QUANTIZED_DELTA_LIMIT;
+                }
+                int32_t quantized = (int32_t)lrintf(delta);
+                *reconstructed = *reconstructed + (float)quantized * quantum;
+                chunk->maxError[group] = fmaxf(chunk->maxError[group], fabsf(value - *reconstructed));
+
+                values[j] = quantized < 0 ? ((uint32_t)(-quantized) << 1) - 1 : (uint32_t)quantized << 1;
+            }
+
+            uint32_t k = riceParameter(values, count);
+            writeBits(&writer, k, 5);
+            for (uint32_t j = 0; j < count; j++) {
+                writeRice(&writer, values[j], k);
+            }
+        }
+        flushBits(&writer);
+        chunk->size = writer.size;
+    }
+}
+
+void createTrajectoryDecoder(TrajectoryDecoder* decoder, const Particle* keyframe, uint32_t particleCount) {
+    decoder->particleCount = particleCount;
+    decoder->reconstructed = (float*)malloc(sizeof(float) * TRAJECTORY_CHANNELS * particleCount);
+    for (uint32_t i = 0; i < particleCount; i++) {
+        for (uint32_t channel = 0; channel < TRAJECTORY_CHANNELS; channel++) {
+            decoder->reconstructed[i * TRAJECTORY_CHANNELS + channel] = channelValue(&keyframe[i], channel);
+        }
+    }
+}
+
+void destroyTrajectoryDecoder(TrajectoryDecoder* decoder) {
+    free(decoder->reconstructed);
+}
+
+bool decodeTrajectoryFrame(TrajectoryDecoder* decoder, FILE* file, CompressedFrameHeader* header, Particle* particles) {
+    uint32_t chunkCount = (decoder->particleCount + TRAJECTORY_CHUNK_SIZE - 1) / TRAJECTORY_CHUNK_SIZE;
+    if (fread(header, sizeof(CompressedFrameHeader), 1, file) != 1 || header->magic != TRAJECTORY_FRAME_MAGIC || header->chunkCount != chunkCount) {
+        return false;
+    }
+
+    uint32_t* chunkSizes = (uint32_t*)malloc(sizeof(uint32_t) * chunkCount);
+    uint8_t* payload = (uint8_t*)malloc((size_t)header->payloadSize);
+    bool success = fread(chunkSizes, sizeof(uint32_t), chunkCount, file) == chunkCount &&
+        fread(payload, 1, (size_t)header->payloadSize, file) == header->payloadSize;
+
+    uint64_t offset = 0;
+    for (uint32_t chunkIndex = 0; chunkIndex < chunkCount && success; chunkIndex++) {
+        if (offset + chunkSizes[chunkIndex] > header->payloadSize) {
+            success = false;
+            break;
+        }
+        BitReader reader = { .data = payload + offset, .size = chunkSizes[chunkIndex] };
+        offset += chunkSizes[chunkIndex];
+
+        uint32_t first = chunkIndex * TRAJECTORY_CHUNK_SIZE;
+        uint32_t count = decoder->particleCount - first < TRAJECTORY_CHUNK_SIZE ? decoder->particleCount - first : TRAJECTORY_CHUNK_SIZE;
+        for (uint32_t channel = 0; channel < TRAJECTORY_CHANNELS; channel++) {
+            float quantum = header->quantum[channel / 2];
+            uint32_t k = readBits(&reader, 5);
+            for (uint32_t j = 0; j < count; j++) {
+                uint32_t value = readRice(&reader, k);
+                int32_t quantized = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+                float* reconstructed = &decoder->reconstructed[(first + j) * TRAJECTORY_CHANNELS + channel];
+                *reconstructed = *reconstructed + (float)quantized * quantum;
+            }
+        }
+    }
+    free(payload);
+    free(chunkSizes);
+    if (!success) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < decoder->particleCount; i++) {
+        const float* reconstructed = &decoder->reconstructed[i * TRAJECTORY_CHANNELS];
+        particles[i].pos.x = reconstructed[0];
+        particles[i].pos.y = reconstructed[1];
+        particles[i].vel.x = reconstructed[2];
+        particles[i].vel.y = reconstructed[3];
+    }
+    return true;
+}
+
+// count <= 32, bits are packed least significant first
+void writeBits(BitWriter* writer, uint32_t value, uint32_t count) {
+    uint32_t mask = count == 32 ? UINT32_MAX : (1u << count) - 1;
+    writer->buffer |= (uint64_t)(value & mask) << writer->bits;
+    writer->bits += count;
+    while (writer->bits >= 8) {
+        writer->data[writer->size++] = (uint8_t)writer->buffer;
+        writer->buffer >>= 8;
+        writer->bits -= 8;
+    }
+}
+
+void flushBits(BitWriter* writer) {
+    if (writer->bits > 0) {
+        writer->data[writer->size++] = (uint8_t)writer->buffer;
+        writer->buffer = 0;
+        writer->bits = 0;
+    }
+}
+
+// Quotient in unary (ones terminated by a zero), then the k low bits
+void writeRice(BitWriter* writer, uint32_t value, uint32_t k) {
+    uint32_t quotient = value >> k;
+    if (quotient >= RICE_ESCAPE) {
+        writeBits(writer, UINT32_MAX, RICE_ESCAPE);
+        writeBits(writer, value, 32);
+        return;
+    }
+    writeBits(writer, (1u << quotient) - 1, quotient + 1);
+    if (k > 0) {
+        writeBits(writer, value, k);
+    }
+}
+
+// Reads past the end return zeros, callers check sizes instead
+uint32_t readBits(BitReader* reader, uint32_t count) {
+    while (reader->bits < count) {
+        uint64_t byte = reader->position < reader->size ? reader->data[reader->position++] : 0;
+        reader->buffer |= byte << reader->bits;
+        reader->bits += 8;
+    }
+    uint32_t mask = count == 32 ? UINT32_MAX : (1u << count) - 1;
+    uint32_t value = (uint32_t)reader->buffer & mask;
+    reader->buffer >>= count;
+    reader->bits -= count;
+    return value;
+}
+
+uint32_t readRice(BitReader* reader, uint32_t k) {
+    uint32_t quotient = 0;
+    while (quotient < RICE_ESCAPE && readBits(reader, 1) == 1) {
+        quotient++;
+    }
+    if (quotient == RICE_ESCAPE) {
+        return readBits(reader, 32);
+    }
+    return (quotient << k) | readBits(reader, k);
+}
+
+// k close to log2 of the mean keeps the expected code length near minimal
+uint32_t riceParameter(const uint32_t* values, uint32_t count) {
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        sum += values[i];
+    }
+    uint32_t k = 0;
+    while (k < 31 && ((uint64_t)count << (k + 1)) <= sum) {
+        k++;
+    }
+    return k;
+}
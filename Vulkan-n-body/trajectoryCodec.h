@@ -0,0 +1,92 @@
+#ifndef TRAJECTORYCODEC_H
+#define TRAJECTORYCODEC_H
+
+#include "types.h"
+#include "threadPool.h"
+
+// Compressed trajectory: the first frame is a full precision checkpoint record, which also
+// carries mass and colour. Every later frame stores positions and velocities as quantized
+// deltas against what a decoder reconstructed for the previous frame, Rice coded in
+// independent chunks of TRAJECTORY_CHUNK_SIZE particles.
+
+#define TRAJECTORY_FRAME_MAGIC 0x434a5254
+#define TRAJECTORY_CHUNK_SIZE 4096
+#define TRAJECTORY_CHANNELS 4     // pos.x, pos.y, vel.x, vel.y
+#define RICE_ESCAPE 32            // quotients this large are stored as 32 raw bits
+
+typedef struct CompressedFrameHeader {
+    uint32_t magic;
+    uint32_t chunkCount;
+    uint64_t step;
+    double time;
+    float quantum[2];     // quantization step of positions and velocities
+    uint64_t payloadSize; // bytes after the chunk size table
+} CompressedFrameHeader;
+
+typedef struct BitWriter {
+    uint8_t* data;
+    uint64_t buffer;
+    uint32_t bits;
+    uint32_t size;
+} BitWriter;
+
+typedef struct BitReader {
+    const uint8_t* data;
+    uint64_t buffer;
+    uint32_t bits;
+    uint32_t position;
+    uint32_t size;
+} BitReader;
+
+typedef struct TrajectoryChunk {
+    uint8_t* data;
+    uint32_t size;
+    float bounds[TRAJECTORY_CHANNELS][2]; // min and max of every channel
+    float maxError[2];                    // positions, velocities
+} TrajectoryChunk;
+
+struct TrajectoryEncoder {
+    ThreadPool pool;
+    uint32_t particleCount;
+    uint32_t chunkCount;
+    float tolerance;        // quantum relative to the frame's bounding box extent
+    float* reconstructed;   // TRAJECTORY_CHANNELS per particle, the decoder's state after the last frame
+    uint32_t* zigzag;       // TRAJECTORY_CHUNK_SIZE per chunk, scratch for the quantized deltas
+    TrajectoryChunk* chunks;
+    const Particle* particles;
+    float quantum[2];
+    uint64_t framesEncoded;
+
+    uint64_t rawBytes;
+    uint64_t encodedBytes;
+    double encodeTime;
+    float maxError[2];
+};
+
+typedef struct TrajectoryDecoder {
+    uint32_t particleCount;
+    float* reconstructed;
+} TrajectoryDecoder;
+
+void createTrajectoryEncoder(TrajectoryEncoder* encoder, uint32_t particleCount, float tolerance, uint32_t threadCount);
+void destroyTrajectoryEncoder(TrajectoryEncoder* encoder);
+// Returns the number of bytes written, 0 on failure
+uint64_t encodeTrajectoryFrame(TrajectoryEncoder* encoder, const CheckpointHeader* header, const Particle* particles, FILE* file);
+void measureChunks(void* arg, uint32_t begin, uint32_t end, uint32_t workerIndex);
+void encodeChunks(void* arg, uint32_t begin, uint32_t end, uint32_t workerIndex);
+float channelValue(const Particle* particle, uint32_t channel);
+
+void createTrajectoryDecoder(TrajectoryDecoder* decoder, const Particle* keyframe, uint32_t particleCount);
+void destroyTrajectoryDecoder(TrajectoryDecoder* decoder);
+// Reads one compressed frame, overwriting the positions and velocities in particles.
+// particles must hold the previous frame. Returns false on a malformed frame.
+bool decodeTrajectoryFrame(TrajectoryDecoder* decoder, FILE* file, CompressedFrameHeader* header, Particle* particles);
+
+void writeBits(BitWriter* writer, uint32_t value, uint32_t count);
+void flushBits(BitWriter* writer);
+void writeRice(BitWriter* writer, uint32_t value, uint32_t k);
+uint32_t readBits(BitReader* reader, uint32_t count);
+uint32_t readRice(BitReader* reader, uint32_t k);
+uint32_t riceParameter(const uint32_t* values, uint32_t count);
+
+#endif
@@ -2,6 +2,9 @@
 #define TYPES_H
 
 #include <stdbool.h>
+#include <stdio.h>
+
+#include "platform.h"
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
@@ -20,12 +23,443 @@ typedef struct {
     float x, y, z;
 } vec3;
 
-typedef struct {
-    vec2 pos;
-    vec2 vel;
-    float mss;
-    vec3 col;
-} Particle;
+// CPU side complex numbers of the particle-mesh FFT and the multipole expansions
+typedef struct Complex {
+    double re;
+    double im;
+} Complex;
+
+#include "particleLayout.h"
+
+typedef enum SimulationBackend {
+    BACKEND_VULKAN, // compute shaders, rendered in a window
+    BACKEND_CPU     // native threads, no window or Vulkan device
+} SimulationBackend;
+
+typedef enum CpuKernel {
+    CPU_KERNEL_SCALAR, // array-of-structs loop over Particle
+    CPU_KERNEL_SIMD,   // structure-of-arrays, widest instruction set found at runtime
+    CPU_KERNEL_FMM     // fast multipole method over a quadtree, see fmm.c
+} CpuKernel;
+
+typedef enum ComputeKernel {
+    COMPUTE_KERNEL_REFERENCE, // every invocation reads every particle from the SSBO
+    COMPUTE_KERNEL_TILED,     // particles are staged through workgroup shared memory
+    COMPUTE_KERNEL_BARNES_HUT, // quadtree approximation, see vkBarnesHut.c
+    COMPUTE_KERNEL_BLOCK_STEPS, // direct forces for the particles due a step on their own power of two time step, see vkBlockSteps.c
+    COMPUTE_KERNEL_PARTICLE_MESH // cloud-in-cell mesh with an FFT convolution, see vkParticleMesh.c
+} ComputeKernel;
+
+typedef enum InitialConditions {
+    INITIAL_CONDITIONS_UNIFORM,  // random positions, velocities and signed masses in [-1, 1]
+    INITIAL_CONDITIONS_CLUSTERED // Plummer spheres of positive mass, the dense cores need small time steps
+} InitialConditions;
+
+// Specialization constants of shader.comp and shader_tiled.comp, see vkAutotune.c
+typedef struct ComputeTuning {
+    uint32_t workgroupSize;
+    uint32_t tileSize; // particles staged per tile, a multiple of workgroupSize and unroll
+    uint32_t unroll;   // inner loop iterations unrolled per tile
+} ComputeTuning;
+
+// Time integration of the direct kernels, Barnes-Hut and the CPU backend only have Euler
+typedef enum Integrator {
+    INTEGRATOR_EULER,    // v += a * dt, then x += v, the position update isn't scaled by dt
+    INTEGRATOR_LEAPFROG, // kick-drift-kick, second order, one force evaluation per step, tiled kernel only
+    INTEGRATOR_YOSHIDA   // three leapfrog substeps, fourth order, three force evaluations per step
+} Integrator;
+
+// Fraction of the time step covered by one leapfrog substep, 0 only computes the accelerations
+typedef struct IntegratorPushConstants {
+    float stepScale;
+} IntegratorPushConstants;
+
+#define ALLOCATOR_BLOCK_SIZE (64ull * 1024 * 1024)
+
+typedef enum AllocationStrategy {
+    ALLOCATION_STRATEGY_LINEAR,   // bump pointer, for buffers that live until shutdown
+    ALLOCATION_STRATEGY_FREE_LIST // first fit, freed ranges are merged with their neighbours
+} AllocationStrategy;
+
+typedef struct MemoryRange {
+    VkDeviceSize offset;
+    VkDeviceSize size;
+} MemoryRange;
+
+// One vkAllocateMemory, shared by every buffer placed in it
+typedef struct MemoryBlock {
+    VkDeviceMemory memory;    // VK_NULL_HANDLE once an oversized block is released
+    VkDeviceSize size;
+    uint32_t memoryTypeIndex;
+    AllocationStrategy strategy;
+    uint8_t* mapped;          // persistently mapped if host visible, NULL otherwise
+    VkDeviceSize linearOffset;
+    MemoryRange* freeRanges;  // sorted by offset, free list blocks only
+    uint32_t freeRangeCount;
+    uint32_t freeRangeCapacity;
+    uint32_t allocationCount;
+    VkDeviceSize usedBytes;
+} MemoryBlock;
+
+typedef struct Allocation {
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    void* mapped;   // NULL unless the memory is host visible
+    uint32_t block; // index into GpuAllocator.blocks
+} Allocation;
+
+typedef struct GpuAllocator {
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    uint32_t maxMemoryAllocationCount;
+    MemoryBlock* blocks;
+    uint32_t blockCount;
+    uint32_t deviceMemoryCount; // live vkAllocateMemory calls
+    uint32_t allocationCount;
+    VkDeviceSize reservedBytes;
+    VkDeviceSize usedBytes;
+    VkDeviceSize peakUsedBytes;
+} GpuAllocator;
+
+typedef enum BarnesHutPass {
+    BH_PASS_BOUNDS,
+    BH_PASS_MORTON,
+    BH_PASS_SORT_COUNT,
+    BH_PASS_SORT_SCAN,
+    BH_PASS_SORT_SCATTER,
+    BH_PASS_LEAVES,
+    BH_PASS_UPSWEEP,
+    BH_PASS_FORCE,
+    BH_PASS_COUNT
+} BarnesHutPass;
+
+typedef struct BarnesHutPushConstants {
+    uint32_t particleCount;
+    uint32_t shift;
+    uint32_t level;
+    uint32_t keysIn;
+    uint32_t keysOut;
+    float theta;
+} BarnesHutPushConstants;
+
+typedef struct BarnesHut {
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline pipelines[BH_PASS_COUNT];
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet* descriptorSets;
+
+    VkBuffer keyBuffer;
+    Allocation keyBufferAllocation;
+    VkBuffer digitCountBuffer;
+    Allocation digitCountBufferAllocation;
+    VkBuffer leafRangeBuffer;
+    Allocation leafRangeBufferAllocation;
+    VkBuffer nodeBuffer;
+    Allocation nodeBufferAllocation;
+    VkBuffer boundsBuffer;
+    Allocation boundsBufferAllocation;
+} BarnesHut;
+
+typedef enum BlockStepPass {
+    BLOCK_PASS_DRIFT,    // drifts every particle, appends the active ones to the index list
+    BLOCK_PASS_DISPATCH, // turns the active count into the indirect dispatch of the force pass
+    BLOCK_PASS_FORCE,    // forces, kicks and new levels of the active particles
+    BLOCK_PASS_COUNT
+} BlockStepPass;
+
+typedef struct BlockStepPushConstants {
+    uint32_t particleCount;
+    uint32_t levelCount;
+    uint32_t tick;  // finest substeps since the start of the step, 0 = initialization
+    float accuracy;
+} BlockStepPushConstants;
+
+// Mirrors the state buffer in shaders/block_common.glsl, the first three words are the
+// VkDispatchIndirectCommand of the force pass. The counters are 64 bit, low word first.
+typedef struct BlockStepState {
+    uint32_t dispatch[3];
+    uint32_t activeCount;
+    uint32_t appendCount;
+    uint32_t deepestLevel;
+    uint32_t evaluations[2];       // particle force evaluations so far
+    uint32_t globalEvaluations[2]; // the same with every particle on the smallest step in use
+} BlockStepState;
+
+typedef struct BlockSteps {
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline pipelines[BLOCK_PASS_COUNT];
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet* descriptorSets; // two per frame slot: previous buffer -> slot, slot -> slot
+
+    VkBuffer levelBuffer;
+    Allocation levelBufferAllocation;
+    VkBuffer activeIndexBuffer;
+    Allocation activeIndexBufferAllocation;
+    VkBuffer stateBuffer;
+    Allocation stateBufferAllocation;
+} BlockSteps;
+
+typedef enum ParticleMeshPass {
+    PM_PASS_BOUNDS,      // min and max of the particle positions, one atomic per workgroup
+    PM_PASS_PLACE,       // places the mesh, around all particles unless it is periodic
+    PM_PASS_KERNEL,      // the force law at every cell offset
+    PM_PASS_DEPOSIT,     // cloud-in-cell masses, 64 or 32 bit fixed point integer atomics
+    PM_PASS_LOAD,        // fixed point masses to a complex grid, clears them for the next step
+    PM_PASS_FFT,         // radix-2 FFT of every row or every column of a complex grid
+    PM_PASS_MULTIPLY,    // mass spectrum times kernel spectrum
+    PM_PASS_INTERPOLATE, // cloud-in-cell accelerations and the usual integration
+    PM_PASS_COUNT
+} ParticleMeshPass;
+
+typedef struct ParticleMeshPushConstants {
+    uint32_t particleCount;
+    uint32_t gridSize;      // mesh cells per side
+    uint32_t fftSize;       // FFT grid cells per side, twice gridSize unless periodic
+    uint32_t logFftSize;
+    uint32_t periodic;
+    float boxSize;          // a periodic mesh covers [-boxSize, boxSize)
+    float massScale;        // fixed point units per unit of mass in the deposit grid
+    uint32_t gridOffset;    // FFT: first element of the complex grid
+    uint32_t sampleStride;  // FFT: elements between the samples of a line
+    uint32_t lineStride;    // FFT: elements between lines
+    float direction;        // FFT: -1 forward, 1 inverse
+} ParticleMeshPushConstants;
+
+typedef struct ParticleMesh {
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline pipelines[PM_PASS_COUNT];
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet* descriptorSets;
+
+    VkBuffer depositBuffer;     // fixed point mass per FFT grid cell
+    Allocation depositBufferAllocation;
+    VkBuffer gridBuffer;        // two complex FFT grids: masses, then accelerations, and the kernel spectrum
+    Allocation gridBufferAllocation;
+    VkBuffer boundsBuffer;      // lower corner and cell size, then the particles' extent
+    Allocation boundsBufferAllocation;
+
+    float massScale;
+} ParticleMesh;
+
+typedef enum TimeStepPass {
+    TIME_STEP_PASS_REDUCE, // largest acceleration and speed of the step's particles
+    TIME_STEP_PASS_UPDATE, // advances the time and picks the next step from them
+    TIME_STEP_PASS_COUNT
+} TimeStepPass;
+
+typedef struct TimeStepPushConstants {
+    uint32_t particleCount;
+    uint32_t advance;       // 0 picks the first step without advancing the time
+    float accuracy;
+    float minTimeStep;
+    float maxTimeStep;
+} TimeStepPushConstants;
+
+// Mirrors the state buffer in shaders/time_step_common.glsl. deltaTime comes first so
+// the buffer also serves as the compute kernels' uniform buffer. The maxima are float
+// bits, which order like unsigned integers for non-negative values.
+typedef struct TimeStepState {
+    float deltaTime;
+    uint32_t maxAcceleration2;  // squared
+    uint32_t maxSpeed2;         // squared
+    float time;                 // simulated time is time + timeLow
+    float timeLow;
+    float smallestTimeStep;     // range of the steps picked so far
+    float largestTimeStep;
+    uint32_t reserved;
+} TimeStepState;
+
+typedef struct TimeStepControl {
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline pipelines[TIME_STEP_PASS_COUNT];
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet* descriptorSets; // one per frame slot, reads the slot's particles and accelerations
+
+    VkBuffer stateBuffer;
+    Allocation stateBufferAllocation;
+} TimeStepControl;
+
+typedef enum RenderMode {
+    RENDER_MODE_POINTS,  // one point per particle
+    RENDER_MODE_DENSITY  // particles counted per pixel by a compute pass, then tone mapped
+} RenderMode;
+
+typedef struct DensityPushConstants {
+    uint32_t width;
+    uint32_t height;
+    uint32_t particleCount;
+    float exposure;
+} DensityPushConstants;
+
+typedef struct DensitySplat {
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline splatPipeline;
+    VkPipeline toneMapPipeline;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet* descriptorSets; // frame slot * MAX_FRAMES_IN_FLIGHT + particle buffer
+
+    VkBuffer* buffers;               // one uint per pixel for every frame slot
+    Allocation* bufferAllocations;
+    uint32_t width;
+    uint32_t height;
+} DensitySplat;
+
+// Vertex written by shaders/render_pack.comp, position as two halves and RGBA8 colour
+typedef struct RenderVertex {
+    uint32_t pos;
+    uint32_t col;
+} RenderVertex;
+
+typedef struct RenderStreamPushConstants {
+    uint32_t particleCount;
+    uint32_t stride;
+} RenderStreamPushConstants;
+
+typedef struct RenderStream {
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline pipeline;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet* descriptorSets; // set i packs shaderStorageBuffers[i] into buffers[i]
+
+    VkBuffer* buffers;
+    Allocation* bufferAllocations;
+    uint32_t vertexCount;
+} RenderStream;
+
+// Draw copies handed from the compute to the graphics family, see vkOwnership.c
+typedef struct QueueOwnership {
+    bool transfers;                 // windowed, with distinct compute and graphics families
+    VkBuffer* drawCopies;           // one per storage buffer, unless the render stream is drawn
+    Allocation* drawCopyAllocations;
+} QueueOwnership;
+
+#define PROFILER_WINDOW 512
+
+typedef enum ProfilerStage {
+    PROFILER_STAGE_COMPUTE,
+    PROFILER_STAGE_RENDER,
+    PROFILER_STAGE_COUNT
+} ProfilerStage;
+
+// The last PROFILER_WINDOW samples of one metric, in milliseconds
+typedef struct RollingStats {
+    double samples[PROFILER_WINDOW];
+    uint32_t count;
+    uint32_t next;
+} RollingStats;
+
+typedef struct Profiler {
+    VkQueryPool queryPools[PROFILER_STAGE_COUNT]; // begin and end timestamp per frame slot, VK_NULL_HANDLE if the queue has no timestamps
+    uint64_t timestampMask[PROFILER_STAGE_COUNT];
+    bool* pending[PROFILER_STAGE_COUNT];          // per frame slot: submitted, not read back yet
+    float timestampPeriod;                        // nanoseconds per timestamp tick
+
+    RollingStats gpuTime[PROFILER_STAGE_COUNT];
+    RollingStats recordSubmitTime;
+    RollingStats frameTime;
+
+    double printTime;
+    uint64_t printStep;
+} Profiler;
+
+#define CHECKPOINT_MAGIC 0x4b43424e // "NBCK"
+#define CHECKPOINT_VERSION 1
+
+// Followed by particleCount raw Particles, and as many again with previousState
+typedef struct CheckpointHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t layoutVersion;
+    uint32_t particleSize;
+    uint64_t particleCount;
+    uint64_t step;
+    double time;
+    float timeStep;
+    uint32_t integrator; // 0 (Euler) in checkpoints written before it was stored
+    uint32_t previousState; // 1 when the state one step earlier follows, which an Euler step reads too
+    uint32_t reserved[3];
+} CheckpointHeader;
+
+// A restart file mapped for the upload, see mapCheckpoint
+typedef struct CheckpointView {
+    void* file;
+    uint64_t fileSize;
+    const Particle* particles;
+    const Particle* previousParticles; // NULL without previousState
+} CheckpointView;
+
+typedef struct CheckpointWriter {
+    VkBuffer readbackBuffer;
+    Allocation readbackBufferAllocation;
+    void* readbackBufferMapped;
+    VkCommandBuffer commandBuffer;
+    VkFence copyFence;
+    bool copyPending;    // GPU copy submitted, not written to disk yet
+    bool writing;        // writerThread owns readbackBufferMapped
+    Thread writerThread;
+    CheckpointHeader header;
+    uint64_t lastStep;
+} CheckpointWriter;
+
+#define TRAJECTORY_RING_SIZE 3
+
+// defined in trajectoryCodec.h
+typedef struct TrajectoryEncoder TrajectoryEncoder;
+
+// A trajectory file is a sequence of checkpoint records, any frame can be restarted from
+typedef struct TrajectorySlot {
+    VkBuffer readbackBuffer;
+    Allocation readbackBufferAllocation;
+    void* readbackBufferMapped;
+    VkCommandBuffer commandBuffer;
+    VkFence copyFence;
+    CheckpointHeader header;
+} TrajectorySlot;
+
+typedef struct TrajectoryWriter {
+    TrajectorySlot slots[TRAJECTORY_RING_SIZE];
+    uint32_t head;           // next slot to copy into, main thread only
+    uint32_t queued;         // slots copied or being copied but not on disk yet, guarded by mutex
+    bool shuttingDown;
+    Mutex mutex;
+    ConditionVariable condition;
+    Thread writerThread;
+    FILE* file;
+    TrajectoryEncoder* encoder; // NULL writes raw frames
+    uint64_t lastStep;
+    uint32_t framesWritten;
+    uint32_t framesDropped;  // the ring was full when the frame was due
+    uint64_t bytesWritten;
+    double writeTime;        // seconds the writer thread spent encoding and writing
+    double startTime;
+} TrajectoryWriter;
+
+#define STAGING_RING_SIZE (32ull * 1024 * 1024)
+#define STAGING_RING_SEGMENTS 4
+
+// A quarter of the staging ring. Copies are recorded while the segment is filled and
+// submitted together once it is full or flushed.
+typedef struct StagingSegment {
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+    VkDeviceSize used;
+    bool recording;
+    bool submitted; // fence signals once the copies are done
+} StagingSegment;
+
+typedef struct StagingRing {
+    VkBuffer buffer;
+    Allocation allocation; // persistently mapped
+    VkCommandPool commandPool;
+    StagingSegment segments[STAGING_RING_SEGMENTS];
+    uint32_t current;
+} StagingRing;
 
 typedef struct SwapChainSupportDetails {
     VkSurfaceCapabilitiesKHR capabilities;
@@ -42,10 +476,19 @@ typedef struct UniformBufferObject {
 typedef struct QueueFamilyIndices {
     uint32_t graphicsFamily; // includes ComputeFamily
     bool HasGraphicsFamily;
+    uint32_t computeFamily; // used on its own in headless mode
+    bool HasComputeFamily;
     uint32_t presentFamily;
     bool HasPresentFamily;
+    uint32_t transferFamily; // copy only family if there is one, otherwise the compute family
+    bool HasTransferFamily;
 } QueueFamilyIndices;
 
+typedef struct Context Context;
+
+// Receives a copy of the particles read back from the GPU, see readbackParticles.
+typedef void (*SnapshotCallback)(Context* context, const Particle* particles, uint64_t step);
+
 typedef struct Context {
     GLFWwindow* window;
     const char* WIN_NAME;
@@ -53,6 +496,7 @@ typedef struct Context {
     VkDebugUtilsMessengerEXT debugMessenger;
     VkSurfaceKHR surface;
     VkPhysicalDevice physicalDevice;
+    bool int64Atomics; // shaderInt64 and shaderBufferInt64Atomics are enabled
     QueueFamilyIndices queueFamilyIndices;
     VkDevice device; // logical device
     VkQueue graphicsQueue;
@@ -68,36 +512,116 @@ typedef struct Context {
     VkPipeline graphicsPipeline;
     VkFramebuffer* swapChainFramebuffers;
     VkCommandPool commandPool;
-    VkCommandBuffer* commandBuffers;
+    VkCommandBuffer* commandBuffers; // one per (frame slot, swapchain image, particle buffer), see graphicsCommandBufferIndex
+    bool* commandBuffersRecorded;
     VkSemaphore* imageAvailableSemaphores;
     VkSemaphore* renderFinishedSemaphores;
-    VkFence* inFlightFences;
     const uint32_t MAX_FRAMES_IN_FLIGHT;
     uint32_t currentFrame;
     bool framebufferResized;
 
     const uint32_t PARTICLE_COUNT;
+    const InitialConditions initialConditions;
+    const SimulationBackend backend;
+    const ComputeKernel computeKernel;
+    const CpuKernel cpuKernel;
+    const bool cpuBenchmark;    // run the single threaded CPU kernel benchmark instead of a simulation
+    const uint32_t threadCount; // CPU backend workers, 0 = one per processor
+    const uint32_t stepCount;   // steps run by the CPU backend and in headless mode
+    const uint32_t fmmOrder;    // CPU_KERNEL_FMM expansion order, at most FMM_MAX_ORDER
+    const float fmmTheta;       // CPU_KERNEL_FMM cells interact through expansions when their radii sum to less than theta times their distance
+    const bool headless;        // compute only: no window, surface, swapchain or graphics pipeline
+    const uint32_t snapshotInterval; // headless steps between snapshotCallback calls, 0 = never
+    SnapshotCallback snapshotCallback;
+    uint64_t stepIndex;         // compute steps submitted so far
+    const uint32_t substeps;    // simulation steps recorded into each compute submission
+    uint32_t latestBuffer;      // shaderStorageBuffers index holding the newest state
     
     VkQueue computeQueue;
+    VkQueue transferQueue;
+    StagingRing staging;
     VkDescriptorSetLayout computeDescriptorSetLayout;
     VkPipelineLayout computePipelineLayout;
     VkPipeline computePipeline;
+    ComputeTuning computeTuning;
+    const bool autotune;       // benchmark computeTuning candidates at startup, the winner is cached in autotunePath
+    const char* autotunePath;
     VkDescriptorPool descriptorPool;
     VkDescriptorSet* computeDescriptorSets;
+    const Integrator integrator;
+    VkDescriptorSet* substepDescriptorSets; // Yoshida: two per frame slot, (slot -> scratch) and (scratch -> slot)
 
     VkBuffer* shaderStorageBuffers;
-    VkDeviceMemory* shaderStorageBuffersMemory;
+    Allocation* shaderStorageBufferAllocations;
+    VkBuffer* accelerationBuffers;          // vec2 per particle, written alongside shaderStorageBuffers[i]
+    Allocation* accelerationBufferAllocations;
+    VkBuffer scratchParticleBuffer;         // Yoshida: state between substeps
+    Allocation scratchParticleBufferAllocation;
+    VkBuffer scratchAccelerationBuffer;
+    Allocation scratchAccelerationBufferAllocation;
 
     VkBuffer* uniformBuffers;
-    VkDeviceMemory* uniformBuffersMemory;
+    Allocation* uniformBufferAllocations;
     void** uniformBuffersMapped;
 
-    VkCommandBuffer* computeCommandBuffers;
+    GpuAllocator allocator;
+
+    VkCommandPool computeCommandPool;
+    VkCommandBuffer* computeCommandBuffers; // one per (frame slot, first input buffer)
+    uint32_t* computeCommandBufferSteps;    // steps recorded into each compute command buffer, 0 = not recorded
+    const bool reuseCommandBuffers;         // false re-records every command buffer before each submission
+    double recordSubmitTime;                // host seconds spent recording and submitting, reset by whoever reports it
+
+    Profiler profiler;
+    double startTime; // when initialization started, 0 once the time to first step is reported
+
+    const char* shaderOverrideDir; // <dir>/<name>.spv replaces the embedded shader if it exists, NULL = embedded only
+    const char* pipelineCachePath; // NULL = pipelines are compiled on every run
+    VkPipelineCache pipelineCache;
+    bool pipelineCacheWarm;        // loaded from a file written by an earlier run on this device
+
+    const char* restartPath;           // checkpoint to start from, NULL = generated initial conditions
+    const char* checkpointPath;
+    const uint32_t checkpointInterval; // steps between checkpoints, 0 = never
+    CheckpointWriter checkpoint;
+    double simulationTime;
+
+    const char* trajectoryPath;
+    const uint32_t trajectoryInterval; // steps between trajectory frames, 0 = never
+    const bool compressTrajectory;
+    const float trajectoryTolerance;   // quantization step relative to the bounding box extent
+    TrajectoryWriter trajectory;
+    const bool printStats; // rolling GPU, CPU and wall time percentiles once a second
+
+    BarnesHut barnesHut;
+    const float theta; // Barnes-Hut opening angle
+    const bool compareWithDirect; // report Barnes-Hut, particle-mesh or FMM force error and step time against the direct kernel at startup
+
+    BlockSteps blockSteps;
+    const uint32_t blockStepLevels;  // time step levels, level l steps with timeStep / 2^l
+    const float blockStepAccuracy;   // a particle wants steps of accuracy * sqrt(softening length / |a|)
+
+    ParticleMesh particleMesh;
+    const uint32_t pmGridSize;  // mesh cells per side, a power of two
+    const bool pmPeriodic;      // wrap particles and forces around a fixed box instead of following the particles
+    const float pmBoxSize;      // half the side of the periodic box
+
+    const uint32_t renderStreamStride; // draw every nth particle from a packed stream, 0 = draw the simulation buffers
+    RenderStream renderStream;
+    const RenderMode renderMode;
+    const float densityExposure;       // tone map brightness per particle in a pixel
+    DensitySplat density;
 
-    VkSemaphore* computeFinishedSemaphores;
-    VkFence* computeInFlightFences;
+    VkSemaphore computeTimeline;  // reaches n when compute submission n has finished
+    VkSemaphore graphicsTimeline; // reaches n when the frame drawn after compute submission n has finished
+    uint64_t submissionCount;     // compute submissions so far
+    QueueOwnership ownership;
 
-    const float timeStep;
+    const float timeStep;             // the largest step with adaptiveTimeStep
+    const bool adaptiveTimeStep;      // the GPU picks every step from the largest acceleration and speed
+    const float timeStepAccuracy;     // steps of accuracy * min(sqrt(softening length / |a|), softening length / |v|)
+    const float minTimeStep;
+    TimeStepControl timeStepControl;
 } Context;
 
 #endif
@@ -0,0 +1,267 @@
+#include "vkAllocator.h"
+#include "vkinit.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Buffers are placed in a few large device memory blocks instead of getting a
+// vkAllocateMemory each, so the allocation count no longer grows with every buffer a
+// feature adds and stays far below maxMemoryAllocationCount (4096 on many drivers).
+// Blocks are kept per memory type and strategy. Host visible blocks are mapped once for
+// their whole lifetime, since a memory object can only be mapped once at a time; every
+// property set used here includes HOST_COHERENT, so mapped writes need no flush.
+void createAllocator(Context* context) {
+    GpuAllocator* allocator = &context->allocator;
+    vkGetPhysicalDeviceMemoryProperties(context->physicalDevice, &allocator->memoryProperties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context->physicalDevice, &properties);
+    allocator->maxMemoryAllocationCount = properties.limits.maxMemoryAllocationCount;
+}
+
+void destroyAllocator(Context* context) {
+    GpuAllocator* allocator = &context->allocator;
+    if (allocator->allocationCount > 0) {
+        printf("%u buffer allocations still live at shutdown!\n", allocator->allocationCount);
+    }
+    for (uint32_t i = 0; i < allocator->blockCount; i++) {
+        if (allocator->blocks[i].memory != VK_NULL_HANDLE) {
+            releaseMemoryBlock(context, &allocator->blocks[i]);
+        }
+    }
+    free(allocator->blocks);
+}
+
+// requirements come from vkGetBufferMemoryRequirements, so the offset satisfies the
+// buffer's alignment. Only buffers are placed in blocks, bufferImageGranularity never applies.
+Allocation allocateMemory(Context* context, VkMemoryRequirements requirements, VkMemoryPropertyFlags properties, AllocationStrategy strategy) {
+    GpuAllocator* allocator = &context->allocator;
+    uint32_t memoryTypeIndex = findMemoryType(context->physicalDevice, requirements.memoryTypeBits, properties);
+
+    Allocation allocation = { 0 };
+    uint32_t blockIndex = allocator->blockCount;
+    for (uint32_t i = 0; i < allocator->blockCount; i++) {
+        MemoryBlock* block = &allocator->blocks[i];
+        if (block->memory != VK_NULL_HANDLE && block->memoryTypeIndex == memoryTypeIndex && block->strategy == strategy &&
+            allocateFromBlock(block, requirements.size, requirements.alignment, &allocation.offset)) {
+            blockIndex = i;
+            break;
+        }
+    }
+    if (blockIndex == allocator->blockCount) {
+        // anything larger than a block gets a block of its own, released again when freed
+        VkDeviceSize blockSize = preferredBlockSize(allocator, memoryTypeIndex);
+        if (requirements.size > blockSize) {
+            blockSize = requirements.size;
+        }
+        blockIndex = createMemoryBlock(context, memoryTypeIndex, blockSize, strategy);
+        allocateFromBlock(&allocator->blocks[blockIndex], requirements.size, requirements.alignment, &allocation.offset);
+    }
+
+    MemoryBlock* block = &allocator->blocks[blockIndex];
+    block->allocationCount++;
+    block->usedBytes += requirements.size;
+
+    allocation.memory = block->memory;
+    allocation.size = requirements.size;
+    allocation.block = blockIndex;
+    if (block->mapped != NULL) {
+        allocation.mapped = block->mapped + allocation.offset;
+    }
+
+    allocator->allocationCount++;
+    allocator->usedBytes += requirements.size;
+    if (allocator->usedBytes > allocator->peakUsedBytes) {
+        allocator->peakUsedBytes = allocator->usedBytes;
+    }
+    return allocation;
+}
+
+// Linear blocks only get their memory back once every allocation in them is freed.
+void freeAllocation(Context* context, Allocation allocation) {
+    GpuAllocator* allocator = &context->allocator;
+    MemoryBlock* block = &allocator->blocks[allocation.block];
+
+    if (block->strategy == ALLOCATION_STRATEGY_FREE_LIST) {
+        freeFromBlock(block, allocation.offset, allocation.size);
+    }
+    block->allocationCount--;
+    block->usedBytes -= allocation.size;
+    allocator->allocationCount--;
+    allocator->usedBytes -= allocation.size;
+
+    if (block->allocationCount == 0) {
+        block->linearOffset = 0;
+        if (block->size > preferredBlockSize(allocator, block->memoryTypeIndex)) {
+            releaseMemoryBlock(context, block);
+        }
+    }
+}
+
+// Returns the index of the new block, reusing the slot of a released one
+uint32_t createMemoryBlock(Context* context, uint32_t memoryTypeIndex, VkDeviceSize size, AllocationStrategy strategy) {
+    GpuAllocator* allocator = &context->allocator;
+    if (allocator->deviceMemoryCount >= allocator->maxMemoryAllocationCount) {
+        printf("maxMemoryAllocationCount (%u) reached!\n", allocator->maxMemoryAllocationCount);
+        exit(1);
+    }
+
+    uint32_t index = allocator->blockCount;
+    for (uint32_t i = 0; i < allocator->blockCount; i++) {
+        if (allocator->blocks[i].memory == VK_NULL_HANDLE) {
+            index = i;
+            break;
+        }
+    }
+    if (index == allocator->blockCount) {
+        allocator->blocks = (MemoryBlock*)realloc(allocator->blocks, sizeof(MemoryBlock) * (allocator->blockCount + 1));
+        allocator->blockCount++;
+    }
+
+    MemoryBlock* block = &allocator->blocks[index];
+    memset(block, 0, sizeof(MemoryBlock));
+    block->size = size;
+    block->memoryTypeIndex = memoryTypeIndex;
+    block->strategy = strategy;
+
+    VkMemoryAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = size,
+        .memoryTypeIndex = memoryTypeIndex
+    };
+    VkResult result = vkAllocateMemory(context->device, &allocInfo, NULL, &block->memory);
+    checkErr(result, "failed to allocate memory block!");
+
+    if (allocator->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        void* mapped;
+        result = vkMapMemory(context->device, block->memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+        checkErr(result, "failed to map memory block!");
+        block->mapped = (uint8_t*)mapped;
+    }
+    if (strategy == ALLOCATION_STRATEGY_FREE_LIST) {
+        insertFreeRange(block, 0, 0, size);
+    }
+
+    allocator->deviceMemoryCount++;
+    allocator->reservedBytes += size;
+    return index;
+}
+
+// Freeing the memory also unmaps it
+void releaseMemoryBlock(Context* context, MemoryBlock* block) {
+    GpuAllocator* allocator = &context->allocator;
+    vkFreeMemory(context->device, block->memory, NULL);
+    free(block->freeRanges);
+
+    allocator->deviceMemoryCount--;
+    allocator->reservedBytes -= block->size;
+    memset(block, 0, sizeof(MemoryBlock));
+}
+
+// Small heaps, such as the 256 MiB device local window the CPU can write to, get
+// smaller blocks so a single block doesn't take most of the heap.
+VkDeviceSize preferredBlockSize(GpuAllocator* allocator, uint32_t memoryTypeIndex) {
+    uint32_t heapIndex = allocator->memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+    VkDeviceSize heapSize = allocator->memoryProperties.memoryHeaps[heapIndex].size;
+    if (heapSize <= 1024ull * 1024 * 1024) {
+        return heapSize / 8;
+    }
+    return ALLOCATOR_BLOCK_SIZE;
+}
+
+// alignment is a power of two, guaranteed by the spec for memory requirements
+bool allocateFromBlock(MemoryBlock* block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset) {
+    if (block->strategy == ALLOCATION_STRATEGY_LINEAR) {
+        VkDeviceSize aligned = (block->linearOffset + alignment - 1) & ~(alignment - 1);
+        if (aligned + size > block->size) {
+            return false;
+        }
+        block->linearOffset = aligned + size;
+        *offset = aligned;
+        return true;
+    }
+
+    for (uint32_t i = 0; i < block->freeRangeCount; i++) {
+        MemoryRange range = block->freeRanges[i];
+        VkDeviceSize aligned = (range.offset + alignment - 1) & ~(alignment - 1);
+        VkDeviceSize end = aligned + size;
+        VkDeviceSize rangeEnd = range.offset + range.size;
+        if (end > rangeEnd) {
+            continue;
+        }
+
+        // the range is split around the allocation, the alignment padding stays free
+        removeFreeRange(block, i);
+        if (end < rangeEnd) {
+            insertFreeRange(block, i, end, rangeEnd - end);
+        }
+        if (aligned > range.offset) {
+            insertFreeRange(block, i, range.offset, aligned - range.offset);
+        }
+        *offset = aligned;
+        return true;
+    }
+    return false;
+}
+
+// Merges the range with the free ranges directly before and after it
+void freeFromBlock(MemoryBlock* block, VkDeviceSize offset, VkDeviceSize size) {
+    uint32_t index = 0;
+    while (index < block->freeRangeCount && block->freeRanges[index].offset < offset) {
+        index++;
+    }
+
+    MemoryRange* previous = index > 0 ? &block->freeRanges[index - 1] : NULL;
+    MemoryRange* next = index < block->freeRangeCount ? &block->freeRanges[index] : NULL;
+    bool mergePrevious = previous != NULL && previous->offset + previous->size == offset;
+    bool mergeNext = next != NULL && offset + size == next->offset;
+
+    if (mergePrevious && mergeNext) {
+        previous->size += size + next->size;
+        removeFreeRange(block, index);
+    }
+    else if (mergePrevious) {
+        previous->size += size;
+    }
+    else if (mergeNext) {
+        next->offset = offset;
+        next->size += size;
+    }
+    else {
+        insertFreeRange(block, index, offset, size);
+    }
+}
+
+void insertFreeRange(MemoryBlock* block, uint32_t index, VkDeviceSize offset, VkDeviceSize size) {
+    if (block->freeRangeCount == block->freeRangeCapacity) {
+        block->freeRangeCapacity = block->freeRangeCapacity == 0 ? 16 : block->freeRangeCapacity * 2;
+        block->freeRanges = (MemoryRange*)realloc(block->freeRanges, sizeof(MemoryRange) * block->freeRangeCapacity);
+    }
+    memmove(&block->freeRanges[index + 1], &block->freeRanges[index], sizeof(MemoryRange) * (block->freeRangeCount - index));
+    block->freeRanges[index].offset = offset;
+    block->freeRanges[index].size = size;
+    block->freeRangeCount++;
+}
+
+void removeFreeRange(MemoryBlock* block, uint32_t index) {
+    memmove(&block->freeRanges[index], &block->freeRanges[index + 1], sizeof(MemoryRange) * (block->freeRangeCount - index - 1));
+    block->freeRangeCount--;
+}
+
+void printAllocatorStats(GpuAllocator* allocator) {
+    double mebibyte = 1024.0 * 1024.0;
+    printf("Memory: %u buffers in %u device allocations (limit %u)\t used MiB %.1lf of %.1lf\t peak MiB %.1lf\n",
+        allocator->allocationCount, allocator->deviceMemoryCount, allocator->maxMemoryAllocationCount,
+        allocator->usedBytes / mebibyte, allocator->reservedBytes / mebibyte, allocator->peakUsedBytes / mebibyte);
+
+    for (uint32_t i = 0; i < allocator->blockCount; i++) {
+        MemoryBlock* block = &allocator->blocks[i];
+        if (block->memory == VK_NULL_HANDLE) {
+            continue;
+        }
+        printf("  block %u: type %u %s\t %u buffers\t used MiB %.1lf of %.1lf\n", i, block->memoryTypeIndex,
+            block->strategy == ALLOCATION_STRATEGY_LINEAR ? "linear   " : "free list",
+            block->allocationCount, block->usedBytes / mebibyte, block->size / mebibyte);
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef VKALLOCATOR_H
+#define VKALLOCATOR_H
+
+#include "types.h"
+
+void createAllocator(Context* context);
+void destroyAllocator(Context* context);
+
+Allocation allocateMemory(Context* context, VkMemoryRequirements requirements, VkMemoryPropertyFlags properties, AllocationStrategy strategy);
+void freeAllocation(Context* context, Allocation allocation);
+
+uint32_t createMemoryBlock(Context* context, uint32_t memoryTypeIndex, VkDeviceSize size, AllocationStrategy strategy);
+void releaseMemoryBlock(Context* context, MemoryBlock* block);
+VkDeviceSize preferredBlockSize(GpuAllocator* allocator, uint32_t memoryTypeIndex);
+bool allocateFromBlock(MemoryBlock* block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset);
+void freeFromBlock(MemoryBlock* block, VkDeviceSize offset, VkDeviceSize size);
+void insertFreeRange(MemoryBlock* block, uint32_t index, VkDeviceSize offset, VkDeviceSize size);
+void removeFreeRange(MemoryBlock* block, uint32_t index);
+
+void printAllocatorStats(GpuAllocator* allocator);
+
+#endif
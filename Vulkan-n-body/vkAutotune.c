@@ -0,0 +1,276 @@
+#include "vkAutotune.h"
+#include "vkinit.h"
+#include "vkDraw.h"
+#include "platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+
+// The best workgroup size, tile size and unroll depend on the GPU and on N, so the
+// candidates are timed once at startup and the winner is stored per device UUID in
+// autotunePath. A later run on the same device and N reads it back without benchmarking.
+void autotuneComputeKernel(Context* context) {
+    const char* shaderName = computeKernelShaderName(context->computeKernel);
+    char uuid[2 * VK_UUID_SIZE + 1];
+    deviceUuidString(context->physicalDevice, uuid);
+
+    char key[128];
+    // the kick-drift-kick variant of a kernel reads more per particle, it is tuned separately
+    snprintf(key, sizeof(key), "%s %s%s %u", uuid, shaderName, context->integrator != INTEGRATOR_EULER ? "_kdk" : "", context->PARTICLE_COUNT);
+    if (loadAutotuneResult(context->autotunePath, key, &context->computeTuning)) {
+        printf("Autotune: using cached result from %s\n", context->autotunePath);
+        return;
+    }
+
+    ComputeTuning candidates[AUTOTUNE_MAX_CANDIDATES];
+    uint32_t candidateCount = autotuneCandidates(context, candidates);
+
+    double autotuneStart = getTime();
+    AutotuneBenchmark benchmark = { 0 };
+    createAutotuneBenchmark(context, &benchmark);
+
+    double bestTime = DBL_MAX;
+    for (uint32_t i = 0; i < candidateCount; i++) {
+        double time = benchmarkTuning(context, &benchmark, candidates[i]);
+        if (context->printStats) {
+            printf("  workgroup %4u\t tile %4u\t unroll %u\t %.3lf ms\n",
+                candidates[i].workgroupSize, candidates[i].tileSize, candidates[i].unroll, time * 1000.0);
+        }
+        if (time < bestTime) {
+            bestTime = time;
+            context->computeTuning = candidates[i];
+        }
+    }
+    destroyAutotuneBenchmark(context, &benchmark);
+
+    printf("Autotune: %u candidates on %u particles in %.1lf ms\n", candidateCount, benchmark.particleCount, (getTime() - autotuneStart) * 1000.0);
+    saveAutotuneResult(context->autotunePath, key, context->computeTuning);
+}
+
+// Workgroup sizes are limited by the device, tiles by shared memory (a vec4 per particle).
+// The reference kernel has no tile, so only its workgroup size is varied.
+uint32_t autotuneCandidates(Context* context, ComputeTuning* candidates) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context->physicalDevice, &properties);
+    VkPhysicalDeviceLimits limits = properties.limits;
+
+    const uint32_t workgroupSizes[] = { 64, 128, 256, 512, 1024 };
+    const uint32_t tileFactors[] = { 1, 2, 4 };
+    const uint32_t unrolls[] = { 1, 4 };
+    bool tiled = context->computeKernel == COMPUTE_KERNEL_TILED;
+
+    uint32_t count = 0;
+    for (uint32_t w = 0; w < sizeof(workgroupSizes) / sizeof(workgroupSizes[0]); w++) {
+        uint32_t workgroupSize = workgroupSizes[w];
+        if (workgroupSize > limits.maxComputeWorkGroupSize[0] || workgroupSize > limits.maxComputeWorkGroupInvocations) {
+            continue;
+        }
+        if (!tiled) {
+            candidates[count++] = (ComputeTuning){ workgroupSize, workgroupSize, 1 };
+            continue;
+        }
+        for (uint32_t t = 0; t < sizeof(tileFactors) / sizeof(tileFactors[0]); t++) {
+            uint32_t tileSize = workgroupSize * tileFactors[t];
+            if (tileSize * 4 * sizeof(float) > limits.maxComputeSharedMemorySize) {
+                continue;
+            }
+            for (uint32_t u = 0; u < sizeof(unrolls) / sizeof(unrolls[0]); u++) {
+                candidates[count++] = (ComputeTuning){ workgroupSize, tileSize, unrolls[u] };
+            }
+        }
+    }
+    return count;
+}
+
+// The candidates run on a copy of the initial particles, capped at AUTOTUNE_MAX_PARTICLES
+// so a large N doesn't make startup take minutes. Everything runs on the compute queue.
+void createAutotuneBenchmark(Context* context, AutotuneBenchmark* benchmark) {
+    benchmark->particleCount = context->PARTICLE_COUNT < AUTOTUNE_MAX_PARTICLES ? context->PARTICLE_COUNT : AUTOTUNE_MAX_PARTICLES;
+    VkDeviceSize bufferSize = sizeof(Particle) * benchmark->particleCount;
+    VkDeviceSize accelerationBufferSize = sizeof(vec2) * benchmark->particleCount;
+
+    for (uint32_t i = 0; i < 4; i++) {
+        createBuffer(context,
+            i < 2 ? bufferSize : accelerationBufferSize,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            ALLOCATION_STRATEGY_FREE_LIST,
+            &benchmark->buffers[i],
+            &benchmark->bufferAllocations[i]);
+    }
+
+    benchmark->shaderModule = loadShaderModule(context, computeKernelShaderName(context->computeKernel));
+
+    benchmark->pipelineLayout = createDirectPipelineLayout(context);
+
+    VkDescriptorPoolSize poolSizes[2] = { 0 };
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].descriptorCount = 1;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = 4;
+
+    VkDescriptorPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .poolSizeCount = 2,
+        .pPoolSizes = poolSizes,
+        .maxSets = 1
+    };
+    VkResult result = vkCreateDescriptorPool(context->device, &poolInfo, NULL, &benchmark->descriptorPool);
+    checkErr(result, "failed to create autotune descriptor pool!");
+
+    VkDescriptorSetAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = benchmark->descriptorPool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &context->computeDescriptorSetLayout
+    };
+    result = vkAllocateDescriptorSets(context->device, &allocInfo, &benchmark->descriptorSet);
+    checkErr(result, "failed to allocate autotune descriptor set!");
+
+    writeComputeDescriptorSet(context, benchmark->descriptorSet, context->uniformBuffers[0],
+        benchmark->buffers[0], benchmark->buffers[1], benchmark->buffers[2], benchmark->buffers[3], benchmark->particleCount);
+
+    VkCommandBufferAllocateInfo commandBufferInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = context->computeCommandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+    result = vkAllocateCommandBuffers(context->device, &commandBufferInfo, &benchmark->commandBuffer);
+    checkErr(result, "failed to allocate autotune command buffer!");
+
+    VkFenceCreateInfo fenceInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO
+    };
+    result = vkCreateFence(context->device, &fenceInfo, NULL, &benchmark->fence);
+    checkErr(result, "failed to create autotune fence!");
+
+    // The compute family owns the storage buffers, so the copy needs no ownership transfer
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    vkBeginCommandBuffer(benchmark->commandBuffer, &beginInfo);
+
+        VkBufferCopy copyRegion = {
+            .size = bufferSize
+        };
+        vkCmdCopyBuffer(benchmark->commandBuffer, context->shaderStorageBuffers[context->latestBuffer], benchmark->buffers[0], 1, &copyRegion);
+        vkCmdCopyBuffer(benchmark->commandBuffer, context->shaderStorageBuffers[context->latestBuffer], benchmark->buffers[1], 1, &copyRegion);
+        vkCmdFillBuffer(benchmark->commandBuffer, benchmark->buffers[2], 0, VK_WHOLE_SIZE, 0);
+
+    vkEndCommandBuffer(benchmark->commandBuffer);
+    submitAutotuneCommands(context, benchmark);
+}
+
+void destroyAutotuneBenchmark(Context* context, AutotuneBenchmark* benchmark) {
+    vkDestroyFence(context->device, benchmark->fence, NULL);
+    vkFreeCommandBuffers(context->device, context->computeCommandPool, 1, &benchmark->commandBuffer);
+    vkDestroyDescriptorPool(context->device, benchmark->descriptorPool, NULL);
+    vkDestroyPipelineLayout(context->device, benchmark->pipelineLayout, NULL);
+    vkDestroyShaderModule(context->device, benchmark->shaderModule, NULL);
+    for (uint32_t i = 0; i < 4; i++) {
+        destroyBuffer(context, benchmark->buffers[i], benchmark->bufferAllocations[i]);
+    }
+}
+
+// Returns the best wall clock time per step over AUTOTUNE_RUNS submissions. The first
+// submission is a warmup and isn't counted, some drivers finish compiling on first use.
+double benchmarkTuning(Context* context, AutotuneBenchmark* benchmark, ComputeTuning tuning) {
+    VkPipeline pipeline = createDirectComputePipeline(context, benchmark->shaderModule, benchmark->pipelineLayout, tuning, benchmark->particleCount);
+
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO
+    };
+    vkBeginCommandBuffer(benchmark->commandBuffer, &beginInfo);
+
+        vkCmdBindPipeline(benchmark->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+        vkCmdBindDescriptorSets(benchmark->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, benchmark->pipelineLayout, 0, 1, &benchmark->descriptorSet, 0, NULL);
+        IntegratorPushConstants pushConstants = {
+            .stepScale = 1.0f
+        };
+        vkCmdPushConstants(benchmark->commandBuffer, benchmark->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(IntegratorPushConstants), &pushConstants);
+        for (uint32_t i = 0; i < AUTOTUNE_DISPATCHES; i++) {
+            recordComputeBarrier(benchmark->commandBuffer);
+            vkCmdDispatch(benchmark->commandBuffer, computeGroupCount(benchmark->particleCount, tuning), 1, 1);
+        }
+
+    vkEndCommandBuffer(benchmark->commandBuffer);
+
+    double bestTime = DBL_MAX;
+    for (uint32_t run = 0; run <= AUTOTUNE_RUNS; run++) {
+        double start = getTime();
+        submitAutotuneCommands(context, benchmark);
+        double time = getTime() - start;
+        if (run > 0 && time < bestTime) {
+            bestTime = time;
+        }
+    }
+
+    vkDestroyPipeline(context->device, pipeline, NULL);
+    return bestTime / AUTOTUNE_DISPATCHES;
+}
+
+void submitAutotuneCommands(Context* context, AutotuneBenchmark* benchmark) {
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &benchmark->commandBuffer
+    };
+    VkResult result = vkQueueSubmit(context->computeQueue, 1, &submitInfo, benchmark->fence);
+    checkErr(result, "failed to submit autotune command buffer!");
+
+    vkWaitForFences(context->device, 1, &benchmark->fence, VK_TRUE, UINT64_MAX);
+    vkResetFences(context->device, 1, &benchmark->fence);
+}
+
+// uuid needs room for 2 * VK_UUID_SIZE + 1 characters
+void deviceUuidString(VkPhysicalDevice physicalDevice, char* uuid) {
+    VkPhysicalDeviceIDProperties idProperties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES
+    };
+    VkPhysicalDeviceProperties2 properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &idProperties
+    };
+    vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+    for (uint32_t i = 0; i < VK_UUID_SIZE; i++) {
+        sprintf(uuid + 2 * i, "%02x", idProperties.deviceUUID[i]);
+    }
+}
+
+// One line per result: <device uuid> <kernel> <particle count> <workgroup> <tile> <unroll>.
+// Results are only ever appended, so the last matching line wins.
+bool loadAutotuneResult(const char* path, const char* key, ComputeTuning* tuning) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+
+    bool found = false;
+    size_t keyLength = strlen(key);
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        ComputeTuning result;
+        if (strncmp(line, key, keyLength) == 0 && line[keyLength] == ' ' &&
+            sscanf(line + keyLength, "%u %u %u", &result.workgroupSize, &result.tileSize, &result.unroll) == 3) {
+            *tuning = result;
+            found = true;
+        }
+    }
+    fclose(file);
+    return found;
+}
+
+void saveAutotuneResult(const char* path, const char* key, ComputeTuning tuning) {
+    FILE* file = fopen(path, "a");
+    if (file == NULL) {
+        printf("failed to write autotune result to %s!\n", path);
+        return;
+    }
+    fprintf(file, "%s %u %u %u\n", key, tuning.workgroupSize, tuning.tileSize, tuning.unroll);
+    fclose(file);
+}
@@ -0,0 +1,36 @@
+#ifndef VKAUTOTUNE_H
+#define VKAUTOTUNE_H
+
+#include "types.h"
+
+#define AUTOTUNE_MAX_PARTICLES 32768
+#define AUTOTUNE_MAX_CANDIDATES 32
+#define AUTOTUNE_DISPATCHES 4
+#define AUTOTUNE_RUNS 3
+
+// Scratch state for timing candidates, separate from the simulation's buffers
+typedef struct AutotuneBenchmark {
+    uint32_t particleCount;
+    VkShaderModule shaderModule;
+    VkPipelineLayout pipelineLayout;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet descriptorSet;
+    VkBuffer buffers[4];             // particles in, particles out, accelerations in, accelerations out
+    Allocation bufferAllocations[4];
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+} AutotuneBenchmark;
+
+void autotuneComputeKernel(Context* context);
+uint32_t autotuneCandidates(Context* context, ComputeTuning* candidates);
+
+void createAutotuneBenchmark(Context* context, AutotuneBenchmark* benchmark);
+void destroyAutotuneBenchmark(Context* context, AutotuneBenchmark* benchmark);
+double benchmarkTuning(Context* context, AutotuneBenchmark* benchmark, ComputeTuning tuning);
+void submitAutotuneCommands(Context* context, AutotuneBenchmark* benchmark);
+
+void deviceUuidString(VkPhysicalDevice physicalDevice, char* uuid);
+bool loadAutotuneResult(const char* path, const char* key, ComputeTuning* tuning);
+void saveAutotuneResult(const char* path, const char* key, ComputeTuning tuning);
+
+#endif
@@ -0,0 +1,314 @@
+#include "vkBarnesHut.h"
+#include "vkinit.h"
+#include "vkDraw.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Barnes-Hut step, one compute pass each:
+//   bounds   - single workgroup min/max reduction giving the square root cell
+//   morton   - 2 * BH_TREE_DEPTH bit morton code of the leaf cell of every particle
+//   sort     - LSD radix sort of (code, index) pairs, BH_SORT_BITS per count/scan/scatter round
+//   leaves   - range of sorted particles in every occupied leaf
+//   upsweep  - mass moments of every cell, one dispatch per level from the leaves up
+//   force    - stack based traversal with opening angle theta, then the usual integration
+// The quadtree is stored implicitly, level by level, so no pointers have to be built.
+
+const char* barnesHutShaderNames[BH_PASS_COUNT] = {
+    "bh_bounds",
+    "bh_morton",
+    "bh_sort_count",
+    "bh_sort_scan",
+    "bh_sort_scatter",
+    "bh_leaves",
+    "bh_upsweep",
+    "bh_force"
+};
+
+void createBarnesHutResources(Context* context) {
+    // the sorted keys have to end up back in the first half of the key buffer
+    if ((2 * BH_TREE_DEPTH / BH_SORT_BITS) % 2 != 0) {
+        printf("Barnes-Hut radix sort needs an even number of passes!\n");
+        exit(1);
+    }
+    // bh_force.comp integrates with the Euler update of the original kernel
+    if (context->integrator != INTEGRATOR_EULER) {
+        printf("Barnes-Hut only supports the Euler integrator!\n");
+        exit(1);
+    }
+
+    createBarnesHutDescriptorSetLayout(context);
+    createBarnesHutPipelines(context);
+    createBarnesHutBuffers(context);
+    createBarnesHutDescriptorSets(context);
+}
+
+void createBarnesHutDescriptorSetLayout(Context* context) {
+    VkDescriptorSetLayoutBinding layoutBindings[8] = { 0 };
+    for (uint32_t i = 0; i < 8; i++) {
+        layoutBindings[i].binding = i;
+        layoutBindings[i].descriptorCount = 1;
+        layoutBindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        layoutBindings[i].pImmutableSamplers = NULL;
+        layoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = 8,
+        .pBindings = layoutBindings
+    };
+
+    VkResult result = vkCreateDescriptorSetLayout(context->device, &layoutInfo, NULL, &context->barnesHut.descriptorSetLayout);
+    checkErr(result, "failed to create Barnes-Hut descriptor set layout!");
+}
+
+void createBarnesHutPipelines(Context* context) {
+    VkPushConstantRange pushConstantRange = {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = sizeof(BarnesHutPushConstants)
+    };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &context->barnesHut.descriptorSetLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstantRange
+    };
+
+    VkResult result = vkCreatePipelineLayout(context->device, &pipelineLayoutInfo, NULL, &context->barnesHut.pipelineLayout);
+    checkErr(result, "failed to create Barnes-Hut pipeline layout!");
+
+    for (uint32_t i = 0; i < BH_PASS_COUNT; i++) {
+        VkShaderModule shaderModule = loadShaderModule(context, barnesHutShaderNames[i]);
+
+        VkComputePipelineCreateInfo pipelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .layout = context->barnesHut.pipelineLayout,
+            .stage = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = shaderModule,
+                .pName = "main"
+            }
+        };
+
+        result = vkCreateComputePipelines(context->device, context->pipelineCache, 1, &pipelineInfo, NULL, &context->barnesHut.pipelines[i]);
+        checkErr(result, "failed to create Barnes-Hut pipeline!");
+
+        vkDestroyShaderModule(context->device, shaderModule, NULL);
+    }
+}
+
+void createBarnesHutBuffers(Context* context) {
+    BarnesHut* bh = &context->barnesHut;
+    uint32_t blockCount = (context->PARTICLE_COUNT + BH_BLOCK_SIZE - 1) / BH_BLOCK_SIZE;
+
+    createBuffer(context,
+        sizeof(uint32_t) * 2 * 2 * context->PARTICLE_COUNT,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ALLOCATION_STRATEGY_LINEAR,
+        &bh->keyBuffer, &bh->keyBufferAllocation);
+
+    createBuffer(context,
+        sizeof(uint32_t) * BH_SORT_BUCKETS * blockCount,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ALLOCATION_STRATEGY_LINEAR,
+        &bh->digitCountBuffer, &bh->digitCountBufferAllocation);
+
+    createBuffer(context,
+        sizeof(uint32_t) * 2 * BH_LEAF_COUNT,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ALLOCATION_STRATEGY_LINEAR,
+        &bh->leafRangeBuffer, &bh->leafRangeBufferAllocation);
+
+    createBuffer(context,
+        sizeof(float) * 8 * BH_NODE_COUNT,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ALLOCATION_STRATEGY_LINEAR,
+        &bh->nodeBuffer, &bh->nodeBufferAllocation);
+
+    createBuffer(context,
+        sizeof(float) * 4,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ALLOCATION_STRATEGY_LINEAR,
+        &bh->boundsBuffer, &bh->boundsBufferAllocation);
+}
+
+void createBarnesHutDescriptorSets(Context* context) {
+    BarnesHut* bh = &context->barnesHut;
+
+    VkDescriptorPoolSize poolSizes[2] = { 0 };
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].descriptorCount = context->MAX_FRAMES_IN_FLIGHT;
+
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = context->MAX_FRAMES_IN_FLIGHT * 7;
+
+    VkDescriptorPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .poolSizeCount = 2,
+        .pPoolSizes = poolSizes,
+        .maxSets = context->MAX_FRAMES_IN_FLIGHT,
+    };
+
+    VkResult result = vkCreateDescriptorPool(context->device, &poolInfo, NULL, &bh->descriptorPool);
+    checkErr(result, "failed to create Barnes-Hut descriptor pool!");
+
+    VkDescriptorSetLayout* layouts = (VkDescriptorSetLayout*)malloc(sizeof(VkDescriptorSetLayout) * context->MAX_FRAMES_IN_FLIGHT);
+    for (uint32_t i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
+        layouts[i] = bh->descriptorSetLayout;
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = bh->descriptorPool,
+        .descriptorSetCount = context->MAX_FRAMES_IN_FLIGHT,
+        .pSetLayouts = layouts
+    };
+
+    bh->descriptorSets = (VkDescriptorSet*)malloc(sizeof(VkDescriptorSet) * context->MAX_FRAMES_IN_FLIGHT);
+    result = vkAllocateDescriptorSets(context->device, &allocInfo, bh->descriptorSets);
+    checkErr(result, "failed to allocate Barnes-Hut descriptor sets!");
+    free(layouts);
+
+    for (uint32_t i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
+        VkDescriptorBufferInfo bufferInfos[8] = {
+            { context->uniformBuffers[i], 0, sizeof(UniformBufferObject) },
+            { context->shaderStorageBuffers[(i + context->MAX_FRAMES_IN_FLIGHT - 1) % context->MAX_FRAMES_IN_FLIGHT], 0, VK_WHOLE_SIZE },
+            { context->shaderStorageBuffers[i], 0, VK_WHOLE_SIZE },
+            { bh->keyBuffer, 0, VK_WHOLE_SIZE },
+            { bh->digitCountBuffer, 0, VK_WHOLE_SIZE },
+            { bh->leafRangeBuffer, 0, VK_WHOLE_SIZE },
+            { bh->nodeBuffer, 0, VK_WHOLE_SIZE },
+            { bh->boundsBuffer, 0, VK_WHOLE_SIZE }
+        };
+
+        VkWriteDescriptorSet descriptorWrites[8] = { 0 };
+        for (uint32_t b = 0; b < 8; b++) {
+            descriptorWrites[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[b].dstSet = bh->descriptorSets[i];
+            descriptorWrites[b].dstBinding = b;
+            descriptorWrites[b].dstArrayElement = 0;
+            descriptorWrites[b].descriptorType = b == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[b].descriptorCount = 1;
+            descriptorWrites[b].pBufferInfo = &bufferInfos[b];
+        }
+
+        vkUpdateDescriptorSets(context->device, 8, descriptorWrites, 0, NULL);
+    }
+}
+
+void recordBarnesHutCommands(Context* context, VkCommandBuffer commandBuffer, uint32_t setIndex) {
+    BarnesHut* bh = &context->barnesHut;
+    uint32_t blockCount = (context->PARTICLE_COUNT + BH_BLOCK_SIZE - 1) / BH_BLOCK_SIZE;
+
+    BarnesHutPushConstants pushConstants = {
+        .particleCount = context->PARTICLE_COUNT,
+        .theta = context->theta
+    };
+
+    // the tree buffers are shared by all frame slots, wait for the previous step to be done with them
+    recordComputeBarrier(commandBuffer);
+    vkCmdFillBuffer(commandBuffer, bh->leafRangeBuffer, 0, VK_WHOLE_SIZE, 0);
+    recordComputeBarrier(commandBuffer);
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, bh->pipelineLayout, 0, 1, &bh->descriptorSets[setIndex], 0, NULL);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, bh->pipelines[BH_PASS_BOUNDS]);
+    vkCmdPushConstants(commandBuffer, bh->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+    vkCmdDispatch(commandBuffer, 1, 1, 1);
+    recordComputeBarrier(commandBuffer);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, bh->pipelines[BH_PASS_MORTON]);
+    vkCmdDispatch(commandBuffer, blockCount, 1, 1);
+    recordComputeBarrier(commandBuffer);
+
+    for (uint32_t pass = 0; pass < 2 * BH_TREE_DEPTH / BH_SORT_BITS; pass++) {
+        pushConstants.shift = pass * BH_SORT_BITS;
+        pushConstants.keysIn = (pass % 2) * context->PARTICLE_COUNT;
+        pushConstants.keysOut = ((pass + 1) % 2) * context->PARTICLE_COUNT;
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, bh->pipelines[BH_PASS_SORT_COUNT]);
+        vkCmdPushConstants(commandBuffer, bh->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+        vkCmdDispatch(commandBuffer, blockCount, 1, 1);
+        recordComputeBarrier(commandBuffer);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, bh->pipelines[BH_PASS_SORT_SCAN]);
+        vkCmdDispatch(commandBuffer, 1, 1, 1);
+        recordComputeBarrier(commandBuffer);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, bh->pipelines[BH_PASS_SORT_SCATTER]);
+        vkCmdDispatch(commandBuffer, blockCount, 1, 1);
+        recordComputeBarrier(commandBuffer);
+    }
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, bh->pipelines[BH_PASS_LEAVES]);
+    vkCmdDispatch(commandBuffer, blockCount, 1, 1);
+    recordComputeBarrier(commandBuffer);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, bh->pipelines[BH_PASS_UPSWEEP]);
+    for (int32_t level = BH_TREE_DEPTH; level >= 0; level--) {
+        pushConstants.level = (uint32_t)level;
+        vkCmdPushConstants(commandBuffer, bh->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+        uint32_t cellCount = 1u << (2 * level);
+        vkCmdDispatch(commandBuffer, (cellCount + BH_BLOCK_SIZE - 1) / BH_BLOCK_SIZE, 1, 1);
+        recordComputeBarrier(commandBuffer);
+    }
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, bh->pipelines[BH_PASS_FORCE]);
+    vkCmdDispatch(commandBuffer, blockCount, 1, 1);
+}
+
+// Runs one step from the same state with the direct kernel and with Barnes-Hut
+// and reports the relative rms difference of the velocity kicks and the time per step.
+// The storage buffers are restored afterwards.
+void compareBarnesHutWithDirect(Context* context) {
+    VkDeviceSize bufferSize = sizeof(Particle) * context->PARTICLE_COUNT;
+
+    Particle* initial = (Particle*)malloc(bufferSize);
+    Particle* results[2] = { (Particle*)malloc(bufferSize), (Particle*)malloc(bufferSize) };
+    double msPerStep[2] = { 0 };
+
+    context->currentFrame = 0;
+    updateUniformBuffer(context->timeStep, context->uniformBuffersMapped, 0);
+    readbackBuffer(context, context->shaderStorageBuffers[context->MAX_FRAMES_IN_FLIGHT - 1], bufferSize, initial);
+
+    for (int useBarnesHut = 0; useBarnesHut < 2; useBarnesHut++) {
+        VkCommandBuffer commandBuffer = beginComparisonStep(context);
+        if (useBarnesHut) {
+            recordBarnesHutCommands(context, commandBuffer, 0);
+        }
+        else {
+            recordDirectStep(context, commandBuffer, 0);
+        }
+        msPerStep[useBarnesHut] = runComparisonStep(context, commandBuffer, results[useBarnesHut]);
+    }
+    vkResetCommandBuffer(context->computeCommandBuffers[0], 0);
+    context->computeCommandBufferSteps[0] = 0;
+
+    printf("Barnes-Hut theta %.2f: relative force error %.3e\n", context->theta,
+        relativeKickError(initial, results[0], results[1], context->PARTICLE_COUNT));
+    printf("time per step: direct %.3f ms\t Barnes-Hut %.3f ms\n", msPerStep[0], msPerStep[1]);
+
+    free(initial);
+    free(results[0]);
+    free(results[1]);
+}
+
+void cleanupBarnesHut(Context* context) {
+    BarnesHut* bh = &context->barnesHut;
+
+    for (uint32_t i = 0; i < BH_PASS_COUNT; i++) {
+        vkDestroyPipeline(context->device, bh->pipelines[i], NULL);
+    }
+    vkDestroyPipelineLayout(context->device, bh->pipelineLayout, NULL);
+    vkDestroyDescriptorPool(context->device, bh->descriptorPool, NULL);
+    vkDestroyDescriptorSetLayout(context->device, bh->descriptorSetLayout, NULL);
+
+    destroyBuffer(context, bh->keyBuffer, bh->keyBufferAllocation);
+    destroyBuffer(context, bh->digitCountBuffer, bh->digitCountBufferAllocation);
+    destroyBuffer(context, bh->leafRangeBuffer, bh->leafRangeBufferAllocation);
+    destroyBuffer(context, bh->nodeBuffer, bh->nodeBufferAllocation);
+    destroyBuffer(context, bh->boundsBuffer, bh->boundsBufferAllocation);
+
+    free(bh->descriptorSets);
+}
@@ -0,0 +1,25 @@
+#ifndef VKBARNESHUT_H
+#define VKBARNESHUT_H
+
+#include "types.h"
+
+// Must match TREE_DEPTH and BLOCK_SIZE in shaders/bh_common.glsl
+#define BH_TREE_DEPTH 8
+#define BH_BLOCK_SIZE 256
+#define BH_SORT_BITS 4
+#define BH_SORT_BUCKETS (1u << BH_SORT_BITS)
+#define BH_LEAF_COUNT (1u << (2 * BH_TREE_DEPTH))
+#define BH_NODE_COUNT (((1u << (2 * (BH_TREE_DEPTH + 1))) - 1) / 3)
+
+void createBarnesHutResources(Context* context);
+void createBarnesHutDescriptorSetLayout(Context* context);
+void createBarnesHutPipelines(Context* context);
+void createBarnesHutBuffers(Context* context);
+void createBarnesHutDescriptorSets(Context* context);
+
+void recordBarnesHutCommands(Context* context, VkCommandBuffer commandBuffer, uint32_t setIndex);
+void compareBarnesHutWithDirect(Context* context);
+
+void cleanupBarnesHut(Context* context);
+
+#endif
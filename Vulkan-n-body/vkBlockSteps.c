@@ -0,0 +1,302 @@
+#include "vkBlockSteps.h"
+#include "vkinit.h"
+#include "vkDraw.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Hierarchical block time steps: particle i steps with timeStep / 2^level[i] and only the
+// particles due at a tick of the finest level get their forces evaluated. Every tick runs
+//   drift    - all particles move by one tick, the due ones are appended to an index list
+//   dispatch - single invocation, writes the indirect dispatch for the due particles
+//   force    - direct forces for the due particles, kicks and new levels
+// so a step costs 2^(blockStepLevels - 1) ticks but far fewer force evaluations than
+// running every particle on the finest step. Integration is always kick-drift-kick.
+
+const char* blockStepShaderNames[BLOCK_PASS_COUNT] = {
+    "block_drift",
+    "block_dispatch",
+    "block_force"
+};
+
+void createBlockStepResources(Context* context) {
+    if (context->blockStepLevels == 0 || context->blockStepLevels > BLOCK_STEP_MAX_LEVELS) {
+        printf("blockStepLevels must be between 1 and %u!\n", BLOCK_STEP_MAX_LEVELS);
+        exit(1);
+    }
+    if (context->integrator != INTEGRATOR_EULER) {
+        printf("Block steps are always kick-drift-kick, leave the integrator at Euler!\n");
+        exit(1);
+    }
+
+    createBlockStepDescriptorSetLayout(context);
+    createBlockStepPipelines(context);
+    createBlockStepBuffers(context);
+    createBlockStepDescriptorSets(context);
+    initializeBlockSteps(context);
+}
+
+void createBlockStepDescriptorSetLayout(Context* context) {
+    VkDescriptorSetLayoutBinding layoutBindings[6] = { 0 };
+    for (uint32_t i = 0; i < 6; i++) {
+        layoutBindings[i].binding = i;
+        layoutBindings[i].descriptorCount = 1;
+        layoutBindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        layoutBindings[i].pImmutableSamplers = NULL;
+        layoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = 6,
+        .pBindings = layoutBindings
+    };
+
+    VkResult result = vkCreateDescriptorSetLayout(context->device, &layoutInfo, NULL, &context->blockSteps.descriptorSetLayout);
+    checkErr(result, "failed to create block step descriptor set layout!");
+}
+
+void createBlockStepPipelines(Context* context) {
+    VkPushConstantRange pushConstantRange = {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = sizeof(BlockStepPushConstants)
+    };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &context->blockSteps.descriptorSetLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstantRange
+    };
+
+    VkResult result = vkCreatePipelineLayout(context->device, &pipelineLayoutInfo, NULL, &context->blockSteps.pipelineLayout);
+    checkErr(result, "failed to create block step pipeline layout!");
+
+    for (uint32_t i = 0; i < BLOCK_PASS_COUNT; i++) {
+        VkShaderModule shaderModule = loadShaderModule(context, blockStepShaderNames[i]);
+
+        VkComputePipelineCreateInfo pipelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .layout = context->blockSteps.pipelineLayout,
+            .stage = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = shaderModule,
+                .pName = "main"
+            }
+        };
+
+        result = vkCreateComputePipelines(context->device, context->pipelineCache, 1, &pipelineInfo, NULL, &context->blockSteps.pipelines[i]);
+        checkErr(result, "failed to create block step pipeline!");
+
+        vkDestroyShaderModule(context->device, shaderModule, NULL);
+    }
+}
+
+void createBlockStepBuffers(Context* context) {
+    BlockSteps* blocks = &context->blockSteps;
+
+    createBuffer(context,
+        sizeof(uint32_t) * context->PARTICLE_COUNT,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ALLOCATION_STRATEGY_LINEAR,
+        &blocks->levelBuffer, &blocks->levelBufferAllocation);
+
+    createBuffer(context,
+        sizeof(uint32_t) * context->PARTICLE_COUNT,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ALLOCATION_STRATEGY_LINEAR,
+        &blocks->activeIndexBuffer, &blocks->activeIndexBufferAllocation);
+
+    createBuffer(context,
+        sizeof(BlockStepState),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ALLOCATION_STRATEGY_LINEAR,
+        &blocks->stateBuffer, &blocks->stateBufferAllocation);
+}
+
+// Set 2 * i reads the previous buffer and writes buffer i, for the first tick of a step.
+// Set 2 * i + 1 reads and writes buffer i, for the remaining ticks.
+void createBlockStepDescriptorSets(Context* context) {
+    BlockSteps* blocks = &context->blockSteps;
+    uint32_t setCount = 2 * context->MAX_FRAMES_IN_FLIGHT;
+
+    VkDescriptorPoolSize poolSizes[2] = { 0 };
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].descriptorCount = setCount;
+
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = setCount * 5;
+
+    VkDescriptorPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .poolSizeCount = 2,
+        .pPoolSizes = poolSizes,
+        .maxSets = setCount,
+    };
+
+    VkResult result = vkCreateDescriptorPool(context->device, &poolInfo, NULL, &blocks->descriptorPool);
+    checkErr(result, "failed to create block step descriptor pool!");
+
+    VkDescriptorSetLayout* layouts = (VkDescriptorSetLayout*)malloc(sizeof(VkDescriptorSetLayout) * setCount);
+    for (uint32_t i = 0; i < setCount; i++) {
+        layouts[i] = blocks->descriptorSetLayout;
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = blocks->descriptorPool,
+        .descriptorSetCount = setCount,
+        .pSetLayouts = layouts
+    };
+
+    blocks->descriptorSets = (VkDescriptorSet*)malloc(sizeof(VkDescriptorSet) * setCount);
+    result = vkAllocateDescriptorSets(context->device, &allocInfo, blocks->descriptorSets);
+    checkErr(result, "failed to allocate block step descriptor sets!");
+    free(layouts);
+
+    for (uint32_t set = 0; set < setCount; set++) {
+        uint32_t i = set / 2;
+        uint32_t input = set % 2 == 0 ? (i + context->MAX_FRAMES_IN_FLIGHT - 1) % context->MAX_FRAMES_IN_FLIGHT : i;
+
+        VkDescriptorBufferInfo bufferInfos[6] = {
+            { context->uniformBuffers[i], 0, sizeof(UniformBufferObject) },
+            { context->shaderStorageBuffers[input], 0, VK_WHOLE_SIZE },
+            { context->shaderStorageBuffers[i], 0, VK_WHOLE_SIZE },
+            { blocks->levelBuffer, 0, VK_WHOLE_SIZE },
+            { blocks->activeIndexBuffer, 0, VK_WHOLE_SIZE },
+            { blocks->stateBuffer, 0, VK_WHOLE_SIZE }
+        };
+
+        VkWriteDescriptorSet descriptorWrites[6] = { 0 };
+        for (uint32_t b = 0; b < 6; b++) {
+            descriptorWrites[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[b].dstSet = blocks->descriptorSets[set];
+            descriptorWrites[b].dstBinding = b;
+            descriptorWrites[b].dstArrayElement = 0;
+            descriptorWrites[b].descriptorType = b == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[b].descriptorCount = 1;
+            descriptorWrites[b].pBufferInfo = &bufferInfos[b];
+        }
+
+        vkUpdateDescriptorSets(context->device, 6, descriptorWrites, 0, NULL);
+    }
+}
+
+// Tick 0 computes every particle's acceleration, picks its level and gives it the opening
+// half kick. All storage buffers hold the initial state, so the latest buffer is written
+// in place of a real step. Velocities are half a kick ahead from here on, including in
+// checkpoints, so a restart repeats the opening kick.
+void initializeBlockSteps(Context* context) {
+    BlockSteps* blocks = &context->blockSteps;
+
+    VkCommandBufferAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandPool = context->computeCommandPool,
+        .commandBufferCount = 1
+    };
+
+    VkCommandBuffer commandBuffer;
+    vkAllocateCommandBuffers(context->device, &allocInfo, &commandBuffer);
+
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        vkCmdFillBuffer(commandBuffer, blocks->levelBuffer, 0, VK_WHOLE_SIZE, 0);
+        vkCmdFillBuffer(commandBuffer, blocks->stateBuffer, 0, VK_WHOLE_SIZE, 0);
+        recordBlockStepTick(context, commandBuffer, blocks->descriptorSets[2 * context->latestBuffer], 0);
+
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &commandBuffer
+    };
+
+    vkQueueSubmit(context->computeQueue, 1, &submitInfo, VK_NULL_HANDLE);
+    vkQueueWaitIdle(context->computeQueue);
+
+    vkFreeCommandBuffers(context->device, context->computeCommandPool, 1, &commandBuffer);
+}
+
+void recordBlockStepCommands(Context* context, VkCommandBuffer commandBuffer, uint32_t setIndex) {
+    uint32_t tickCount = 1u << (context->blockStepLevels - 1);
+    for (uint32_t tick = 1; tick <= tickCount; tick++) {
+        uint32_t set = 2 * setIndex + (tick == 1 ? 0 : 1);
+        recordBlockStepTick(context, commandBuffer, context->blockSteps.descriptorSets[set], tick);
+    }
+}
+
+void recordBlockStepTick(Context* context, VkCommandBuffer commandBuffer, VkDescriptorSet descriptorSet, uint32_t tick) {
+    BlockSteps* blocks = &context->blockSteps;
+    uint32_t blockCount = (context->PARTICLE_COUNT + BLOCK_STEP_BLOCK_SIZE - 1) / BLOCK_STEP_BLOCK_SIZE;
+
+    BlockStepPushConstants pushConstants = {
+        .particleCount = context->PARTICLE_COUNT,
+        .levelCount = context->blockStepLevels,
+        .tick = tick,
+        .accuracy = context->blockStepAccuracy
+    };
+
+    // The input buffer was written by the previous tick, in this or an earlier submission
+    recordComputeBarrier(commandBuffer);
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, blocks->pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+    vkCmdPushConstants(commandBuffer, blocks->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, blocks->pipelines[BLOCK_PASS_DRIFT]);
+    vkCmdDispatch(commandBuffer, blockCount, 1, 1);
+    recordComputeBarrier(commandBuffer);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, blocks->pipelines[BLOCK_PASS_DISPATCH]);
+    vkCmdDispatch(commandBuffer, 1, 1, 1);
+    recordIndirectBarrier(commandBuffer);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, blocks->pipelines[BLOCK_PASS_FORCE]);
+    vkCmdDispatchIndirect(commandBuffer, blocks->stateBuffer, 0);
+}
+
+// Like recordComputeBarrier, and also makes the dispatch pass's output visible to vkCmdDispatchIndirect
+void recordIndirectBarrier(VkCommandBuffer commandBuffer) {
+    VkMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+// Only complete steps count towards the global estimate, the device has to be idle
+void printBlockStepStats(Context* context) {
+    BlockStepState state;
+    readbackBuffer(context, context->blockSteps.stateBuffer, sizeof(BlockStepState), &state);
+
+    uint64_t evaluations = ((uint64_t)state.evaluations[1] << 32) | state.evaluations[0];
+    uint64_t globalEvaluations = ((uint64_t)state.globalEvaluations[1] << 32) | state.globalEvaluations[0];
+    printf("Block steps: %llu force evaluations, global steps on the finest level in use would need %llu (%.2lfx)\n",
+        (unsigned long long)evaluations, (unsigned long long)globalEvaluations,
+        evaluations > 0 ? (double)globalEvaluations / (double)evaluations : 0.0);
+}
+
+void cleanupBlockSteps(Context* context) {
+    BlockSteps* blocks = &context->blockSteps;
+
+    for (uint32_t i = 0; i < BLOCK_PASS_COUNT; i++) {
+        vkDestroyPipeline(context->device, blocks->pipelines[i], NULL);
+    }
+    vkDestroyPipelineLayout(context->device, blocks->pipelineLayout, NULL);
+    vkDestroyDescriptorPool(context->device, blocks->descriptorPool, NULL);
+    vkDestroyDescriptorSetLayout(context->device, blocks->descriptorSetLayout, NULL);
+
+    destroyBuffer(context, blocks->levelBuffer, blocks->levelBufferAllocation);
+    destroyBuffer(context, blocks->activeIndexBuffer, blocks->activeIndexBufferAllocation);
+    destroyBuffer(context, blocks->stateBuffer, blocks->stateBufferAllocation);
+
+    free(blocks->descriptorSets);
+}
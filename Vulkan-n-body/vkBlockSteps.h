@@ -0,0 +1,24 @@
+#ifndef VKBLOCKSTEPS_H
+#define VKBLOCKSTEPS_H
+
+#include "types.h"
+
+// Must match BLOCK_SIZE in shaders/block_common.glsl
+#define BLOCK_STEP_BLOCK_SIZE 256
+#define BLOCK_STEP_MAX_LEVELS 16
+
+void createBlockStepResources(Context* context);
+void createBlockStepDescriptorSetLayout(Context* context);
+void createBlockStepPipelines(Context* context);
+void createBlockStepBuffers(Context* context);
+void createBlockStepDescriptorSets(Context* context);
+void initializeBlockSteps(Context* context);
+
+void recordBlockStepCommands(Context* context, VkCommandBuffer commandBuffer, uint32_t setIndex);
+void recordBlockStepTick(Context* context, VkCommandBuffer commandBuffer, VkDescriptorSet descriptorSet, uint32_t tick);
+void recordIndirectBarrier(VkCommandBuffer commandBuffer);
+
+void printBlockStepStats(Context* context);
+void cleanupBlockSteps(Context* context);
+
+#endif
@@ -0,0 +1,333 @@
+#include "vkDensity.h"
+#include "vkinit.h"
+#include "vkOwnership.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// RENDER_MODE_DENSITY replaces the point draw: the graphics command buffer clears a per pixel
+// count buffer, density_splat.comp adds every particle to its pixel with an atomic, and a
+// fullscreen triangle tone maps the counts. Past a few particles per pixel this costs one
+// atomic per particle plus one read per pixel, instead of rasterizing overlapping points.
+// Every frame slot has its own count buffer, the slot's previous frame has finished by the
+// time its command buffer is submitted again.
+
+void createDensityResources(Context* context) {
+    createDensityDescriptorSetLayout(context);
+    createDensityPipelines(context);
+    createDensityBuffers(context);
+    createDensityDescriptorSets(context);
+    updateDensityDescriptorSets(context);
+}
+
+void createDensityDescriptorSetLayout(Context* context) {
+    VkDescriptorSetLayoutBinding layoutBindings[2] = { 0 };
+    for (uint32_t i = 0; i < 2; i++) {
+        layoutBindings[i].binding = i;
+        layoutBindings[i].descriptorCount = 1;
+        layoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        layoutBindings[i].pImmutableSamplers = NULL;
+    }
+    layoutBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    layoutBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = 2,
+        .pBindings = layoutBindings
+    };
+
+    VkResult result = vkCreateDescriptorSetLayout(context->device, &layoutInfo, NULL, &context->density.descriptorSetLayout);
+    checkErr(result, "failed to create density descriptor set layout!");
+}
+
+void createDensityPipelines(Context* context) {
+    DensitySplat* density = &context->density;
+
+    VkPushConstantRange pushConstantRange = {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        .offset = 0,
+        .size = sizeof(DensityPushConstants)
+    };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &density->descriptorSetLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstantRange
+    };
+
+    VkResult result = vkCreatePipelineLayout(context->device, &pipelineLayoutInfo, NULL, &density->pipelineLayout);
+    checkErr(result, "failed to create density pipeline layout!");
+
+    // Splat
+    VkShaderModule splatShaderModule = loadShaderModule(context, "density_splat");
+
+    VkComputePipelineCreateInfo computePipelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .layout = density->pipelineLayout,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = splatShaderModule,
+            .pName = "main"
+        }
+    };
+
+    result = vkCreateComputePipelines(context->device, context->pipelineCache, 1, &computePipelineInfo, NULL, &density->splatPipeline);
+    checkErr(result, "failed to create density splat pipeline!");
+
+    vkDestroyShaderModule(context->device, splatShaderModule, NULL);
+
+    // Tone map, a fullscreen triangle without vertex input
+    VkShaderModule vertShaderModule = loadShaderModule(context, "fullscreen_vert");
+    VkShaderModule fragShaderModule = loadShaderModule(context, "density_tonemap_frag");
+
+    VkPipelineShaderStageCreateInfo shaderStages[2] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_VERTEX_BIT,
+            .module = vertShaderModule,
+            .pName = "main"
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .module = fragShaderModule,
+            .pName = "main"
+        }
+    };
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO
+    };
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        .primitiveRestartEnable = VK_FALSE
+    };
+
+    VkPipelineViewportStateCreateInfo viewportState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .viewportCount = 1,
+        .scissorCount = 1,
+    };
+
+    VkPipelineRasterizationStateCreateInfo rasterizer = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .depthClampEnable = VK_FALSE,
+        .rasterizerDiscardEnable = VK_FALSE,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        .lineWidth = 1.0f,
+        .cullMode = VK_CULL_MODE_NONE,
+        .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+        .depthBiasEnable = VK_FALSE
+    };
+
+    VkPipelineMultisampleStateCreateInfo multisampling = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .sampleShadingEnable = VK_FALSE,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT
+    };
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment = {
+        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+        .blendEnable = VK_FALSE
+    };
+
+    VkPipelineColorBlendStateCreateInfo colorBlending = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .logicOpEnable = VK_FALSE,
+        .attachmentCount = 1,
+        .pAttachments = &colorBlendAttachment
+    };
+
+    VkDynamicState dynamicStates[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    VkPipelineDynamicStateCreateInfo dynamicState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount = 2,
+        .pDynamicStates = dynamicStates
+    };
+
+    VkGraphicsPipelineCreateInfo pipelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .stageCount = 2,
+        .pStages = shaderStages,
+        .pVertexInputState = &vertexInputInfo,
+        .pInputAssemblyState = &inputAssembly,
+        .pViewportState = &viewportState,
+        .pRasterizationState = &rasterizer,
+        .pMultisampleState = &multisampling,
+        .pColorBlendState = &colorBlending,
+        .pDynamicState = &dynamicState,
+        .layout = density->pipelineLayout,
+        .renderPass = context->renderPass,
+        .subpass = 0
+    };
+
+    result = vkCreateGraphicsPipelines(context->device, context->pipelineCache, 1, &pipelineInfo, NULL, &density->toneMapPipeline);
+    checkErr(result, "failed to create density tone map pipeline!");
+
+    vkDestroyShaderModule(context->device, fragShaderModule, NULL);
+    vkDestroyShaderModule(context->device, vertShaderModule, NULL);
+}
+
+// Sized to the swapchain, recreated with it
+void createDensityBuffers(Context* context) {
+    DensitySplat* density = &context->density;
+    density->width = context->swapChainExtent.width;
+    density->height = context->swapChainExtent.height;
+    density->buffers = (VkBuffer*)malloc(sizeof(VkBuffer) * context->MAX_FRAMES_IN_FLIGHT);
+    density->bufferAllocations = (Allocation*)malloc(sizeof(Allocation) * context->MAX_FRAMES_IN_FLIGHT);
+
+    for (uint32_t i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
+        createBuffer(context,
+            sizeof(uint32_t) * density->width * density->height,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            ALLOCATION_STRATEGY_FREE_LIST,
+            &density->buffers[i],
+            &density->bufferAllocations[i]);
+    }
+}
+
+void createDensityDescriptorSets(Context* context) {
+    DensitySplat* density = &context->density;
+    uint32_t setCount = context->MAX_FRAMES_IN_FLIGHT * context->MAX_FRAMES_IN_FLIGHT;
+
+    VkDescriptorPoolSize poolSize = {
+        .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = setCount * 2
+    };
+
+    VkDescriptorPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .poolSizeCount = 1,
+        .pPoolSizes = &poolSize,
+        .maxSets = setCount,
+    };
+
+    VkResult result = vkCreateDescriptorPool(context->device, &poolInfo, NULL, &density->descriptorPool);
+    checkErr(result, "failed to create density descriptor pool!");
+
+    VkDescriptorSetLayout* layouts = (VkDescriptorSetLayout*)malloc(sizeof(VkDescriptorSetLayout) * setCount);
+    for (uint32_t i = 0; i < setCount; i++) {
+        layouts[i] = density->descriptorSetLayout;
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = density->descriptorPool,
+        .descriptorSetCount = setCount,
+        .pSetLayouts = layouts
+    };
+
+    density->descriptorSets = (VkDescriptorSet*)malloc(sizeof(VkDescriptorSet) * setCount);
+    result = vkAllocateDescriptorSets(context->device, &allocInfo, density->descriptorSets);
+    checkErr(result, "failed to allocate density descriptor sets!");
+    free(layouts);
+}
+
+void updateDensityDescriptorSets(Context* context) {
+    DensitySplat* density = &context->density;
+
+    for (uint32_t frame = 0; frame < context->MAX_FRAMES_IN_FLIGHT; frame++) {
+        for (uint32_t particleBuffer = 0; particleBuffer < context->MAX_FRAMES_IN_FLIGHT; particleBuffer++) {
+            VkDescriptorBufferInfo bufferInfos[2] = {
+                { drawnParticleBuffer(context, particleBuffer), 0, VK_WHOLE_SIZE },
+                { density->buffers[frame], 0, VK_WHOLE_SIZE }
+            };
+
+            VkWriteDescriptorSet descriptorWrites[2] = { 0 };
+            for (uint32_t b = 0; b < 2; b++) {
+                descriptorWrites[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[b].dstSet = density->descriptorSets[frame * context->MAX_FRAMES_IN_FLIGHT + particleBuffer];
+                descriptorWrites[b].dstBinding = b;
+                descriptorWrites[b].dstArrayElement = 0;
+                descriptorWrites[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                descriptorWrites[b].descriptorCount = 1;
+                descriptorWrites[b].pBufferInfo = &bufferInfos[b];
+            }
+
+            vkUpdateDescriptorSets(context->device, 2, descriptorWrites, 0, NULL);
+        }
+    }
+}
+
+// The device is idle, called from recreateSwapChain
+void recreateDensityBuffers(Context* context) {
+    destroyDensityBuffers(context);
+    createDensityBuffers(context);
+    updateDensityDescriptorSets(context);
+}
+
+void destroyDensityBuffers(Context* context) {
+    DensitySplat* density = &context->density;
+    for (uint32_t i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
+        destroyBuffer(context, density->buffers[i], density->bufferAllocations[i]);
+    }
+    free(density->buffers);
+    free(density->bufferAllocations);
+}
+
+// Recorded before the render pass
+void recordDensitySplat(Context* context, VkCommandBuffer commandBuffer, uint32_t frame, uint32_t particleBuffer) {
+    DensitySplat* density = &context->density;
+    DensityPushConstants pushConstants = {
+        .width = density->width,
+        .height = density->height,
+        .particleCount = context->PARTICLE_COUNT,
+        .exposure = context->densityExposure
+    };
+
+    vkCmdFillBuffer(commandBuffer, density->buffers[frame], 0, VK_WHOLE_SIZE, 0);
+
+    VkMemoryBarrier clearBarrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, NULL, 0, NULL);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, density->splatPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, density->pipelineLayout, 0, 1, &density->descriptorSets[frame * context->MAX_FRAMES_IN_FLIGHT + particleBuffer], 0, NULL);
+    vkCmdPushConstants(commandBuffer, density->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(DensityPushConstants), &pushConstants);
+    vkCmdDispatch(commandBuffer, (context->PARTICLE_COUNT + DENSITY_BLOCK_SIZE - 1) / DENSITY_BLOCK_SIZE, 1, 1);
+
+    VkMemoryBarrier splatBarrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &splatBarrier, 0, NULL, 0, NULL);
+}
+
+// Recorded inside the render pass, viewport and scissor already set
+void recordDensityToneMap(Context* context, VkCommandBuffer commandBuffer, uint32_t frame, uint32_t particleBuffer) {
+    DensitySplat* density = &context->density;
+    DensityPushConstants pushConstants = {
+        .width = density->width,
+        .height = density->height,
+        .particleCount = context->PARTICLE_COUNT,
+        .exposure = context->densityExposure
+    };
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, density->toneMapPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, density->pipelineLayout, 0, 1, &density->descriptorSets[frame * context->MAX_FRAMES_IN_FLIGHT + particleBuffer], 0, NULL);
+    vkCmdPushConstants(commandBuffer, density->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(DensityPushConstants), &pushConstants);
+    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+}
+
+void cleanupDensity(Context* context) {
+    DensitySplat* density = &context->density;
+
+    vkDestroyPipeline(context->device, density->splatPipeline, NULL);
+    vkDestroyPipeline(context->device, density->toneMapPipeline, NULL);
+    vkDestroyPipelineLayout(context->device, density->pipelineLayout, NULL);
+    vkDestroyDescriptorPool(context->device, density->descriptorPool, NULL);
+    vkDestroyDescriptorSetLayout(context->device, density->descriptorSetLayout, NULL);
+
+    destroyDensityBuffers(context);
+    free(density->descriptorSets);
+}
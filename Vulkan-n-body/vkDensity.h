@@ -0,0 +1,22 @@
+#ifndef VKDENSITY_H
+#define VKDENSITY_H
+
+#include "types.h"
+
+#define DENSITY_BLOCK_SIZE 256
+
+void createDensityResources(Context* context);
+void createDensityDescriptorSetLayout(Context* context);
+void createDensityPipelines(Context* context);
+void createDensityBuffers(Context* context);
+void createDensityDescriptorSets(Context* context);
+void updateDensityDescriptorSets(Context* context);
+void recreateDensityBuffers(Context* context);
+void destroyDensityBuffers(Context* context);
+
+void recordDensitySplat(Context* context, VkCommandBuffer commandBuffer, uint32_t frame, uint32_t particleBuffer);
+void recordDensityToneMap(Context* context, VkCommandBuffer commandBuffer, uint32_t frame, uint32_t particleBuffer);
+
+void cleanupDensity(Context* context);
+
+#endif
@@ -1,11 +1,21 @@
 #include "vkDraw.h"
 #include "vkinit.h"
-
+#include "vkBarnesHut.h"
+#include "vkBlockSteps.h"
+#include "vkParticleMesh.h"
+#include "vkTimeStep.h"
+#include "vkRenderStream.h"
+#include "vkDensity.h"
+#include "vkOwnership.h"
+#include "platform.h"
+#include "profiler.h"
+
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-void recordCommandBuffer(Context* context, VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+void recordCommandBuffer(Context* context, VkCommandBuffer commandBuffer, uint32_t frame, uint32_t imageIndex, uint32_t particleBuffer) {
     VkCommandBufferBeginInfo beginInfo = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
         .flags = 0, // Optional
@@ -25,9 +35,18 @@ void recordCommandBuffer(Context* context, VkCommandBuffer commandBuffer, uint32
         .pClearValues = &clearColor
     };
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    // starts once the wait for the compute results is satisfied
+    profilerBegin(context, commandBuffer, PROFILER_STAGE_RENDER, frame, context->renderMode == RENDER_MODE_DENSITY ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+
+    if (context->ownership.transfers) {
+        recordGraphicsAcquire(context, commandBuffer, particleBuffer);
+    }
 
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, context->graphicsPipeline);
+    if (context->renderMode == RENDER_MODE_DENSITY) {
+        recordDensitySplat(context, commandBuffer, frame, particleBuffer);
+    }
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
         VkViewport viewport = {
             .x = 0.0f,
@@ -45,72 +64,106 @@ void recordCommandBuffer(Context* context, VkCommandBuffer commandBuffer, uint32
         vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
         VkDeviceSize offsets[] = { 0 };
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &context->shaderStorageBuffers[context->currentFrame], offsets);
-
-        // Draw command
-        vkCmdDraw(commandBuffer, context->PARTICLE_COUNT, 1, 0, 0);
+        if (context->renderMode == RENDER_MODE_DENSITY) {
+            recordDensityToneMap(context, commandBuffer, frame, particleBuffer);
+        }
+        else if (context->renderStreamStride > 0) {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, context->graphicsPipeline);
+            vkCmdBindVertexBuffers(commandBuffer, 0, 1, &context->renderStream.buffers[particleBuffer], offsets);
+
+            vkCmdDraw(commandBuffer, context->renderStream.vertexCount, 1, 0, 0);
+        }
+        else {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, context->graphicsPipeline);
+            VkBuffer drawnBuffer = drawnParticleBuffer(context, particleBuffer);
+            vkCmdBindVertexBuffers(commandBuffer, 0, 1, &drawnBuffer, offsets);
+
+            // Draw command
+            vkCmdDraw(commandBuffer, context->PARTICLE_COUNT, 1, 0, 0);
+        }
 
     vkCmdEndRenderPass(commandBuffer);
+
+    profilerEnd(context, commandBuffer, PROFILER_STAGE_RENDER, frame);
+
     result = vkEndCommandBuffer(commandBuffer);
     checkErr(result, "failed to record command buffer!");
 }
 
 void drawFrame(Context* context) {
-    VkSubmitInfo submitInfo = {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO
-    };
-
     // Compute submission
-    vkWaitForFences(context->device, 1, &context->computeInFlightFences[context->currentFrame], VK_TRUE, UINT64_MAX);
+    submitComputeSteps(context, context->substeps);
+    uint64_t frame = context->submissionCount;
 
-    updateUniformBuffer(context->timeStep, context->uniformBuffersMapped, context->currentFrame);
-
-    vkResetFences(context->device, 1, &context->computeInFlightFences[context->currentFrame]);
-
-    vkResetCommandBuffer(context->computeCommandBuffers[context->currentFrame], 0);
-    recordComputeCommandBuffer(context, context->computeCommandBuffers[context->currentFrame]);
-
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &context->computeCommandBuffers[context->currentFrame];
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &context->computeFinishedSemaphores[context->currentFrame];
-
-    VkResult result = vkQueueSubmit(context->computeQueue, 1, &submitInfo, context->computeInFlightFences[context->currentFrame]);
-    checkErr(result, "failed to submit compute command buffer!");
-
-
-    // Graphics submission
-    vkWaitForFences(context->device, 1, &context->inFlightFences[context->currentFrame], VK_TRUE, UINT64_MAX);
+    // Graphics submission, the command buffer of this slot was last submitted MAX_FRAMES_IN_FLIGHT frames ago
+    if (frame > context->MAX_FRAMES_IN_FLIGHT) {
+        waitTimeline(context->device, context->graphicsTimeline, frame - context->MAX_FRAMES_IN_FLIGHT);
+    }
+    profilerCollect(context, PROFILER_STAGE_RENDER, context->currentFrame);
 
     uint32_t imageIndex;
-    result = vkAcquireNextImageKHR(context->device, context->swapChain, UINT64_MAX, context->imageAvailableSemaphores[context->currentFrame], VK_NULL_HANDLE, &imageIndex);
+    VkResult result = vkAcquireNextImageKHR(context->device, context->swapChain, UINT64_MAX, context->imageAvailableSemaphores[context->currentFrame], VK_NULL_HANDLE, &imageIndex);
     if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+        // Later compute submissions wait for this frame's value, so signal it without drawing
+        VkTimelineSemaphoreSubmitInfo timelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &frame
+        };
+        VkSubmitInfo signalInfo = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timelineInfo,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &context->graphicsTimeline
+        };
+        result = vkQueueSubmit(context->graphicsQueue, 1, &signalInfo, VK_NULL_HANDLE);
+        checkErr(result, "failed to signal graphics timeline!");
+
         recreateSwapChain(context);
+        context->currentFrame = (context->currentFrame + 1) % context->MAX_FRAMES_IN_FLIGHT;
         return;
     }
     else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
         printf("failed to acquire swap chain image!");
         exit(1);
     }
-    vkResetFences(context->device, 1, &context->inFlightFences[context->currentFrame]);
 
-    vkResetCommandBuffer(context->commandBuffers[context->currentFrame], 0);
-    recordCommandBuffer(context, context->commandBuffers[context->currentFrame], imageIndex);
+    double recordStart = getTime();
+    uint32_t commandBufferIndex = graphicsCommandBufferIndex(context, context->currentFrame, imageIndex, context->latestBuffer);
+    VkCommandBuffer commandBuffer = context->commandBuffers[commandBufferIndex];
+    if (!context->commandBuffersRecorded[commandBufferIndex] || !context->reuseCommandBuffers) {
+        vkResetCommandBuffer(commandBuffer, 0);
+        recordCommandBuffer(context, commandBuffer, context->currentFrame, imageIndex, context->latestBuffer);
+        context->commandBuffersRecorded[commandBufferIndex] = true;
+    }
 
-    VkSemaphore waitSemaphores[2] = { context->computeFinishedSemaphores[context->currentFrame], context->imageAvailableSemaphores[context->currentFrame] };
-    VkPipelineStageFlags waitStages[2] = { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+    VkSemaphore waitSemaphores[2] = { context->computeTimeline, context->imageAvailableSemaphores[context->currentFrame] };
+    uint64_t waitValues[2] = { frame, 0 };
+    VkPipelineStageFlags waitStages[2] = { renderWaitStages(context), VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+    VkSemaphore signalSemaphores[2] = { context->graphicsTimeline, context->renderFinishedSemaphores[context->currentFrame] };
+    uint64_t signalValues[2] = { frame, 0 };
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .waitSemaphoreValueCount = 2,
+        .pWaitSemaphoreValues = waitValues,
+        .signalSemaphoreValueCount = 2,
+        .pSignalSemaphoreValues = signalValues
+    };
     VkSubmitInfo submitInfo2 = {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timelineInfo,
         .waitSemaphoreCount = 2,
         .pWaitSemaphores = waitSemaphores,
         .pWaitDstStageMask = waitStages,
         .commandBufferCount = 1,
-        .pCommandBuffers = &context->commandBuffers[context->currentFrame],
-        .signalSemaphoreCount = 1,
-        .pSignalSemaphores = &context->renderFinishedSemaphores[context->currentFrame]
+        .pCommandBuffers = &commandBuffer,
+        .signalSemaphoreCount = 2,
+        .pSignalSemaphores = signalSemaphores
     };
-    result = vkQueueSubmit(context->graphicsQueue, 1, &submitInfo2, context->inFlightFences[context->currentFrame]);
+    result = vkQueueSubmit(context->graphicsQueue, 1, &submitInfo2, VK_NULL_HANDLE);
     checkErr(result, "failed to submit draw command buffer!");
+    context->recordSubmitTime += getTime() - recordStart;
+    profilerSubmitted(context, PROFILER_STAGE_RENDER, context->currentFrame);
 
     VkSwapchainKHR swapChains[] = { context->swapChain };
     VkPresentInfoKHR presentInfo = {
@@ -136,6 +189,95 @@ void drawFrame(Context* context) {
     context->currentFrame = (context->currentFrame + 1) % context->MAX_FRAMES_IN_FLIGHT;
 }
 
+// Records and submits stepCount simulation steps for the current frame slot. Submission n
+// signals n on computeTimeline.
+void submitComputeSteps(Context* context, uint32_t stepCount) {
+    uint64_t submission = context->submissionCount + 1;
+
+    // The command buffer of this slot was last submitted MAX_FRAMES_IN_FLIGHT submissions ago
+    if (submission > context->MAX_FRAMES_IN_FLIGHT) {
+        waitTimeline(context->device, context->computeTimeline, submission - context->MAX_FRAMES_IN_FLIGHT);
+    }
+    profilerCollect(context, PROFILER_STAGE_COMPUTE, context->currentFrame);
+
+    // Recorded once per (slot, first input buffer) and resubmitted unless the step count changes,
+    // which only happens for the last batch of a headless run
+    double recordStart = getTime();
+    uint32_t commandBufferIndex = context->currentFrame * context->MAX_FRAMES_IN_FLIGHT + context->latestBuffer;
+    VkCommandBuffer commandBuffer = context->computeCommandBuffers[commandBufferIndex];
+    if (context->computeCommandBufferSteps[commandBufferIndex] != stepCount || !context->reuseCommandBuffers) {
+        vkResetCommandBuffer(commandBuffer, 0);
+        recordComputeCommandBuffer(context, commandBuffer, context->currentFrame, context->latestBuffer, stepCount);
+        context->computeCommandBufferSteps[commandBufferIndex] = stepCount;
+    }
+
+    // A single step writes the buffer drawn two frames ago and only reads the one being drawn
+    // now, so it overlaps with the previous frame's rendering. More steps also overwrite the
+    // buffer being drawn and have to wait for the previous frame. With separate families the
+    // same holds for the draw copy the submission overwrites, see vkOwnership.c.
+    uint64_t drawnFrame = stepCount > 1 ? submission - 1 : (submission > 2 ? submission - 2 : 0);
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .waitSemaphoreValueCount = 1,
+        .pWaitSemaphoreValues = &drawnFrame,
+        .signalSemaphoreValueCount = 1,
+        .pSignalSemaphoreValues = &submission
+    };
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timelineInfo,
+        .waitSemaphoreCount = 1,
+        .pWaitSemaphores = &context->graphicsTimeline,
+        .pWaitDstStageMask = &waitStage,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &commandBuffer,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &context->computeTimeline
+    };
+    if (context->headless) {
+        submitInfo.waitSemaphoreCount = 0;
+        timelineInfo.waitSemaphoreValueCount = 0;
+    }
+
+    VkResult result = vkQueueSubmit(context->computeQueue, 1, &submitInfo, VK_NULL_HANDLE);
+    checkErr(result, "failed to submit compute command buffer!");
+    context->recordSubmitTime += getTime() - recordStart;
+    profilerSubmitted(context, PROFILER_STAGE_COMPUTE, context->currentFrame);
+
+    context->latestBuffer = (context->latestBuffer + stepCount) % context->MAX_FRAMES_IN_FLIGHT;
+    context->submissionCount = submission;
+    context->stepIndex += stepCount;
+    // with an adaptive time step only the GPU knows the time, see recordTimeStepReadback
+    if (!context->adaptiveTimeStep) {
+        context->simulationTime += stepCount * (double)context->timeStep;
+    }
+}
+
+// First stages of the graphics submission that read the compute results. The density splat
+// reads the particles in a compute shader, after clearing its buffer.
+VkPipelineStageFlags renderWaitStages(Context* context) {
+    if (context->renderMode == RENDER_MODE_DENSITY) {
+        return VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    }
+    return VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+}
+
+uint32_t graphicsCommandBufferIndex(Context* context, uint32_t frame, uint32_t imageIndex, uint32_t particleBuffer) {
+    return (frame * context->swapChainImageCount + imageIndex) * context->MAX_FRAMES_IN_FLIGHT + particleBuffer;
+}
+
+void waitTimeline(VkDevice device, VkSemaphore timeline, uint64_t value) {
+    VkSemaphoreWaitInfo waitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .semaphoreCount = 1,
+        .pSemaphores = &timeline,
+        .pValues = &value
+    };
+    vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+}
+
 void updateUniformBuffer(float timeStep, void** uniformBuffersMapped, uint32_t currentImage) {
     UniformBufferObject ubo = {
         .deltaTime = timeStep
@@ -157,9 +299,18 @@ void recreateSwapChain(Context* context) {
 
     cleanupSwapChain(context);
 
+    uint32_t commandBufferCount = context->MAX_FRAMES_IN_FLIGHT * context->swapChainImageCount * context->MAX_FRAMES_IN_FLIGHT;
+    vkFreeCommandBuffers(context->device, context->commandPool, commandBufferCount, context->commandBuffers);
+    free(context->commandBuffers);
+    free(context->commandBuffersRecorded);
+
     createSwapChain(context);
     createImageViews(context);
     createFramebuffers(context);
+    if (context->renderMode == RENDER_MODE_DENSITY) {
+        recreateDensityBuffers(context);
+    }
+    createCommandBuffers(context);
 }
 
 void cleanupSwapChain(Context* context) {
@@ -172,7 +323,9 @@ void cleanupSwapChain(Context* context) {
     vkDestroySwapchainKHR(context->device, context->swapChain, NULL);
 }
 
-void recordComputeCommandBuffer(Context* context, VkCommandBuffer commandBuffer) {
+// Records stepCount steps that ping-pong between the two storage buffers, the first one
+// reading firstInput. Descriptor set i reads the other buffer and writes buffer i.
+void recordComputeCommandBuffer(Context* context, VkCommandBuffer commandBuffer, uint32_t frame, uint32_t firstInput, uint32_t stepCount) {
     VkCommandBufferBeginInfo beginInfo = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO
     };
@@ -180,12 +333,149 @@ void recordComputeCommandBuffer(Context* context, VkCommandBuffer commandBuffer)
     VkResult result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
     checkErr(result, "failed to begin recording compute command buffer!");
 
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context->computePipeline);
+    // starts once the wait for the graphics timeline is satisfied
+    profilerBegin(context, commandBuffer, PROFILER_STAGE_COMPUTE, frame, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    for (uint32_t step = 0; step < stepCount; step++) {
+        uint32_t setIndex = (firstInput + step + 1) % context->MAX_FRAMES_IN_FLIGHT;
+
+        if (context->computeKernel == COMPUTE_KERNEL_BARNES_HUT) {
+            recordBarnesHutCommands(context, commandBuffer, setIndex);
+        }
+        else if (context->computeKernel == COMPUTE_KERNEL_BLOCK_STEPS) {
+            recordBlockStepCommands(context, commandBuffer, setIndex);
+        }
+        else if (context->computeKernel == COMPUTE_KERNEL_PARTICLE_MESH) {
+            recordParticleMeshCommands(context, commandBuffer, setIndex);
+        }
+        else {
+            recordDirectStep(context, commandBuffer, setIndex);
+        }
+    }
 
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context->computePipelineLayout, 0, 1, &context->computeDescriptorSets[context->currentFrame], 0, NULL);
+    // only the final state of the submission is drawn
+    if (context->renderStreamStride > 0 && !context->headless) {
+        recordRenderStreamCommands(context, commandBuffer, (firstInput + stepCount) % context->MAX_FRAMES_IN_FLIGHT);
+    }
+    if (context->ownership.transfers) {
+        recordDrawHandoff(context, commandBuffer, (firstInput + stepCount) % context->MAX_FRAMES_IN_FLIGHT);
+    }
 
-    vkCmdDispatch(commandBuffer, context->PARTICLE_COUNT / 256, 1, 1);
+    profilerEnd(context, commandBuffer, PROFILER_STAGE_COMPUTE, frame);
 
     result = vkEndCommandBuffer(commandBuffer);
     checkErr(result, "failed to record compute command buffer!");
-}
\ No newline at end of file
+}
+
+// One step of the direct kernel writing shaderStorageBuffers[setIndex]. Yoshida's first
+// substep writes the output buffer as well, the second moves the state to the scratch
+// buffers and the third back, so the buffer the graphics queue draws is never written.
+void recordDirectStep(Context* context, VkCommandBuffer commandBuffer, uint32_t setIndex) {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context->computePipeline);
+
+    uint32_t substepCount = integratorSubstepCount(context->integrator);
+    for (uint32_t substep = 0; substep < substepCount; substep++) {
+        // The input buffer was written by the previous (sub)step, in this or an earlier submission
+        recordComputeBarrier(commandBuffer);
+
+        VkDescriptorSet descriptorSet = substep == 0 ? context->computeDescriptorSets[setIndex] : context->substepDescriptorSets[2 * setIndex + substep - 1];
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context->computePipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+
+        IntegratorPushConstants pushConstants = {
+            .stepScale = integratorStepScale(context->integrator, substep)
+        };
+        vkCmdPushConstants(commandBuffer, context->computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(IntegratorPushConstants), &pushConstants);
+
+        vkCmdDispatch(commandBuffer, computeGroupCount(context->PARTICLE_COUNT, context->computeTuning), 1, 1);
+    }
+
+    // all substeps of a step use the same step
+    if (context->adaptiveTimeStep) {
+        recordTimeStepUpdate(context, commandBuffer, setIndex, true);
+    }
+}
+
+uint32_t integratorSubstepCount(Integrator integrator) {
+    return integrator == INTEGRATOR_YOSHIDA ? 3 : 1;
+}
+
+// Yoshida (1990): leapfrog substeps of w1, w0, w1 times the step with
+// w1 = 1 / (2 - 2^(1/3)) and w0 = 1 - 2 w1, the middle one runs backwards in time.
+float integratorStepScale(Integrator integrator, uint32_t substep) {
+    if (integrator != INTEGRATOR_YOSHIDA) {
+        return 1.0f;
+    }
+    const float w1 = 1.35120719195965763f;
+    const float w0 = -1.70241438391931527f;
+    return substep == 1 ? w0 : w1;
+}
+
+// Makes compute and transfer writes visible to the following compute and transfer commands.
+void recordComputeBarrier(VkCommandBuffer commandBuffer) {
+    VkMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT
+    };
+    VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+    vkCmdPipelineBarrier(commandBuffer, stages, stages, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+// The comparisons against the direct kernel (compareBarnesHutWithDirect and
+// compareParticleMeshWithDirect) record each method's step from the state in the last
+// storage buffer into compute command buffer 0, between these two.
+VkCommandBuffer beginComparisonStep(Context* context) {
+    VkCommandBuffer commandBuffer = context->computeCommandBuffers[0];
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO
+    };
+    vkResetCommandBuffer(commandBuffer, 0);
+    VkResult result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    checkErr(result, "failed to begin recording compute command buffer!");
+    return commandBuffer;
+}
+
+// Runs the recorded step once and reads the result back, then runs it TIMED_STEPS more times
+// and returns the wall clock ms per step. Every run starts from the same state: the step only
+// writes buffer 0, which is restored from the last buffer before returning.
+double runComparisonStep(Context* context, VkCommandBuffer commandBuffer, Particle* stepped) {
+    const uint32_t TIMED_STEPS = 10;
+    VkDeviceSize bufferSize = sizeof(Particle) * context->PARTICLE_COUNT;
+
+    VkResult result = vkEndCommandBuffer(commandBuffer);
+    checkErr(result, "failed to record compute command buffer!");
+
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &commandBuffer
+    };
+
+    vkQueueSubmit(context->computeQueue, 1, &submitInfo, VK_NULL_HANDLE);
+    vkQueueWaitIdle(context->computeQueue);
+    readbackBuffer(context, context->shaderStorageBuffers[0], bufferSize, stepped);
+
+    double start = getTime();
+    for (uint32_t step = 0; step < TIMED_STEPS; step++) {
+        vkQueueSubmit(context->computeQueue, 1, &submitInfo, VK_NULL_HANDLE);
+        vkQueueWaitIdle(context->computeQueue);
+    }
+    double msPerStep = (getTime() - start) * 1e3 / TIMED_STEPS;
+
+    copyBuffer(context, context->shaderStorageBuffers[context->MAX_FRAMES_IN_FLIGHT - 1], context->shaderStorageBuffers[0], bufferSize);
+    return msPerStep;
+}
+
+// Relative rms difference of the velocity kicks from initial to stepped and to reference
+double relativeKickError(const Particle* initial, const Particle* reference, const Particle* stepped, uint32_t count) {
+    double errorSquared = 0.0;
+    double normSquared = 0.0;
+    for (uint32_t i = 0; i < count; i++) {
+        double referenceX = reference[i].vel.x - initial[i].vel.x;
+        double referenceY = reference[i].vel.y - initial[i].vel.y;
+        double errorX = stepped[i].vel.x - reference[i].vel.x;
+        double errorY = stepped[i].vel.y - reference[i].vel.y;
+        errorSquared += errorX * errorX + errorY * errorY;
+        normSquared += referenceX * referenceX + referenceY * referenceY;
+    }
+    return normSquared > 0.0 ? sqrt(errorSquared / normSquared) : 0.0;
+}
@@ -3,15 +3,27 @@
 
 #include "types.h"
 
-void recordCommandBuffer(Context* app, VkCommandBuffer commandBuffer, uint32_t imageIndex);
+void recordCommandBuffer(Context* app, VkCommandBuffer commandBuffer, uint32_t frame, uint32_t imageIndex, uint32_t particleBuffer);
 
 void drawFrame(Context* app);
+void submitComputeSteps(Context* context, uint32_t stepCount);
+VkPipelineStageFlags renderWaitStages(Context* context);
+uint32_t graphicsCommandBufferIndex(Context* context, uint32_t frame, uint32_t imageIndex, uint32_t particleBuffer);
+void waitTimeline(VkDevice device, VkSemaphore timeline, uint64_t value);
 void updateUniformBuffer(float timeStep, void** uniformBuffersMapped, uint32_t currentImage);
 
 void cleanupSwapChain(Context* app);
 
 void recreateSwapChain(Context* app);
 
-void recordComputeCommandBuffer(Context* context, VkCommandBuffer commandBuffer);
+void recordComputeCommandBuffer(Context* context, VkCommandBuffer commandBuffer, uint32_t frame, uint32_t firstInput, uint32_t stepCount);
+void recordDirectStep(Context* context, VkCommandBuffer commandBuffer, uint32_t setIndex);
+uint32_t integratorSubstepCount(Integrator integrator);
+float integratorStepScale(Integrator integrator, uint32_t substep);
+void recordComputeBarrier(VkCommandBuffer commandBuffer);
+
+VkCommandBuffer beginComparisonStep(Context* context);
+double runComparisonStep(Context* context, VkCommandBuffer commandBuffer, Particle* stepped);
+double relativeKickError(const Particle* initial, const Particle* reference, const Particle* stepped, uint32_t count);
 
 #endif
\ No newline at end of file
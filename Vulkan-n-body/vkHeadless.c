@@ -0,0 +1,144 @@
+#include "vkHeadless.h"
+#include "vkinit.h"
+#include "vkAllocator.h"
+#include "vkStaging.h"
+#include "vkAutotune.h"
+#include "vkPipelineCache.h"
+#include "vkDraw.h"
+#include "vkBarnesHut.h"
+#include "vkBlockSteps.h"
+#include "vkParticleMesh.h"
+#include "vkTimeStep.h"
+#include "platform.h"
+#include "profiler.h"
+#include "checkpoint.h"
+#include "trajectory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Same as initVulkan without the window, surface, swapchain and graphics pipeline.
+// Any queue family with compute support is accepted.
+void initVulkanHeadless(Context* context) {
+    context->startTime = getTime();
+    createInstance(context);
+    setupDebugMessenger(context);
+    pickPhysicalDevice(context);
+    createLogicalDevice(context);
+    createAllocator(context);
+    if (context->pipelineCachePath != NULL) {
+        createPipelineCache(context);
+    }
+    createComputeDescriptorSetLayout(context);
+    createCommandPool(context);
+    createStagingRing(context);
+    createShaderStorageBuffers(context);
+    createUniformBuffers(context);
+    if (context->adaptiveTimeStep) {
+        createTimeStepResources(context);
+    }
+    if (context->autotune && (context->computeKernel == COMPUTE_KERNEL_REFERENCE || context->computeKernel == COMPUTE_KERNEL_TILED)) {
+        autotuneComputeKernel(context);
+    }
+    createComputePipeline(context);
+    createDescriptorPool(context);
+    createComputeDescriptorSets(context);
+    createComputeCommandBuffers(context);
+    if (context->integrator != INTEGRATOR_EULER) {
+        initializeAccelerations(context);
+    }
+    createSyncObjects(context);
+    createProfiler(context);
+    if (context->checkpointInterval > 0) {
+        createCheckpointWriter(context);
+    }
+    if (context->trajectoryInterval > 0) {
+        createTrajectoryWriter(context);
+    }
+
+    if (context->computeKernel == COMPUTE_KERNEL_BARNES_HUT) {
+        createBarnesHutResources(context);
+        if (context->compareWithDirect) {
+            compareBarnesHutWithDirect(context);
+        }
+    }
+    if (context->computeKernel == COMPUTE_KERNEL_BLOCK_STEPS) {
+        createBlockStepResources(context);
+    }
+    if (context->computeKernel == COMPUTE_KERNEL_PARTICLE_MESH) {
+        createParticleMeshResources(context);
+        if (context->compareWithDirect) {
+            compareParticleMeshWithDirect(context);
+        }
+    }
+
+    if (context->printStats) {
+        printAllocatorStats(&context->allocator);
+    }
+}
+
+// Submits stepCount compute steps back to back, substeps per submission. Nothing is
+// presented, so the only throttling is waiting for the submission MAX_FRAMES_IN_FLIGHT back.
+void runHeadless(Context* context) {
+    Particle* snapshot = NULL;
+    if (context->snapshotCallback != NULL && context->snapshotInterval > 0) {
+        snapshot = (Particle*)malloc(context->PARTICLE_COUNT * sizeof(Particle));
+    }
+
+    printf("Headless: %u particles, %u steps, %u substeps per submission\n", context->PARTICLE_COUNT, context->stepCount, context->substeps);
+
+    double interactionsPerStep = (double)context->PARTICLE_COUNT * (double)context->PARTICLE_COUNT;
+    double startTime = getTime();
+    double submitTime = startTime;
+    double totalRecordSubmitTime = 0.0;
+    uint32_t step = 0;
+    while (step < context->stepCount) {
+        uint32_t batch = context->stepCount - step < context->substeps ? context->stepCount - step : context->substeps;
+        context->recordSubmitTime = 0.0;
+        submitComputeSteps(context, batch);
+        totalRecordSubmitTime += context->recordSubmitTime;
+        if (context->printStats && context->startTime > 0.0) {
+            profilerFirstStep(context);
+        }
+        context->currentFrame = (context->currentFrame + 1) % context->MAX_FRAMES_IN_FLIGHT;
+        if (context->checkpointInterval > 0) {
+            updateCheckpoints(context);
+        }
+        if (context->trajectoryInterval > 0) {
+            updateTrajectory(context);
+        }
+
+        // a batch can step over a multiple of the interval without landing on it
+        if (snapshot != NULL && (context->stepIndex - batch) / context->snapshotInterval != context->stepIndex / context->snapshotInterval) {
+            readbackParticles(context, snapshot);
+            context->snapshotCallback(context, snapshot, context->stepIndex);
+        }
+        step += batch;
+
+        double now = getTime();
+        if (context->printStats) {
+            rollingStatsAdd(&context->profiler.frameTime, (now - submitTime) * 1000.0);
+            rollingStatsAdd(&context->profiler.recordSubmitTime, context->recordSubmitTime * 1000.0);
+            profilerPrint(context, now);
+        }
+        submitTime = now;
+    }
+    vkDeviceWaitIdle(context->device);
+
+    double elapsed = getTime() - startTime;
+    if (context->stepCount > 0 && elapsed > 0.0) {
+        double stepsPerSecond = context->stepCount / elapsed;
+        uint32_t submissions = (context->stepCount + context->substeps - 1) / context->substeps;
+        printf("%u steps in %.2lf s\t steps/s: %.1lf\t interactions/s: %.3e\t record+submit: ms %.3lf\n", context->stepCount, elapsed, stepsPerSecond, stepsPerSecond * interactionsPerStep, totalRecordSubmitTime * 1000.0 / submissions);
+    }
+
+    free(snapshot);
+}
+
+// Copies the particles written by the most recently submitted compute step into dst.
+// Blocks until that step has finished; works in windowed mode as well.
+void readbackParticles(Context* context, Particle* dst) {
+    waitTimeline(context->device, context->computeTimeline, context->submissionCount);
+
+    readbackBuffer(context, context->shaderStorageBuffers[context->latestBuffer], sizeof(Particle) * context->PARTICLE_COUNT, dst);
+}
@@ -0,0 +1,10 @@
+#ifndef VKHEADLESS_H
+#define VKHEADLESS_H
+
+#include "types.h"
+
+void initVulkanHeadless(Context* context);
+void runHeadless(Context* context);
+void readbackParticles(Context* context, Particle* dst);
+
+#endif
@@ -0,0 +1,164 @@
+#include "vkOwnership.h"
+#include "vkinit.h"
+#include "vkDraw.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Every buffer uses exclusive sharing. The storage buffers the steps ping-pong between never
+// leave the compute family. When the graphics queue is in another family it draws a copy:
+// at the end of each compute submission the final state is copied into drawCopies[i] (or
+// packed into the render stream, which already is a separate buffer) and released to the
+// graphics family, whose command buffer acquires it before drawing.
+//
+// The copy is never handed back. The next compute submission writing it overwrites all of it,
+// so it takes ownership without a transfer, which only leaves the old contents undefined.
+// The timeline waits of submitComputeSteps already keep that write behind the frame drawing
+// the copy, so step n+1 overlaps frame n exactly as with a single family. The price is one
+// buffer copy per submission and the memory of the copies.
+
+void createOwnershipResources(Context* context) {
+    QueueOwnership* ownership = &context->ownership;
+    ownership->transfers = context->queueFamilyIndices.computeFamily != context->queueFamilyIndices.graphicsFamily;
+    if (!ownership->transfers || drawsRenderStream(context)) {
+        return;
+    }
+
+    ownership->drawCopies = (VkBuffer*)malloc(sizeof(VkBuffer) * context->MAX_FRAMES_IN_FLIGHT);
+    ownership->drawCopyAllocations = (Allocation*)malloc(sizeof(Allocation) * context->MAX_FRAMES_IN_FLIGHT);
+    for (uint32_t i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
+        createBuffer(context,
+            sizeof(Particle) * context->PARTICLE_COUNT,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            ALLOCATION_STRATEGY_LINEAR,
+            &ownership->drawCopies[i],
+            &ownership->drawCopyAllocations[i]);
+    }
+}
+
+void destroyOwnershipResources(Context* context) {
+    QueueOwnership* ownership = &context->ownership;
+    if (!ownership->transfers || drawsRenderStream(context)) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
+        destroyBuffer(context, ownership->drawCopies[i], ownership->drawCopyAllocations[i]);
+    }
+    free(ownership->drawCopies);
+    free(ownership->drawCopyAllocations);
+}
+
+// The density splat reads the particles themselves, the render stream isn't drawn then
+bool drawsRenderStream(Context* context) {
+    return context->renderMode != RENDER_MODE_DENSITY && context->renderStreamStride > 0;
+}
+
+// The buffer recordCommandBuffer reads for particle buffer i, see renderWaitStages
+VkBuffer drawnParticleBuffer(Context* context, uint32_t particleBuffer) {
+    if (drawsRenderStream(context)) {
+        return context->renderStream.buffers[particleBuffer];
+    }
+    if (context->ownership.transfers) {
+        return context->ownership.drawCopies[particleBuffer];
+    }
+    return context->shaderStorageBuffers[particleBuffer];
+}
+
+VkAccessFlags drawnBufferAccess(Context* context) {
+    if (context->renderMode == RENDER_MODE_DENSITY) {
+        return VK_ACCESS_SHADER_READ_BIT;
+    }
+    return VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+}
+
+// One half of a queue family ownership transfer: the release when recorded on srcFamily's
+// queue, the acquire on dstFamily's. Both halves name the same families and buffer range.
+void recordOwnershipBarrier(VkCommandBuffer commandBuffer, VkBuffer buffer, uint32_t srcFamily, uint32_t dstFamily,
+    VkPipelineStageFlags srcStages, VkAccessFlags srcAccess, VkPipelineStageFlags dstStages, VkAccessFlags dstAccess) {
+    VkBufferMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = srcAccess,
+        .dstAccessMask = dstAccess,
+        .srcQueueFamilyIndex = srcFamily,
+        .dstQueueFamilyIndex = dstFamily,
+        .buffer = buffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE
+    };
+    vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, NULL, 1, &barrier, 0, NULL);
+}
+
+// Recorded at the end of a compute submission whose last step wrote particle buffer i. The
+// render stream was packed just before, otherwise the state is copied into the draw copy.
+void recordDrawHandoff(Context* context, VkCommandBuffer commandBuffer, uint32_t particleBuffer) {
+    if (!drawsRenderStream(context)) {
+        VkMemoryBarrier stepBarrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT
+        };
+        VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+        vkCmdPipelineBarrier(commandBuffer, stages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &stepBarrier, 0, NULL, 0, NULL);
+
+        VkBufferCopy copyRegion = {
+            .size = sizeof(Particle) * context->PARTICLE_COUNT
+        };
+        vkCmdCopyBuffer(commandBuffer, context->shaderStorageBuffers[particleBuffer], context->ownership.drawCopies[particleBuffer], 1, &copyRegion);
+    }
+
+    recordOwnershipBarrier(commandBuffer, drawnParticleBuffer(context, particleBuffer),
+        context->queueFamilyIndices.computeFamily, context->queueFamilyIndices.graphicsFamily,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+}
+
+// The stages match the wait on computeTimeline in drawFrame
+void recordGraphicsAcquire(Context* context, VkCommandBuffer commandBuffer, uint32_t particleBuffer) {
+    VkPipelineStageFlags stages = renderWaitStages(context);
+    recordOwnershipBarrier(commandBuffer, drawnParticleBuffer(context, particleBuffer),
+        context->queueFamilyIndices.computeFamily, context->queueFamilyIndices.graphicsFamily,
+        stages, 0,
+        stages, drawnBufferAccess(context));
+}
+
+// Acquire half of releaseStagedBuffers. The staging fences have already been waited on, so
+// the release has executed before this is submitted.
+void acquireTransferredBuffers(Context* context, const VkBuffer* buffers, uint32_t bufferCount) {
+    VkCommandBufferAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandPool = context->computeCommandPool,
+        .commandBufferCount = 1
+    };
+
+    VkCommandBuffer commandBuffer;
+    vkAllocateCommandBuffers(context->device, &allocInfo, &commandBuffer);
+
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+        for (uint32_t i = 0; i < bufferCount; i++) {
+            recordOwnershipBarrier(commandBuffer, buffers[i],
+                context->queueFamilyIndices.transferFamily, context->queueFamilyIndices.computeFamily,
+                stages, 0,
+                stages, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+        }
+
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &commandBuffer
+    };
+
+    vkQueueSubmit(context->computeQueue, 1, &submitInfo, VK_NULL_HANDLE);
+    vkQueueWaitIdle(context->computeQueue);
+
+    vkFreeCommandBuffers(context->device, context->computeCommandPool, 1, &commandBuffer);
+}
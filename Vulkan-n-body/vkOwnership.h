@@ -0,0 +1,20 @@
+#ifndef VKOWNERSHIP_H
+#define VKOWNERSHIP_H
+
+#include "types.h"
+
+void createOwnershipResources(Context* context);
+void destroyOwnershipResources(Context* context);
+
+bool drawsRenderStream(Context* context);
+VkBuffer drawnParticleBuffer(Context* context, uint32_t particleBuffer);
+VkAccessFlags drawnBufferAccess(Context* context);
+
+void recordOwnershipBarrier(VkCommandBuffer commandBuffer, VkBuffer buffer, uint32_t srcFamily, uint32_t dstFamily,
+    VkPipelineStageFlags srcStages, VkAccessFlags srcAccess, VkPipelineStageFlags dstStages, VkAccessFlags dstAccess);
+void recordDrawHandoff(Context* context, VkCommandBuffer commandBuffer, uint32_t particleBuffer);
+void recordGraphicsAcquire(Context* context, VkCommandBuffer commandBuffer, uint32_t particleBuffer);
+
+void acquireTransferredBuffers(Context* context, const VkBuffer* buffers, uint32_t bufferCount);
+
+#endif
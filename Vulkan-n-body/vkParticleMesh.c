@@ -0,0 +1,461 @@
+#include "vkParticleMesh.h"
+#include "vkinit.h"
+#include "vkDraw.h"
+#include "particleMesh.h"
+#include "platform.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Particle-mesh step, one compute pass each:
+//   bounds      - min and max of the positions over all workgroups, skipped when periodic
+//   place       - single invocation placing the mesh around them, or on the periodic box
+//   kernel      - the force law at every cell offset, FFT'd like the masses
+//   deposit     - cloud-in-cell masses with 64 bit fixed point integer atomics, 32 bit without them
+//   load        - fixed point masses into the complex grid
+//   fft         - rows, then columns, forward
+//   multiply    - mass spectrum times kernel spectrum
+//   fft         - rows, then columns, inverse, leaving the accelerations on the grid
+//   interpolate - cloud-in-cell accelerations and the Euler update of the direct kernel
+// A step costs O(N + fftSize^2 log fftSize) instead of O(N^2). The periodic kernel does not
+// depend on the particles and is only transformed once, an isolated mesh follows them.
+
+const char* particleMeshShaderNames[PM_PASS_COUNT] = {
+    "pm_bounds",
+    "pm_place",
+    "pm_kernel",
+    "pm_deposit",
+    "pm_load",
+    "pm_fft",
+    "pm_multiply",
+    "pm_interpolate"
+};
+
+void createParticleMeshResources(Context* context) {
+    uint32_t gridSize = context->pmGridSize;
+    if (gridSize < PM_MIN_GRID_SIZE || (gridSize & (gridSize - 1)) != 0 ||
+        particleMeshFftSize(gridSize, context->pmPeriodic) > PM_MAX_FFT_SIZE) {
+        printf("pmGridSize must be a power of two from %u to %u (%u when periodic)!\n",
+            PM_MIN_GRID_SIZE, PM_MAX_FFT_SIZE / 2, PM_MAX_FFT_SIZE);
+        exit(1);
+    }
+    // pm_interpolate.comp integrates with the Euler update of the original kernel
+    if (context->integrator != INTEGRATOR_EULER) {
+        printf("The particle mesh only supports the Euler integrator!\n");
+        exit(1);
+    }
+
+    printf("Particle mesh deposit: %s bit fixed point\n", context->int64Atomics ? "64" : "32");
+
+    createParticleMeshDescriptorSetLayout(context);
+    createParticleMeshPipelines(context);
+    createParticleMeshBuffers(context);
+    createParticleMeshDescriptorSets(context);
+    initializeParticleMesh(context);
+}
+
+void createParticleMeshDescriptorSetLayout(Context* context) {
+    VkDescriptorSetLayoutBinding layoutBindings[6] = { 0 };
+    for (uint32_t i = 0; i < 6; i++) {
+        layoutBindings[i].binding = i;
+        layoutBindings[i].descriptorCount = 1;
+        layoutBindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        layoutBindings[i].pImmutableSamplers = NULL;
+        layoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = 6,
+        .pBindings = layoutBindings
+    };
+
+    VkResult result = vkCreateDescriptorSetLayout(context->device, &layoutInfo, NULL, &context->particleMesh.descriptorSetLayout);
+    checkErr(result, "failed to create particle mesh descriptor set layout!");
+}
+
+void createParticleMeshPipelines(Context* context) {
+    VkPushConstantRange pushConstantRange = {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = sizeof(ParticleMeshPushConstants)
+    };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &context->particleMesh.descriptorSetLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstantRange
+    };
+
+    VkResult result = vkCreatePipelineLayout(context->device, &pipelineLayoutInfo, NULL, &context->particleMesh.pipelineLayout);
+    checkErr(result, "failed to create particle mesh pipeline layout!");
+
+    for (uint32_t i = 0; i < PM_PASS_COUNT; i++) {
+        // the deposit and load passes compiled with DEPOSIT_INT64, see pm_common.glsl
+        const char* shaderName = particleMeshShaderNames[i];
+        if (context->int64Atomics && i == PM_PASS_DEPOSIT) {
+            shaderName = "pm_deposit64";
+        }
+        if (context->int64Atomics && i == PM_PASS_LOAD) {
+            shaderName = "pm_load64";
+        }
+        VkShaderModule shaderModule = loadShaderModule(context, shaderName);
+
+        VkComputePipelineCreateInfo pipelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .layout = context->particleMesh.pipelineLayout,
+            .stage = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = shaderModule,
+                .pName = "main"
+            }
+        };
+
+        result = vkCreateComputePipelines(context->device, context->pipelineCache, 1, &pipelineInfo, NULL, &context->particleMesh.pipelines[i]);
+        checkErr(result, "failed to create particle mesh pipeline!");
+
+        vkDestroyShaderModule(context->device, shaderModule, NULL);
+    }
+}
+
+// Sized for pmGridSize, smaller meshes fit in the same buffers
+void createParticleMeshBuffers(Context* context) {
+    ParticleMesh* pm = &context->particleMesh;
+    uint32_t fftSize = particleMeshFftSize(context->pmGridSize, context->pmPeriodic);
+    VkDeviceSize cellCount = (VkDeviceSize)fftSize * fftSize;
+
+    createBuffer(context,
+        (context->int64Atomics ? sizeof(int64_t) : sizeof(int32_t)) * cellCount,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ALLOCATION_STRATEGY_LINEAR,
+        &pm->depositBuffer, &pm->depositBufferAllocation);
+
+    createBuffer(context,
+        sizeof(float) * 2 * 2 * cellCount,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ALLOCATION_STRATEGY_LINEAR,
+        &pm->gridBuffer, &pm->gridBufferAllocation);
+
+    createBuffer(context,
+        sizeof(float) * 4 + sizeof(int32_t) * 4,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ALLOCATION_STRATEGY_LINEAR,
+        &pm->boundsBuffer, &pm->boundsBufferAllocation);
+}
+
+void createParticleMeshDescriptorSets(Context* context) {
+    ParticleMesh* pm = &context->particleMesh;
+
+    VkDescriptorPoolSize poolSizes[2] = { 0 };
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].descriptorCount = context->MAX_FRAMES_IN_FLIGHT;
+
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = context->MAX_FRAMES_IN_FLIGHT * 5;
+
+    VkDescriptorPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .poolSizeCount = 2,
+        .pPoolSizes = poolSizes,
+        .maxSets = context->MAX_FRAMES_IN_FLIGHT,
+    };
+
+    VkResult result = vkCreateDescriptorPool(context->device, &poolInfo, NULL, &pm->descriptorPool);
+    checkErr(result, "failed to create particle mesh descriptor pool!");
+
+    VkDescriptorSetLayout* layouts = (VkDescriptorSetLayout*)malloc(sizeof(VkDescriptorSetLayout) * context->MAX_FRAMES_IN_FLIGHT);
+    for (uint32_t i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
+        layouts[i] = pm->descriptorSetLayout;
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = pm->descriptorPool,
+        .descriptorSetCount = context->MAX_FRAMES_IN_FLIGHT,
+        .pSetLayouts = layouts
+    };
+
+    pm->descriptorSets = (VkDescriptorSet*)malloc(sizeof(VkDescriptorSet) * context->MAX_FRAMES_IN_FLIGHT);
+    result = vkAllocateDescriptorSets(context->device, &allocInfo, pm->descriptorSets);
+    checkErr(result, "failed to allocate particle mesh descriptor sets!");
+    free(layouts);
+
+    for (uint32_t i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
+        VkDescriptorBufferInfo bufferInfos[6] = {
+            { context->uniformBuffers[i], 0, sizeof(UniformBufferObject) },
+            { context->shaderStorageBuffers[(i + context->MAX_FRAMES_IN_FLIGHT - 1) % context->MAX_FRAMES_IN_FLIGHT], 0, VK_WHOLE_SIZE },
+            { context->shaderStorageBuffers[i], 0, VK_WHOLE_SIZE },
+            { pm->depositBuffer, 0, VK_WHOLE_SIZE },
+            { pm->gridBuffer, 0, VK_WHOLE_SIZE },
+            { pm->boundsBuffer, 0, VK_WHOLE_SIZE }
+        };
+
+        VkWriteDescriptorSet descriptorWrites[6] = { 0 };
+        for (uint32_t b = 0; b < 6; b++) {
+            descriptorWrites[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[b].dstSet = pm->descriptorSets[i];
+            descriptorWrites[b].dstBinding = b;
+            descriptorWrites[b].dstArrayElement = 0;
+            descriptorWrites[b].descriptorType = b == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[b].descriptorCount = 1;
+            descriptorWrites[b].pBufferInfo = &bufferInfos[b];
+        }
+
+        vkUpdateDescriptorSets(context->device, 6, descriptorWrites, 0, NULL);
+    }
+}
+
+// Picks the fixed point scale so that even all mass in one cell fits in 62 bits, or 30 bits
+// without 64 bit atomics, then clears the deposit grid and the extent and, for a periodic
+// mesh, transforms the kernel once and for all.
+//
+// The 30 bits are the fallback's precision limit: N bodies of equal mass deposit about
+// 2^30 / N units each, split over four cells and rounded to whole units. For a thousand
+// bodies that is a million units, at tens of millions it is a few dozen, so each rounded
+// share is off by several percent and the mesh forces pick up that noise. With 64 bits
+// every share keeps the precision of its float product instead.
+void initializeParticleMesh(Context* context) {
+    ParticleMesh* pm = &context->particleMesh;
+    VkDeviceSize bufferSize = sizeof(Particle) * context->PARTICLE_COUNT;
+
+    Particle* particles = (Particle*)malloc(bufferSize);
+    readbackBuffer(context, context->shaderStorageBuffers[context->latestBuffer], bufferSize, particles);
+    double totalMass = 0.0;
+    for (uint32_t i = 0; i < context->PARTICLE_COUNT; i++) {
+        totalMass += fabs(particles[i].mss);
+    }
+    free(particles);
+    double fixedPointRange = context->int64Atomics ? 4611686018427387904.0 : 1073741824.0;
+    pm->massScale = totalMass > 0.0 ? (float)(fixedPointRange / totalMass) : 1.0f;
+
+    VkCommandBufferAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandPool = context->computeCommandPool,
+        .commandBufferCount = 1
+    };
+
+    VkCommandBuffer commandBuffer;
+    vkAllocateCommandBuffers(context->device, &allocInfo, &commandBuffer);
+
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        vkCmdFillBuffer(commandBuffer, pm->depositBuffer, 0, VK_WHOLE_SIZE, 0);
+        vkCmdFillBuffer(commandBuffer, pm->boundsBuffer, sizeof(float) * 4, sizeof(int32_t) * 4, PM_EXTENT_CLEAR);
+        recordComputeBarrier(commandBuffer);
+        if (context->pmPeriodic) {
+            ParticleMeshPushConstants pushConstants = particleMeshPushConstants(context, context->pmGridSize);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pm->pipelineLayout, 0, 1, &pm->descriptorSets[context->latestBuffer], 0, NULL);
+            recordParticleMeshKernel(context, commandBuffer, &pushConstants);
+        }
+
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &commandBuffer
+    };
+
+    vkQueueSubmit(context->computeQueue, 1, &submitInfo, VK_NULL_HANDLE);
+    vkQueueWaitIdle(context->computeQueue);
+
+    vkFreeCommandBuffers(context->device, context->computeCommandPool, 1, &commandBuffer);
+}
+
+ParticleMeshPushConstants particleMeshPushConstants(Context* context, uint32_t gridSize) {
+    uint32_t fftSize = particleMeshFftSize(gridSize, context->pmPeriodic);
+    uint32_t logFftSize = 0;
+    while ((1u << logFftSize) < fftSize) {
+        logFftSize++;
+    }
+
+    ParticleMeshPushConstants pushConstants = {
+        .particleCount = context->PARTICLE_COUNT,
+        .gridSize = gridSize,
+        .fftSize = fftSize,
+        .logFftSize = logFftSize,
+        .periodic = context->pmPeriodic ? 1 : 0,
+        .boxSize = context->pmBoxSize,
+        .massScale = context->particleMesh.massScale
+    };
+    return pushConstants;
+}
+
+void recordParticleMeshCommands(Context* context, VkCommandBuffer commandBuffer, uint32_t setIndex) {
+    recordParticleMeshStep(context, commandBuffer, setIndex, context->pmGridSize, !context->pmPeriodic);
+}
+
+void recordParticleMeshStep(Context* context, VkCommandBuffer commandBuffer, uint32_t setIndex, uint32_t gridSize, bool updateKernel) {
+    ParticleMesh* pm = &context->particleMesh;
+    ParticleMeshPushConstants pushConstants = particleMeshPushConstants(context, gridSize);
+    uint32_t blockCount = (context->PARTICLE_COUNT + PM_BLOCK_SIZE - 1) / PM_BLOCK_SIZE;
+    uint32_t cellBlockCount = (pushConstants.fftSize * pushConstants.fftSize + PM_BLOCK_SIZE - 1) / PM_BLOCK_SIZE;
+
+    // the mesh buffers are shared by all frame slots, wait for the previous step to be done with them
+    recordComputeBarrier(commandBuffer);
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pm->pipelineLayout, 0, 1, &pm->descriptorSets[setIndex], 0, NULL);
+
+    if (updateKernel) {
+        recordParticleMeshKernel(context, commandBuffer, &pushConstants);
+    }
+
+    vkCmdPushConstants(commandBuffer, pm->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pm->pipelines[PM_PASS_DEPOSIT]);
+    vkCmdDispatch(commandBuffer, blockCount, 1, 1);
+    recordComputeBarrier(commandBuffer);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pm->pipelines[PM_PASS_LOAD]);
+    vkCmdDispatch(commandBuffer, cellBlockCount, 1, 1);
+    recordComputeBarrier(commandBuffer);
+
+    recordParticleMeshFft(context, commandBuffer, &pushConstants, 0, -1.0f);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pm->pipelines[PM_PASS_MULTIPLY]);
+    vkCmdDispatch(commandBuffer, cellBlockCount, 1, 1);
+    recordComputeBarrier(commandBuffer);
+
+    recordParticleMeshFft(context, commandBuffer, &pushConstants, 0, 1.0f);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pm->pipelines[PM_PASS_INTERPOLATE]);
+    vkCmdDispatch(commandBuffer, blockCount, 1, 1);
+}
+
+// Places the mesh and fills the second grid with the kernel spectrum for it
+void recordParticleMeshKernel(Context* context, VkCommandBuffer commandBuffer, ParticleMeshPushConstants* pushConstants) {
+    ParticleMesh* pm = &context->particleMesh;
+    uint32_t cellCount = pushConstants->fftSize * pushConstants->fftSize;
+
+    vkCmdPushConstants(commandBuffer, pm->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(*pushConstants), pushConstants);
+    if (!pushConstants->periodic) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pm->pipelines[PM_PASS_BOUNDS]);
+        vkCmdDispatch(commandBuffer, (context->PARTICLE_COUNT + PM_BLOCK_SIZE - 1) / PM_BLOCK_SIZE, 1, 1);
+        recordComputeBarrier(commandBuffer);
+    }
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pm->pipelines[PM_PASS_PLACE]);
+    vkCmdDispatch(commandBuffer, 1, 1, 1);
+    recordComputeBarrier(commandBuffer);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pm->pipelines[PM_PASS_KERNEL]);
+    vkCmdDispatch(commandBuffer, (cellCount + PM_BLOCK_SIZE - 1) / PM_BLOCK_SIZE, 1, 1);
+    recordComputeBarrier(commandBuffer);
+
+    recordParticleMeshFft(context, commandBuffer, pushConstants, cellCount, -1.0f);
+}
+
+// 2D FFT of the complex grid at gridOffset, one workgroup per row and then per column
+void recordParticleMeshFft(Context* context, VkCommandBuffer commandBuffer, ParticleMeshPushConstants* pushConstants, uint32_t gridOffset, float direction) {
+    ParticleMesh* pm = &context->particleMesh;
+    uint32_t fftSize = pushConstants->fftSize;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pm->pipelines[PM_PASS_FFT]);
+    pushConstants->gridOffset = gridOffset;
+    pushConstants->direction = direction;
+    for (uint32_t axis = 0; axis < 2; axis++) {
+        pushConstants->sampleStride = axis == 0 ? 1 : fftSize;
+        pushConstants->lineStride = axis == 0 ? fftSize : 1;
+        vkCmdPushConstants(commandBuffer, pm->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(*pushConstants), pushConstants);
+        vkCmdDispatch(commandBuffer, fftSize, 1, 1);
+        recordComputeBarrier(commandBuffer);
+    }
+}
+
+// Runs one step from the same state with the direct kernel and with the particle mesh on
+// pmGridSize and three coarser meshes, and reports the relative rms difference of the velocity
+// kicks and the time per step. The configured mesh is also checked against the CPU reference
+// in particleMesh.c. The storage buffers are restored afterwards.
+void compareParticleMeshWithDirect(Context* context) {
+    const uint32_t MESH_COUNT = 4;
+    VkDeviceSize bufferSize = sizeof(Particle) * context->PARTICLE_COUNT;
+
+    Particle* initial = (Particle*)malloc(bufferSize);
+    Particle* direct = (Particle*)malloc(bufferSize);
+    Particle* mesh = (Particle*)malloc(bufferSize);
+
+    context->currentFrame = 0;
+    updateUniformBuffer(context->timeStep, context->uniformBuffersMapped, 0);
+    readbackBuffer(context, context->shaderStorageBuffers[context->MAX_FRAMES_IN_FLIGHT - 1], bufferSize, initial);
+
+    // run 0 is the direct kernel, run m the mesh pmGridSize >> (m - 1)
+    for (uint32_t run = 0; run <= MESH_COUNT; run++) {
+        uint32_t gridSize = run == 0 ? 0 : context->pmGridSize >> (run - 1);
+        if (run > 0 && gridSize < PM_MIN_GRID_SIZE) {
+            break;
+        }
+
+        VkCommandBuffer commandBuffer = beginComparisonStep(context);
+        if (run > 0) {
+            // every mesh size needs its own kernel spectrum
+            recordParticleMeshStep(context, commandBuffer, 0, gridSize, true);
+        }
+        else {
+            recordDirectStep(context, commandBuffer, 0);
+        }
+        double msPerStep = runComparisonStep(context, commandBuffer, run == 0 ? direct : mesh);
+
+        if (run == 0) {
+            printf("direct: %.3f ms per step\n", msPerStep);
+            continue;
+        }
+
+        printf("particle mesh %ux%u%s: relative force error %.3e\t %.3f ms per step\n", gridSize, gridSize,
+            context->pmPeriodic ? " periodic" : "", relativeKickError(initial, direct, mesh, context->PARTICLE_COUNT), msPerStep);
+
+        if (run == 1) {
+            vec2* accelerations = (vec2*)malloc(sizeof(vec2) * context->PARTICLE_COUNT);
+            double cpuStart = getTime();
+            particleMeshAccelerations(initial, context->PARTICLE_COUNT, gridSize, context->pmPeriodic, context->pmBoxSize, accelerations);
+            double cpuMs = (getTime() - cpuStart) * 1e3;
+
+            double errorSquared = 0.0;
+            double normSquared = 0.0;
+            for (uint32_t i = 0; i < context->PARTICLE_COUNT; i++) {
+                double referenceX = accelerations[i].x * (double)context->timeStep;
+                double referenceY = accelerations[i].y * (double)context->timeStep;
+                double errorX = (mesh[i].vel.x - initial[i].vel.x) - referenceX;
+                double errorY = (mesh[i].vel.y - initial[i].vel.y) - referenceY;
+                errorSquared += errorX * errorX + errorY * errorY;
+                normSquared += referenceX * referenceX + referenceY * referenceY;
+            }
+            printf("particle mesh GPU against CPU reference: relative difference %.3e\t CPU %.3f ms\n",
+                normSquared > 0.0 ? sqrt(errorSquared / normSquared) : 0.0, cpuMs);
+            free(accelerations);
+        }
+    }
+    vkResetCommandBuffer(context->computeCommandBuffers[0], 0);
+    context->computeCommandBufferSteps[0] = 0;
+
+    // leave the kernel spectrum of a periodic mesh on pmGridSize again
+    if (context->pmPeriodic) {
+        initializeParticleMesh(context);
+    }
+
+    free(initial);
+    free(direct);
+    free(mesh);
+}
+
+void cleanupParticleMesh(Context* context) {
+    ParticleMesh* pm = &context->particleMesh;
+
+    for (uint32_t i = 0; i < PM_PASS_COUNT; i++) {
+        vkDestroyPipeline(context->device, pm->pipelines[i], NULL);
+    }
+    vkDestroyPipelineLayout(context->device, pm->pipelineLayout, NULL);
+    vkDestroyDescriptorPool(context->device, pm->descriptorPool, NULL);
+    vkDestroyDescriptorSetLayout(context->device, pm->descriptorSetLayout, NULL);
+
+    destroyBuffer(context, pm->depositBuffer, pm->depositBufferAllocation);
+    destroyBuffer(context, pm->gridBuffer, pm->gridBufferAllocation);
+    destroyBuffer(context, pm->boundsBuffer, pm->boundsBufferAllocation);
+
+    free(pm->descriptorSets);
+}
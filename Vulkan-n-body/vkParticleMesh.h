@@ -0,0 +1,29 @@
+#ifndef VKPARTICLEMESH_H
+#define VKPARTICLEMESH_H
+
+#include "types.h"
+
+// Must match BLOCK_SIZE and MAX_FFT_SIZE in shaders/pm_common.glsl
+#define PM_BLOCK_SIZE 256
+#define PM_MAX_FFT_SIZE 1024
+#define PM_MIN_GRID_SIZE 16
+// What pm_place.comp resets the extent of the bounds buffer to, orderedKey of the largest float
+#define PM_EXTENT_CLEAR 0x7FFFFFFF
+
+void createParticleMeshResources(Context* context);
+void createParticleMeshDescriptorSetLayout(Context* context);
+void createParticleMeshPipelines(Context* context);
+void createParticleMeshBuffers(Context* context);
+void createParticleMeshDescriptorSets(Context* context);
+void initializeParticleMesh(Context* context);
+
+ParticleMeshPushConstants particleMeshPushConstants(Context* context, uint32_t gridSize);
+void recordParticleMeshCommands(Context* context, VkCommandBuffer commandBuffer, uint32_t setIndex);
+void recordParticleMeshStep(Context* context, VkCommandBuffer commandBuffer, uint32_t setIndex, uint32_t gridSize, bool updateKernel);
+void recordParticleMeshKernel(Context* context, VkCommandBuffer commandBuffer, ParticleMeshPushConstants* pushConstants);
+void recordParticleMeshFft(Context* context, VkCommandBuffer commandBuffer, ParticleMeshPushConstants* pushConstants, uint32_t gridOffset, float direction);
+void compareParticleMeshWithDirect(Context* context);
+
+void cleanupParticleMesh(Context* context);
+
+#endif
@@ -0,0 +1,84 @@
+#include "vkPipelineCache.h"
+#include "vkinit.h"
+#include "platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Every pipeline is created through context->pipelineCache, so a run that finds
+// pipelineCachePath from an earlier run skips compiling SPIR-V in the driver.
+// A cache from another device or driver version is ignored rather than handed to the
+// driver, and overwritten on exit.
+void createPipelineCache(Context* context) {
+    uint64_t fileSize = 0;
+    void* file = mapFile(context->pipelineCachePath, &fileSize);
+
+    VkPipelineCacheCreateInfo cacheInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO
+    };
+    if (file != NULL && pipelineCacheMatchesDevice(context, file, fileSize)) {
+        cacheInfo.initialDataSize = (size_t)fileSize;
+        cacheInfo.pInitialData = file;
+        context->pipelineCacheWarm = true;
+    }
+    else if (file != NULL) {
+        printf("pipeline cache %s was built for another device or driver, starting cold\n", context->pipelineCachePath);
+    }
+
+    VkResult result = vkCreatePipelineCache(context->device, &cacheInfo, NULL, &context->pipelineCache);
+    checkErr(result, "failed to create pipeline cache!");
+
+    if (file != NULL) {
+        unmapFile(file, fileSize);
+    }
+}
+
+void destroyPipelineCache(Context* context) {
+    savePipelineCache(context);
+    vkDestroyPipelineCache(context->device, context->pipelineCache, NULL);
+}
+
+// The header layout is fixed by the spec, the rest of the data is driver specific
+bool pipelineCacheMatchesDevice(Context* context, const void* data, uint64_t size) {
+    VkPipelineCacheHeaderVersionOne header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context->physicalDevice, &properties);
+
+    return header.headerSize >= sizeof(header) &&
+        header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+        header.vendorID == properties.vendorID &&
+        header.deviceID == properties.deviceID &&
+        memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+// Written next to the destination and renamed over it, like checkpoints
+void savePipelineCache(Context* context) {
+    size_t dataSize = 0;
+    VkResult result = vkGetPipelineCacheData(context->device, context->pipelineCache, &dataSize, NULL);
+    checkErr(result, "failed to get pipeline cache size!");
+    void* data = malloc(dataSize);
+    result = vkGetPipelineCacheData(context->device, context->pipelineCache, &dataSize, data);
+    checkErr(result, "failed to get pipeline cache data!");
+
+    size_t pathLength = strlen(context->pipelineCachePath);
+    char* tempPath = (char*)malloc(pathLength + 5);
+    memcpy(tempPath, context->pipelineCachePath, pathLength);
+    memcpy(tempPath + pathLength, ".tmp", 5);
+
+    FILE* file = fopen(tempPath, "wb");
+    bool success = file != NULL && fwrite(data, 1, dataSize, file) == dataSize;
+    if (file != NULL) {
+        success = fclose(file) == 0 && success;
+    }
+    if (!success || !replaceFile(tempPath, context->pipelineCachePath)) {
+        printf("failed to write pipeline cache %s!\n", context->pipelineCachePath);
+    }
+    free(tempPath);
+    free(data);
+}
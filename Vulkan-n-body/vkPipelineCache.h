@@ -0,0 +1,11 @@
+#ifndef VKPIPELINECACHE_H
+#define VKPIPELINECACHE_H
+
+#include "types.h"
+
+void createPipelineCache(Context* context);
+void destroyPipelineCache(Context* context);
+bool pipelineCacheMatchesDevice(Context* context, const void* data, uint64_t size);
+void savePipelineCache(Context* context);
+
+#endif
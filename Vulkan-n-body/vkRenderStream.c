@@ -0,0 +1,184 @@
+#include "vkRenderStream.h"
+#include "vkinit.h"
+#include "vkDraw.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// With renderStreamStride > 0 the vertex stage no longer reads the simulation buffers. At the
+// end of every compute submission render_pack.comp writes every stride-th particle of the
+// buffer the last step produced as an 8 byte RenderVertex, instead of the 32 byte Particle,
+// and the graphics pipeline draws those. There is one stream per storage buffer, so the
+// timeline waits that already order the storage buffers between the queues cover them too.
+// With separate queue families the streams are what the compute queue hands over, see
+// vkOwnership.c.
+
+void createRenderStreamResources(Context* context) {
+    context->renderStream.vertexCount = (context->PARTICLE_COUNT + context->renderStreamStride - 1) / context->renderStreamStride;
+
+    createRenderStreamDescriptorSetLayout(context);
+    createRenderStreamPipeline(context);
+    createRenderStreamBuffers(context);
+    createRenderStreamDescriptorSets(context);
+}
+
+void createRenderStreamDescriptorSetLayout(Context* context) {
+    VkDescriptorSetLayoutBinding layoutBindings[2] = { 0 };
+    for (uint32_t i = 0; i < 2; i++) {
+        layoutBindings[i].binding = i;
+        layoutBindings[i].descriptorCount = 1;
+        layoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        layoutBindings[i].pImmutableSamplers = NULL;
+        layoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = 2,
+        .pBindings = layoutBindings
+    };
+
+    VkResult result = vkCreateDescriptorSetLayout(context->device, &layoutInfo, NULL, &context->renderStream.descriptorSetLayout);
+    checkErr(result, "failed to create render stream descriptor set layout!");
+}
+
+void createRenderStreamPipeline(Context* context) {
+    VkPushConstantRange pushConstantRange = {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = sizeof(RenderStreamPushConstants)
+    };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &context->renderStream.descriptorSetLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstantRange
+    };
+
+    VkResult result = vkCreatePipelineLayout(context->device, &pipelineLayoutInfo, NULL, &context->renderStream.pipelineLayout);
+    checkErr(result, "failed to create render stream pipeline layout!");
+
+    VkShaderModule shaderModule = loadShaderModule(context, "render_pack");
+
+    VkComputePipelineCreateInfo pipelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .layout = context->renderStream.pipelineLayout,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = shaderModule,
+            .pName = "main"
+        }
+    };
+
+    result = vkCreateComputePipelines(context->device, context->pipelineCache, 1, &pipelineInfo, NULL, &context->renderStream.pipeline);
+    checkErr(result, "failed to create render stream pipeline!");
+
+    vkDestroyShaderModule(context->device, shaderModule, NULL);
+}
+
+void createRenderStreamBuffers(Context* context) {
+    RenderStream* stream = &context->renderStream;
+    stream->buffers = (VkBuffer*)malloc(sizeof(VkBuffer) * context->MAX_FRAMES_IN_FLIGHT);
+    stream->bufferAllocations = (Allocation*)malloc(sizeof(Allocation) * context->MAX_FRAMES_IN_FLIGHT);
+
+    // written on the compute queue and released to the graphics queue every submission
+    for (uint32_t i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
+        createBuffer(context,
+            sizeof(RenderVertex) * stream->vertexCount,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            ALLOCATION_STRATEGY_LINEAR,
+            &stream->buffers[i],
+            &stream->bufferAllocations[i]);
+    }
+}
+
+void createRenderStreamDescriptorSets(Context* context) {
+    RenderStream* stream = &context->renderStream;
+
+    VkDescriptorPoolSize poolSize = {
+        .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = context->MAX_FRAMES_IN_FLIGHT * 2
+    };
+
+    VkDescriptorPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .poolSizeCount = 1,
+        .pPoolSizes = &poolSize,
+        .maxSets = context->MAX_FRAMES_IN_FLIGHT,
+    };
+
+    VkResult result = vkCreateDescriptorPool(context->device, &poolInfo, NULL, &stream->descriptorPool);
+    checkErr(result, "failed to create render stream descriptor pool!");
+
+    VkDescriptorSetLayout* layouts = (VkDescriptorSetLayout*)malloc(sizeof(VkDescriptorSetLayout) * context->MAX_FRAMES_IN_FLIGHT);
+    for (uint32_t i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
+        layouts[i] = stream->descriptorSetLayout;
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = stream->descriptorPool,
+        .descriptorSetCount = context->MAX_FRAMES_IN_FLIGHT,
+        .pSetLayouts = layouts
+    };
+
+    stream->descriptorSets = (VkDescriptorSet*)malloc(sizeof(VkDescriptorSet) * context->MAX_FRAMES_IN_FLIGHT);
+    result = vkAllocateDescriptorSets(context->device, &allocInfo, stream->descriptorSets);
+    checkErr(result, "failed to allocate render stream descriptor sets!");
+    free(layouts);
+
+    for (uint32_t i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
+        VkDescriptorBufferInfo bufferInfos[2] = {
+            { context->shaderStorageBuffers[i], 0, VK_WHOLE_SIZE },
+            { stream->buffers[i], 0, VK_WHOLE_SIZE }
+        };
+
+        VkWriteDescriptorSet descriptorWrites[2] = { 0 };
+        for (uint32_t b = 0; b < 2; b++) {
+            descriptorWrites[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[b].dstSet = stream->descriptorSets[i];
+            descriptorWrites[b].dstBinding = b;
+            descriptorWrites[b].dstArrayElement = 0;
+            descriptorWrites[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[b].descriptorCount = 1;
+            descriptorWrites[b].pBufferInfo = &bufferInfos[b];
+        }
+
+        vkUpdateDescriptorSets(context->device, 2, descriptorWrites, 0, NULL);
+    }
+}
+
+// setIndex is the storage buffer the last step of the submission wrote
+void recordRenderStreamCommands(Context* context, VkCommandBuffer commandBuffer, uint32_t setIndex) {
+    RenderStream* stream = &context->renderStream;
+    RenderStreamPushConstants pushConstants = {
+        .particleCount = context->PARTICLE_COUNT,
+        .stride = context->renderStreamStride
+    };
+
+    recordComputeBarrier(commandBuffer);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, stream->pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, stream->pipelineLayout, 0, 1, &stream->descriptorSets[setIndex], 0, NULL);
+    vkCmdPushConstants(commandBuffer, stream->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(RenderStreamPushConstants), &pushConstants);
+    vkCmdDispatch(commandBuffer, (stream->vertexCount + RENDER_STREAM_BLOCK_SIZE - 1) / RENDER_STREAM_BLOCK_SIZE, 1, 1);
+}
+
+void cleanupRenderStream(Context* context) {
+    RenderStream* stream = &context->renderStream;
+
+    vkDestroyPipeline(context->device, stream->pipeline, NULL);
+    vkDestroyPipelineLayout(context->device, stream->pipelineLayout, NULL);
+    vkDestroyDescriptorPool(context->device, stream->descriptorPool, NULL);
+    vkDestroyDescriptorSetLayout(context->device, stream->descriptorSetLayout, NULL);
+
+    for (uint32_t i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
+        destroyBuffer(context, stream->buffers[i], stream->bufferAllocations[i]);
+    }
+    free(stream->buffers);
+    free(stream->bufferAllocations);
+    free(stream->descriptorSets);
+}
@@ -0,0 +1,18 @@
+#ifndef VKRENDERSTREAM_H
+#define VKRENDERSTREAM_H
+
+#include "types.h"
+
+#define RENDER_STREAM_BLOCK_SIZE 256
+
+void createRenderStreamResources(Context* context);
+void createRenderStreamDescriptorSetLayout(Context* context);
+void createRenderStreamPipeline(Context* context);
+void createRenderStreamBuffers(Context* context);
+void createRenderStreamDescriptorSets(Context* context);
+
+void recordRenderStreamCommands(Context* context, VkCommandBuffer commandBuffer, uint32_t setIndex);
+
+void cleanupRenderStream(Context* context);
+
+#endif
@@ -0,0 +1,183 @@
+#include "vkStaging.h"
+#include "vkinit.h"
+#include "vkOwnership.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Uploads go through one persistently mapped buffer split into STAGING_RING_SEGMENTS
+// segments. Copies staged into a segment are recorded into its command buffer and
+// submitted together on the transfer queue, so many small uploads cost one submission.
+// The CPU fills the next segment while the previous ones are copied, and only waits
+// when it wraps around to a segment whose fence hasn't signaled yet.
+void createStagingRing(Context* context) {
+    StagingRing* staging = &context->staging;
+
+    VkCommandPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = context->queueFamilyIndices.transferFamily
+    };
+    VkResult result = vkCreateCommandPool(context->device, &poolInfo, NULL, &staging->commandPool);
+    checkErr(result, "failed to create staging command pool!");
+
+    createBuffer(context,
+        STAGING_RING_SIZE,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        ALLOCATION_STRATEGY_LINEAR,
+        &staging->buffer,
+        &staging->allocation);
+
+    VkCommandBufferAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = staging->commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+    VkFenceCreateInfo fenceInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO
+    };
+    for (uint32_t i = 0; i < STAGING_RING_SEGMENTS; i++) {
+        result = vkAllocateCommandBuffers(context->device, &allocInfo, &staging->segments[i].commandBuffer);
+        checkErr(result, "failed to allocate staging command buffer!");
+        result = vkCreateFence(context->device, &fenceInfo, NULL, &staging->segments[i].fence);
+        checkErr(result, "failed to create staging fence!");
+    }
+}
+
+void destroyStagingRing(Context* context) {
+    StagingRing* staging = &context->staging;
+    finishStagingUploads(context);
+
+    for (uint32_t i = 0; i < STAGING_RING_SEGMENTS; i++) {
+        vkDestroyFence(context->device, staging->segments[i].fence, NULL);
+    }
+    vkDestroyCommandPool(context->device, staging->commandPool, NULL);
+    destroyBuffer(context, staging->buffer, staging->allocation);
+}
+
+// Copies size bytes of data to dstOffset in every one of dstBuffers. Data larger than a
+// segment is split across segments. The copies are only submitted once the segment fills
+// up or the ring is flushed. Exclusive destination buffers used by another family have to
+// be handed over with releaseStagedBuffers. data can be reused as soon as this returns.
+void stageUpload(Context* context, const VkBuffer* dstBuffers, uint32_t dstBufferCount, VkDeviceSize dstOffset, const void* data, VkDeviceSize size) {
+    StagingRing* staging = &context->staging;
+    VkDeviceSize segmentSize = STAGING_RING_SIZE / STAGING_RING_SEGMENTS;
+    const uint8_t* src = (const uint8_t*)data;
+
+    while (size > 0) {
+        StagingSegment* segment = &staging->segments[staging->current];
+        if (segment->recording && segment->used == segmentSize) {
+            submitStagingSegment(context);
+            segment = &staging->segments[staging->current];
+        }
+        if (!segment->recording) {
+            segment = beginStagingSegment(context);
+        }
+
+        VkDeviceSize chunk = segmentSize - segment->used < size ? segmentSize - segment->used : size;
+        VkDeviceSize srcOffset = staging->current * segmentSize + segment->used;
+        memcpy((uint8_t*)staging->allocation.mapped + srcOffset, src, (size_t)chunk);
+
+        VkBufferCopy copyRegion = {
+            .srcOffset = srcOffset,
+            .dstOffset = dstOffset,
+            .size = chunk
+        };
+        for (uint32_t i = 0; i < dstBufferCount; i++) {
+            vkCmdCopyBuffer(segment->commandBuffer, staging->buffer, dstBuffers[i], 1, &copyRegion);
+        }
+
+        segment->used += chunk;
+        src += chunk;
+        dstOffset += chunk;
+        size -= chunk;
+    }
+}
+
+// Releases buffers filled by stageUpload to dstFamily once the copies staged so far are
+// done. The acquire on dstFamily's queue has to wait for the release, finishStagingUploads
+// does that from the host.
+void releaseStagedBuffers(Context* context, const VkBuffer* buffers, uint32_t bufferCount, uint32_t dstFamily) {
+    StagingRing* staging = &context->staging;
+    StagingSegment* segment = &staging->segments[staging->current];
+    if (!segment->recording) {
+        segment = beginStagingSegment(context);
+    }
+
+    for (uint32_t i = 0; i < bufferCount; i++) {
+        recordOwnershipBarrier(segment->commandBuffer, buffers[i],
+            context->queueFamilyIndices.transferFamily, dstFamily,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+    }
+}
+
+// Submits the copies staged so far without waiting for them
+void flushStagingRing(Context* context) {
+    StagingRing* staging = &context->staging;
+    if (staging->segments[staging->current].recording) {
+        submitStagingSegment(context);
+    }
+}
+
+// Blocks until every staged copy has finished. The fence wait stands in for a semaphore
+// the next compute or graphics submission would otherwise have to wait on.
+void finishStagingUploads(Context* context) {
+    StagingRing* staging = &context->staging;
+    flushStagingRing(context);
+
+    for (uint32_t i = 0; i < STAGING_RING_SEGMENTS; i++) {
+        StagingSegment* segment = &staging->segments[i];
+        if (segment->submitted) {
+            vkWaitForFences(context->device, 1, &segment->fence, VK_TRUE, UINT64_MAX);
+            vkResetFences(context->device, 1, &segment->fence);
+            segment->submitted = false;
+        }
+    }
+}
+
+// Waits for the current segment's previous copies before its memory is overwritten
+StagingSegment* beginStagingSegment(Context* context) {
+    StagingRing* staging = &context->staging;
+    StagingSegment* segment = &staging->segments[staging->current];
+
+    if (segment->submitted) {
+        vkWaitForFences(context->device, 1, &segment->fence, VK_TRUE, UINT64_MAX);
+        vkResetFences(context->device, 1, &segment->fence);
+        segment->submitted = false;
+    }
+
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    VkResult result = vkBeginCommandBuffer(segment->commandBuffer, &beginInfo);
+    checkErr(result, "failed to begin recording staging command buffer!");
+
+    segment->used = 0;
+    segment->recording = true;
+    return segment;
+}
+
+void submitStagingSegment(Context* context) {
+    StagingRing* staging = &context->staging;
+    StagingSegment* segment = &staging->segments[staging->current];
+
+    VkResult result = vkEndCommandBuffer(segment->commandBuffer);
+    checkErr(result, "failed to record staging command buffer!");
+
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &segment->commandBuffer
+    };
+    result = vkQueueSubmit(context->transferQueue, 1, &submitInfo, segment->fence);
+    checkErr(result, "failed to submit staging copies!");
+
+    segment->recording = false;
+    segment->submitted = true;
+    staging->current = (staging->current + 1) % STAGING_RING_SEGMENTS;
+}
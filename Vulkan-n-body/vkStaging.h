@@ -0,0 +1,17 @@
+#ifndef VKSTAGING_H
+#define VKSTAGING_H
+
+#include "types.h"
+
+void createStagingRing(Context* context);
+void destroyStagingRing(Context* context);
+
+void stageUpload(Context* context, const VkBuffer* dstBuffers, uint32_t dstBufferCount, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+void releaseStagedBuffers(Context* context, const VkBuffer* buffers, uint32_t bufferCount, uint32_t dstFamily);
+void flushStagingRing(Context* context);
+void finishStagingUploads(Context* context);
+
+StagingSegment* beginStagingSegment(Context* context);
+void submitStagingSegment(Context* context);
+
+#endif
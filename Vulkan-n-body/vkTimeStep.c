@@ -0,0 +1,264 @@
+#include "vkTimeStep.h"
+#include "vkinit.h"
+#include "vkDraw.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Adaptive global time step. After every step two passes reduce the largest acceleration
+// and speed on the GPU and write the next step into a buffer the compute kernels bind as
+// their uniform buffer, so the step changes without the CPU ever waiting for it. The
+// simulated time is accumulated in the same buffer and only read back with checkpoints.
+
+const char* timeStepShaderNames[TIME_STEP_PASS_COUNT] = {
+    "time_step_reduce",
+    "time_step_update"
+};
+
+void createTimeStepResources(Context* context) {
+    if (context->integrator == INTEGRATOR_EULER ||
+        (context->computeKernel != COMPUTE_KERNEL_REFERENCE && context->computeKernel != COMPUTE_KERNEL_TILED)) {
+        printf("The adaptive time step needs a direct kernel with the leapfrog or Yoshida integrator!\n");
+        exit(1);
+    }
+    if (context->timeStepAccuracy <= 0.0f || context->minTimeStep <= 0.0f || context->minTimeStep > context->timeStep) {
+        printf("The adaptive time step needs 0 < minTimeStep <= timeStep and a positive accuracy!\n");
+        exit(1);
+    }
+
+    createTimeStepDescriptorSetLayout(context);
+    createTimeStepPipelines(context);
+    createTimeStepBuffer(context);
+    createTimeStepDescriptorSets(context);
+}
+
+void createTimeStepDescriptorSetLayout(Context* context) {
+    VkDescriptorSetLayoutBinding layoutBindings[3] = { 0 };
+    for (uint32_t i = 0; i < 3; i++) {
+        layoutBindings[i].binding = i;
+        layoutBindings[i].descriptorCount = 1;
+        layoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        layoutBindings[i].pImmutableSamplers = NULL;
+        layoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = 3,
+        .pBindings = layoutBindings
+    };
+
+    VkResult result = vkCreateDescriptorSetLayout(context->device, &layoutInfo, NULL, &context->timeStepControl.descriptorSetLayout);
+    checkErr(result, "failed to create time step descriptor set layout!");
+}
+
+void createTimeStepPipelines(Context* context) {
+    VkPushConstantRange pushConstantRange = {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = sizeof(TimeStepPushConstants)
+    };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &context->timeStepControl.descriptorSetLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstantRange
+    };
+
+    VkResult result = vkCreatePipelineLayout(context->device, &pipelineLayoutInfo, NULL, &context->timeStepControl.pipelineLayout);
+    checkErr(result, "failed to create time step pipeline layout!");
+
+    for (uint32_t i = 0; i < TIME_STEP_PASS_COUNT; i++) {
+        VkShaderModule shaderModule = loadShaderModule(context, timeStepShaderNames[i]);
+
+        VkComputePipelineCreateInfo pipelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .layout = context->timeStepControl.pipelineLayout,
+            .stage = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = shaderModule,
+                .pName = "main"
+            }
+        };
+
+        result = vkCreateComputePipelines(context->device, context->pipelineCache, 1, &pipelineInfo, NULL, &context->timeStepControl.pipelines[i]);
+        checkErr(result, "failed to create time step pipeline!");
+
+        vkDestroyShaderModule(context->device, shaderModule, NULL);
+    }
+}
+
+// Filled by recordTimeStepReset, see initializeAccelerations
+void createTimeStepBuffer(Context* context) {
+    createBuffer(context,
+        sizeof(TimeStepState),
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ALLOCATION_STRATEGY_LINEAR,
+        &context->timeStepControl.stateBuffer, &context->timeStepControl.stateBufferAllocation);
+}
+
+void createTimeStepDescriptorSets(Context* context) {
+    TimeStepControl* control = &context->timeStepControl;
+    uint32_t setCount = context->MAX_FRAMES_IN_FLIGHT;
+
+    VkDescriptorPoolSize poolSize = {
+        .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = setCount * 3
+    };
+
+    VkDescriptorPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .poolSizeCount = 1,
+        .pPoolSizes = &poolSize,
+        .maxSets = setCount,
+    };
+
+    VkResult result = vkCreateDescriptorPool(context->device, &poolInfo, NULL, &control->descriptorPool);
+    checkErr(result, "failed to create time step descriptor pool!");
+
+    VkDescriptorSetLayout* layouts = (VkDescriptorSetLayout*)malloc(sizeof(VkDescriptorSetLayout) * setCount);
+    for (uint32_t i = 0; i < setCount; i++) {
+        layouts[i] = control->descriptorSetLayout;
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = control->descriptorPool,
+        .descriptorSetCount = setCount,
+        .pSetLayouts = layouts
+    };
+
+    control->descriptorSets = (VkDescriptorSet*)malloc(sizeof(VkDescriptorSet) * setCount);
+    result = vkAllocateDescriptorSets(context->device, &allocInfo, control->descriptorSets);
+    checkErr(result, "failed to allocate time step descriptor sets!");
+    free(layouts);
+
+    for (uint32_t i = 0; i < setCount; i++) {
+        VkDescriptorBufferInfo bufferInfos[3] = {
+            { control->stateBuffer, 0, VK_WHOLE_SIZE },
+            { context->shaderStorageBuffers[i], 0, VK_WHOLE_SIZE },
+            { context->accelerationBuffers[i], 0, VK_WHOLE_SIZE }
+        };
+
+        VkWriteDescriptorSet descriptorWrites[3] = { 0 };
+        for (uint32_t b = 0; b < 3; b++) {
+            descriptorWrites[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[b].dstSet = control->descriptorSets[i];
+            descriptorWrites[b].dstBinding = b;
+            descriptorWrites[b].dstArrayElement = 0;
+            descriptorWrites[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[b].descriptorCount = 1;
+            descriptorWrites[b].pBufferInfo = &bufferInfos[b];
+        }
+
+        vkUpdateDescriptorSets(context->device, 3, descriptorWrites, 0, NULL);
+    }
+}
+
+// What the direct kernel's descriptor set for setIndex binds as its uniform buffer
+VkBuffer computeUniformBuffer(Context* context, uint32_t setIndex) {
+    return context->adaptiveTimeStep ? context->timeStepControl.stateBuffer : context->uniformBuffers[setIndex];
+}
+
+// Starts from the largest step at the simulated time restored from a checkpoint, if any
+void recordTimeStepReset(Context* context, VkCommandBuffer commandBuffer) {
+    float time = (float)context->simulationTime;
+    TimeStepState state = {
+        .deltaTime = context->timeStep,
+        .time = time,
+        .timeLow = (float)(context->simulationTime - (double)time),
+        .smallestTimeStep = context->timeStep,
+        .largestTimeStep = context->minTimeStep
+    };
+    vkCmdUpdateBuffer(commandBuffer, context->timeStepControl.stateBuffer, 0, sizeof(TimeStepState), &state);
+    recordTimeStepBarrier(commandBuffer);
+}
+
+// Picks the step after the one that wrote shaderStorageBuffers[setIndex] and its accelerations.
+// Without advance the time stays put, for the first step after initializeAccelerations.
+void recordTimeStepUpdate(Context* context, VkCommandBuffer commandBuffer, uint32_t setIndex, bool advance) {
+    TimeStepControl* control = &context->timeStepControl;
+
+    TimeStepPushConstants pushConstants = {
+        .particleCount = context->PARTICLE_COUNT,
+        .advance = advance ? 1 : 0,
+        .accuracy = context->timeStepAccuracy,
+        .minTimeStep = context->minTimeStep,
+        .maxTimeStep = context->timeStep
+    };
+
+    recordComputeBarrier(commandBuffer);
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, control->pipelineLayout, 0, 1, &control->descriptorSets[setIndex], 0, NULL);
+    vkCmdPushConstants(commandBuffer, control->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, control->pipelines[TIME_STEP_PASS_REDUCE]);
+    vkCmdDispatch(commandBuffer, (context->PARTICLE_COUNT + TIME_STEP_REDUCE_SIZE - 1) / TIME_STEP_REDUCE_SIZE, 1, 1);
+    recordComputeBarrier(commandBuffer);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, control->pipelines[TIME_STEP_PASS_UPDATE]);
+    vkCmdDispatch(commandBuffer, 1, 1, 1);
+    recordTimeStepBarrier(commandBuffer);
+}
+
+// Like recordComputeBarrier, and also makes the new step visible to the kernels' uniform reads
+void recordTimeStepBarrier(VkCommandBuffer commandBuffer) {
+    VkMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT
+    };
+    VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+    vkCmdPipelineBarrier(commandBuffer, stages, stages, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+// Appends the state to a particle readback, so checkpoints get the time that goes with
+// their particles. Recorded after recordParticleReadback on the compute queue.
+void recordTimeStepReadback(Context* context, VkCommandBuffer commandBuffer, VkBuffer dstBuffer, VkDeviceSize dstOffset) {
+    VkMemoryBarrier computeBarrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &computeBarrier, 0, NULL, 0, NULL);
+
+    VkBufferCopy copyRegion = {
+        .dstOffset = dstOffset,
+        .size = sizeof(TimeStepState)
+    };
+    vkCmdCopyBuffer(commandBuffer, context->timeStepControl.stateBuffer, dstBuffer, 1, &copyRegion);
+
+    VkMemoryBarrier hostBarrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, NULL, 0, NULL);
+}
+
+// The device has to be idle
+void printTimeStepStats(Context* context) {
+    TimeStepState state;
+    readbackBuffer(context, context->timeStepControl.stateBuffer, sizeof(TimeStepState), &state);
+
+    printf("Adaptive time step: time %g after %llu steps, steps between %g and %g, next %g\n",
+        (double)state.time + (double)state.timeLow, (unsigned long long)context->stepIndex,
+        state.smallestTimeStep, state.largestTimeStep, state.deltaTime);
+}
+
+void cleanupTimeStep(Context* context) {
+    TimeStepControl* control = &context->timeStepControl;
+
+    for (uint32_t i = 0; i < TIME_STEP_PASS_COUNT; i++) {
+        vkDestroyPipeline(context->device, control->pipelines[i], NULL);
+    }
+    vkDestroyPipelineLayout(context->device, control->pipelineLayout, NULL);
+    vkDestroyDescriptorPool(context->device, control->descriptorPool, NULL);
+    vkDestroyDescriptorSetLayout(context->device, control->descriptorSetLayout, NULL);
+
+    destroyBuffer(context, control->stateBuffer, control->stateBufferAllocation);
+    free(control->descriptorSets);
+}
@@ -0,0 +1,24 @@
+#ifndef VKTIMESTEP_H
+#define VKTIMESTEP_H
+
+#include "types.h"
+
+// Must match REDUCE_SIZE in shaders/time_step_common.glsl
+#define TIME_STEP_REDUCE_SIZE 256
+
+void createTimeStepResources(Context* context);
+void createTimeStepDescriptorSetLayout(Context* context);
+void createTimeStepPipelines(Context* context);
+void createTimeStepBuffer(Context* context);
+void createTimeStepDescriptorSets(Context* context);
+
+VkBuffer computeUniformBuffer(Context* context, uint32_t setIndex);
+void recordTimeStepReset(Context* context, VkCommandBuffer commandBuffer);
+void recordTimeStepUpdate(Context* context, VkCommandBuffer commandBuffer, uint32_t setIndex, bool advance);
+void recordTimeStepBarrier(VkCommandBuffer commandBuffer);
+void recordTimeStepReadback(Context* context, VkCommandBuffer commandBuffer, VkBuffer dstBuffer, VkDeviceSize dstOffset);
+
+void printTimeStepStats(Context* context);
+void cleanupTimeStep(Context* context);
+
+#endif
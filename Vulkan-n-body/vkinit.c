@@ -1,4 +1,12 @@
 #include "vkinit.h"
+#include "vkDraw.h"
+#include "vkAllocator.h"
+#include "vkStaging.h"
+#include "vkOwnership.h"
+#include "particles.h"
+#include "checkpoint.h"
+#include "embeddedShaders.h"
+#include "vkTimeStep.h"
 
 #include <limits.h>
 #include <stdio.h>
@@ -22,13 +30,16 @@ void createInstance(Context* context) {
         .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
         .pEngineName = "No Engine",
         .engineVersion = VK_MAKE_VERSION(1, 0, 0),
-        .apiVersion = VK_API_VERSION_1_0,
+        .apiVersion = VK_API_VERSION_1_2, // timeline semaphores
         .pNext = NULL
     };
 
     uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    const char** glfwExtensions = NULL;
+    // Headless runs never initialize GLFW and need no surface extensions
+    if (!context->headless) {
+        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    }
 
     const char** glfwExtensionsWithDebug = malloc(sizeof(const char*) * (glfwExtensionCount + 1));
 
@@ -194,10 +205,43 @@ void pickPhysicalDevice(Context* context) {
     }
 
     context->queueFamilyIndices = findQueueFamilies(context->physicalDevice, context->surface);
+    if (!context->headless && context->queueFamilyIndices.computeFamily != context->queueFamilyIndices.graphicsFamily) {
+        printf("Async compute on queue family %u\n", context->queueFamilyIndices.computeFamily);
+    }
+    if (context->queueFamilyIndices.transferFamily != context->queueFamilyIndices.computeFamily) {
+        printf("Uploads on transfer queue family %u\n", context->queueFamilyIndices.transferFamily);
+    }
 }
 
 bool isDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surface) {
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(device, &deviceProperties);
+    if (deviceProperties.apiVersion < VK_API_VERSION_1_2) {
+        printf("Vulkan 1.2 not supported!\n");
+        return false;
+    }
+    VkPhysicalDeviceVulkan12Features vulkan12Features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES
+    };
+    VkPhysicalDeviceFeatures2 features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &vulkan12Features
+    };
+    vkGetPhysicalDeviceFeatures2(device, &features);
+    if (!vulkan12Features.timelineSemaphore) {
+        printf("Timeline semaphores not supported!\n");
+        return false;
+    }
+
     QueueFamilyIndices indices = findQueueFamilies(device, surface);
+    // Without a surface (headless) any device with a compute queue will do
+    if (surface == VK_NULL_HANDLE) {
+        if (!indices.HasComputeFamily) {
+            printf("Compute queuefamily not supported!\n");
+            return false;
+        }
+        return true;
+    }
     if (!(indices.HasGraphicsFamily && indices.HasPresentFamily)) {
         printf("Queuefalmily not supported!\n");
         return false;
@@ -256,16 +300,52 @@ QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device, VkSurfaceKHR surfa
             indices.graphicsFamily = i;
             indices.HasGraphicsFamily = true;
         }
-        VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
-        if (presentSupport) {
-            indices.presentFamily = i;
-            indices.HasPresentFamily = true;
+        if (surface != VK_NULL_HANDLE) {
+            VkBool32 presentSupport = false;
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+            if (presentSupport) {
+                indices.presentFamily = i;
+                indices.HasPresentFamily = true;
+            }
         }
         if (indices.HasGraphicsFamily && indices.HasPresentFamily) {
             break;
         }
     }
+
+    // Prefer a family without graphics so the simulation can run next to rendering,
+    // otherwise share the graphics family
+    for (int i = 0; i < queueFamilyCount; i++) {
+        if ((queueFamilyProperties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamilyProperties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+            indices.computeFamily = i;
+            indices.HasComputeFamily = true;
+            break;
+        }
+    }
+    if (!indices.HasComputeFamily && indices.HasGraphicsFamily) {
+        indices.computeFamily = indices.graphicsFamily;
+        indices.HasComputeFamily = true;
+    }
+    for (int i = 0; i < queueFamilyCount && !indices.HasComputeFamily; i++) {
+        if (queueFamilyProperties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) {
+            indices.computeFamily = i;
+            indices.HasComputeFamily = true;
+        }
+    }
+
+    // A copy only family is usually backed by DMA engines that move data without
+    // taking time from the compute or graphics queues
+    for (int i = 0; i < queueFamilyCount; i++) {
+        if ((queueFamilyProperties[i].queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueFamilyProperties[i].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            indices.transferFamily = i;
+            indices.HasTransferFamily = true;
+            break;
+        }
+    }
+    if (!indices.HasTransferFamily) {
+        indices.transferFamily = indices.computeFamily;
+        indices.HasTransferFamily = indices.HasComputeFamily;
+    }
     free(queueFamilyProperties);
     return indices;
 }
@@ -276,19 +356,42 @@ void createLogicalDevice(Context* context) {
     VkPhysicalDeviceFeatures deviceFeatures;
     vkGetPhysicalDeviceFeatures(context->physicalDevice, &deviceFeatures);
 
-    VkDeviceQueueCreateInfo queues[2];
-    getFamilyDeviceQueues(queues, indices);
+    VkPhysicalDeviceVulkan12Features supportedFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES
+    };
+    VkPhysicalDeviceFeatures2 features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &supportedFeatures
+    };
+    vkGetPhysicalDeviceFeatures2(context->physicalDevice, &features);
+    // optional, the particle mesh falls back to 32 bit fixed point without them
+    context->int64Atomics = deviceFeatures.shaderInt64 && supportedFeatures.shaderBufferInt64Atomics;
+
+    VkPhysicalDeviceVulkan12Features vulkan12Features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+        .timelineSemaphore = VK_TRUE,
+        .shaderBufferInt64Atomics = context->int64Atomics
+    };
+
+    VkDeviceQueueCreateInfo queues[4];
+    uint32_t queueCount = getFamilyDeviceQueues(queues, indices, context->headless);
 
     VkDeviceCreateInfo createInfo = {
       .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
       //.pQueueCreateInfos = &queueCreateInfo,
       .pQueueCreateInfos = queues,
-      .queueCreateInfoCount = 1,
+      .queueCreateInfoCount = queueCount,
       .pEnabledFeatures = &deviceFeatures,
       .enabledExtensionCount = deviceExtensionsCount,
-      .ppEnabledExtensionNames = deviceExtensions
+      .ppEnabledExtensionNames = deviceExtensions,
+      .pNext = &vulkan12Features
     };
 
+    if (context->headless) {
+        createInfo.enabledExtensionCount = 0;
+        createInfo.ppEnabledExtensionNames = NULL;
+    }
+
     if (ENABLEVALIDATIONLAYERS) {
         createInfo.enabledLayerCount = validationLayerCount;
         createInfo.ppEnabledLayerNames = validationLayers;
@@ -300,33 +403,49 @@ void createLogicalDevice(Context* context) {
     VkResult result = vkCreateDevice(context->physicalDevice, &createInfo, NULL, &context->device);
     checkErr(result, "failed to create logical device!");
 
+    if (context->headless) {
+        vkGetDeviceQueue(context->device, context->queueFamilyIndices.computeFamily, 0, &context->computeQueue);
+        vkGetDeviceQueue(context->device, context->queueFamilyIndices.transferFamily, 0, &context->transferQueue);
+        return;
+    }
+
+    // Without a dedicated compute family computeQueue is the graphics queue
     vkGetDeviceQueue(context->device, context->queueFamilyIndices.graphicsFamily, 0, &context->graphicsQueue);
-    vkGetDeviceQueue(context->device, context->queueFamilyIndices.graphicsFamily, 0, &context->computeQueue);
+    vkGetDeviceQueue(context->device, context->queueFamilyIndices.computeFamily, 0, &context->computeQueue);
     vkGetDeviceQueue(context->device, context->queueFamilyIndices.presentFamily, 0, &context->presentQueue);
+    vkGetDeviceQueue(context->device, context->queueFamilyIndices.transferFamily, 0, &context->transferQueue);
 }
 
-void getFamilyDeviceQueues(VkDeviceQueueCreateInfo* queues, QueueFamilyIndices indices) {
+// Fills one create info per distinct family and returns how many were written.
+uint32_t getFamilyDeviceQueues(VkDeviceQueueCreateInfo* queues, QueueFamilyIndices indices, bool headless) {
+    // Must outlive vkCreateDevice
+    static const float QueuePriority = 1.0f;
 
-    float QueuePriority = 1.0f;
-    // GraphicsQueue
-    VkDeviceQueueCreateInfo graphicsQueueCreateInfo = {
-      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-      .queueFamilyIndex = indices.graphicsFamily,
-      .queueCount = 1
-    };
-
-    graphicsQueueCreateInfo.pQueuePriorities = &QueuePriority;
-    queues[0] = graphicsQueueCreateInfo;
+    uint32_t families[4] = { indices.computeFamily, indices.transferFamily, indices.graphicsFamily, indices.presentFamily };
+    uint32_t familyCount = headless ? 2 : 4;
 
-    // PresentQueue
-    VkDeviceQueueCreateInfo presentQueueCreateInfo = {
-      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-      .queueFamilyIndex = indices.presentFamily,
-      .queueCount = 1
-    };
+    uint32_t queueCount = 0;
+    for (uint32_t i = 0; i < familyCount; i++) {
+        bool duplicate = false;
+        for (uint32_t j = 0; j < queueCount; j++) {
+            if (queues[j].queueFamilyIndex == families[i]) {
+                duplicate = true;
+                break;
+            }
+        }
+        if (duplicate) {
+            continue;
+        }
 
-    presentQueueCreateInfo.pQueuePriorities = &QueuePriority;
-    queues[1] = presentQueueCreateInfo;
+        VkDeviceQueueCreateInfo queueCreateInfo = {
+          .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+          .queueFamilyIndex = families[i],
+          .queueCount = 1,
+          .pQueuePriorities = &QueuePriority
+        };
+        queues[queueCount++] = queueCreateInfo;
+    }
+    return queueCount;
 }
 
 void createSwapChain(Context* context) {
@@ -523,29 +642,29 @@ void createRenderPass(Context* context) {
     checkErr(result, "failed to create render pass!");
 }
 
+// 0 uniforms, 1 particles in, 2 particles out, 3 accelerations in, 4 accelerations out.
+// The Euler kernels don't read the accelerations, but every binding is always written.
 void createComputeDescriptorSetLayout(Context* context) {
-    VkDescriptorSetLayoutBinding layoutBindings[3] = { 0 };
-    layoutBindings[0].binding = 0;
-    layoutBindings[0].descriptorCount = 1;
-    layoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    layoutBindings[0].pImmutableSamplers = NULL;
-    layoutBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-
-    layoutBindings[1].binding = 1;
-    layoutBindings[1].descriptorCount = 1;
-    layoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    layoutBindings[1].pImmutableSamplers = NULL;
-    layoutBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-
-    layoutBindings[2].binding = 2;
-    layoutBindings[2].descriptorCount = 1;
-    layoutBindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    layoutBindings[2].pImmutableSamplers = NULL;
-    layoutBindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    // The reference kernel reads the particles straight from the buffer, drifting them there
+    // would double its loads per interaction and repeat every drift N times. Checked here,
+    // before the autotuner compiles the first candidate.
+    if (context->integrator != INTEGRATOR_EULER && context->computeKernel == COMPUTE_KERNEL_REFERENCE) {
+        printf("Kick-drift-kick needs the tiled kernel, the reference kernel only supports the Euler integrator!\n");
+        exit(1);
+    }
+
+    VkDescriptorSetLayoutBinding layoutBindings[5] = { 0 };
+    for (uint32_t i = 0; i < 5; i++) {
+        layoutBindings[i].binding = i;
+        layoutBindings[i].descriptorCount = 1;
+        layoutBindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        layoutBindings[i].pImmutableSamplers = NULL;
+        layoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
 
     VkDescriptorSetLayoutCreateInfo layoutInfo = {
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-        .bindingCount = 3,
+        .bindingCount = 5,
         .pBindings = layoutBindings
     };
     
@@ -554,13 +673,8 @@ void createComputeDescriptorSetLayout(Context* context) {
 }
 
 void createGraphicsPipeline(Context* context) {
-    char* vertShaderCode = NULL;
-    char* fragShaderCode = NULL;
-    uint32_t vertShaderCodeSize = (uint32_t)readFile("shaders/compiled/vert.spv", &vertShaderCode);
-    uint32_t fragShaderCodeSize = (uint32_t)readFile("shaders/compiled/frag.spv", &fragShaderCode);
-
-    VkShaderModule vertShaderModule = createShaderModule(context->device, vertShaderCode, vertShaderCodeSize);
-    VkShaderModule fragShaderModule = createShaderModule(context->device, fragShaderCode, fragShaderCodeSize);
+    VkShaderModule vertShaderModule = loadShaderModule(context, "vert");
+    VkShaderModule fragShaderModule = loadShaderModule(context, "frag");
 
     VkPipelineShaderStageCreateInfo vertShaderStageInfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
@@ -577,9 +691,9 @@ void createGraphicsPipeline(Context* context) {
     VkPipelineShaderStageCreateInfo shaderStages[2] = { vertShaderStageInfo, fragShaderStageInfo };
 
     VkVertexInputBindingDescription bindingDescriptions[1];
-    getBindingDescriptions(bindingDescriptions);
+    getBindingDescriptions(bindingDescriptions, context->renderStreamStride > 0);
     VkVertexInputAttributeDescription attributeDescriptions[2];
-    getAttributeDescriptions(attributeDescriptions);
+    getAttributeDescriptions(attributeDescriptions, context->renderStreamStride > 0);
     VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
         .vertexBindingDescriptionCount = 1,
@@ -674,45 +788,47 @@ void createGraphicsPipeline(Context* context) {
         .basePipelineHandle = VK_NULL_HANDLE, // Optional
     };
 
-    result = vkCreateGraphicsPipelines(context->device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &context->graphicsPipeline);
+    result = vkCreateGraphicsPipelines(context->device, context->pipelineCache, 1, &pipelineInfo, NULL, &context->graphicsPipeline);
     checkErr(result, "failed to create graphics pipeline!");
 
     vkDestroyShaderModule(context->device, fragShaderModule, NULL);
     vkDestroyShaderModule(context->device, vertShaderModule, NULL);
-    free(vertShaderCode);
-    free(fragShaderCode);
 }
 
-uint32_t readFile(const char* filename, char** buffer) {
-    FILE* file = fopen(filename, "rb");
-    if (file == NULL) {
-        perror("Failed to open file!");
-        exit(1);
-    }
-    fseek(file, 0, SEEK_END);
-    long length = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    if (length <= 0) {
-        printf("Failed to get length of file!");
-        fclose(file);
-        exit(1);
+// Shaders are compiled into the binary, see embeddedShaders.c, so startup reads no files.
+// With shaderOverrideDir set, <shaderOverrideDir>/<name>.spv is used instead when it
+// exists, which lets a recompiled shader be tried without rebuilding.
+VkShaderModule loadShaderModule(Context* context, const char* name) {
+    if (context->shaderOverrideDir != NULL) {
+        size_t pathLength = strlen(context->shaderOverrideDir) + strlen(name) + 5;
+        char* path = (char*)malloc(pathLength + 1);
+        snprintf(path, pathLength + 1, "%s/%s.spv", context->shaderOverrideDir, name);
+
+        uint64_t fileSize = 0;
+        void* file = mapFile(path, &fileSize);
+        if (file != NULL) {
+            printf("Shader %s loaded from %s\n", name, path);
+            VkShaderModule shaderModule = createShaderModule(context->device, (const uint32_t*)file, (size_t)fileSize);
+            unmapFile(file, fileSize);
+            free(path);
+            return shaderModule;
+        }
+        free(path);
     }
-    *buffer = (char*)malloc(length * sizeof(char));
-    if (*buffer == NULL) {
-        printf("Failed to allocate buffer!");
-        fclose(file);
+
+    const EmbeddedShader* shader = findEmbeddedShader(name);
+    if (shader == NULL) {
+        printf("no embedded shader %s!\n", name);
         exit(1);
     }
-    fread(*buffer, sizeof(char), length, file);
-    fclose(file);
-    return length;
+    return createShaderModule(context->device, shader->code, shader->codeSize);
 }
 
-VkShaderModule createShaderModule(VkDevice device, uint8_t* code, uint32_t codeSize) {
+VkShaderModule createShaderModule(VkDevice device, const uint32_t* code, size_t codeSize) {
     VkShaderModuleCreateInfo createInfo = {
         .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
         .codeSize = codeSize,
-        .pCode = (uint32_t*)code
+        .pCode = code
     };
 
     VkShaderModule shaderModule;
@@ -722,25 +838,26 @@ VkShaderModule createShaderModule(VkDevice device, uint8_t* code, uint32_t codeS
     return shaderModule;
 }
 
-void getBindingDescriptions(VkVertexInputBindingDescription* bindingDescriptions) {
+// renderStream: vertices come from the packed RenderVertex stream instead of the particles
+void getBindingDescriptions(VkVertexInputBindingDescription* bindingDescriptions, bool renderStream) {
     bindingDescriptions[0] = (VkVertexInputBindingDescription){ 0 };
     bindingDescriptions[0].binding = 0;
-    bindingDescriptions[0].stride = sizeof(Particle);
+    bindingDescriptions[0].stride = renderStream ? sizeof(RenderVertex) : sizeof(Particle);
     bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 }
 
-void getAttributeDescriptions(VkVertexInputAttributeDescription* attributeDescriptions) {
+void getAttributeDescriptions(VkVertexInputAttributeDescription* attributeDescriptions, bool renderStream) {
     attributeDescriptions[0] = (VkVertexInputAttributeDescription){ 0 };
     attributeDescriptions[0].binding = 0;
     attributeDescriptions[0].location = 0;
-    attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
-    attributeDescriptions[0].offset = offsetof(Particle, pos);
+    attributeDescriptions[0].format = renderStream ? VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_R32G32_SFLOAT;
+    attributeDescriptions[0].offset = renderStream ? offsetof(RenderVertex, pos) : offsetof(Particle, pos);
 
     attributeDescriptions[1] = (VkVertexInputAttributeDescription){ 0 };
     attributeDescriptions[1].binding = 0;
     attributeDescriptions[1].location = 1;
-    attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attributeDescriptions[1].offset = offsetof(Particle, col);
+    attributeDescriptions[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+    attributeDescriptions[1].offset = renderStream ? offsetof(RenderVertex, col) : offsetof(Particle, col);
 }
 
 void createFramebuffers(Context* context) {
@@ -769,13 +886,20 @@ void createCommandPool(Context* context) {
     VkCommandPoolCreateInfo poolInfo = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
         .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-        .queueFamilyIndex = queueFamilyIndices.graphicsFamily
+        .queueFamilyIndex = context->headless ? queueFamilyIndices.computeFamily : queueFamilyIndices.graphicsFamily
     };
     VkResult result = vkCreateCommandPool(context->device, &poolInfo, NULL, &context->commandPool);
     checkErr(result, "failed to create command pool!");
+
+    poolInfo.queueFamilyIndex = queueFamilyIndices.computeFamily;
+    result = vkCreateCommandPool(context->device, &poolInfo, NULL, &context->computeCommandPool);
+    checkErr(result, "failed to create compute command pool!");
 }
 
-void createBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer* buffer, VkDeviceMemory* bufferMemory) {
+// Buffers are exclusive to one queue family at a time, the ones used by more than one are
+// moved with ownership transfers, see vkOwnership.c. The memory is sub-allocated from one of
+// the allocator's blocks, see vkAllocator.c.
+void createBuffer(Context* context, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, AllocationStrategy strategy, VkBuffer* buffer, Allocation* allocation) {
 
     VkBufferCreateInfo bufferInfo = {
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
@@ -784,25 +908,23 @@ void createBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize
         .sharingMode = VK_SHARING_MODE_EXCLUSIVE
     };
 
-    VkResult result = vkCreateBuffer(device, &bufferInfo, NULL, buffer);
+    VkResult result = vkCreateBuffer(context->device, &bufferInfo, NULL, buffer);
     checkErr(result, "failed to create buffer!");
 
     VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(device, *buffer, &memRequirements);
+    vkGetBufferMemoryRequirements(context->device, *buffer, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memRequirements.size,
-        .memoryTypeIndex = findMemoryType(physicalDevice, memRequirements.memoryTypeBits, properties)
-    };
-
-    result = vkAllocateMemory(device, &allocInfo, NULL, bufferMemory);
-    checkErr(result, "failed to allocate buffer memory!");
+    *allocation = allocateMemory(context, memRequirements, properties, strategy);
 
-    result = vkBindBufferMemory(device, *buffer, *bufferMemory, 0);
+    result = vkBindBufferMemory(context->device, *buffer, allocation->memory, allocation->offset);
     checkErr(result, "failed to bind buffer memory!");
 }
 
+void destroyBuffer(Context* context, VkBuffer buffer, Allocation allocation) {
+    vkDestroyBuffer(context->device, buffer, NULL);
+    freeAllocation(context, allocation);
+}
+
 uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties) {
     VkPhysicalDeviceMemoryProperties memProperties;
     vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
@@ -815,11 +937,25 @@ uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, Vk
     exit(1);
 }
 
-void copyBuffer(Context* context, VkCommandPool commandPool, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+// Host cached memory is read back at memcpy speed, uncached memory is many times slower
+VkMemoryPropertyFlags readbackMemoryProperties(VkPhysicalDevice physicalDevice) {
+    VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+        if ((memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return properties;
+        }
+    }
+    return VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+}
+
+// Runs on the compute queue, whose family owns the buffers outside of a frame
+void copyBuffer(Context* context, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
     VkCommandBufferAllocateInfo allocInfo = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
         .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandPool = commandPool,
+        .commandPool = context->computeCommandPool,
         .commandBufferCount = 1
     };
 
@@ -845,20 +981,42 @@ void copyBuffer(Context* context, VkCommandPool commandPool, VkBuffer srcBuffer,
         .pCommandBuffers = &commandBuffer
     };
 
-    vkQueueSubmit(context->graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(context->graphicsQueue);
+    vkQueueSubmit(context->computeQueue, 1, &submitInfo, VK_NULL_HANDLE);
+    vkQueueWaitIdle(context->computeQueue);
+
+    vkFreeCommandBuffers(context->device, context->computeCommandPool, 1, &commandBuffer);
+}
+
+void readbackBuffer(Context* context, VkBuffer srcBuffer, VkDeviceSize size, void* dst) {
+    VkBuffer stagingBuffer;
+    Allocation stagingAllocation;
+    createBuffer(context,
+        size,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        ALLOCATION_STRATEGY_FREE_LIST,
+        &stagingBuffer,
+        &stagingAllocation);
+
+    copyBuffer(context, srcBuffer, stagingBuffer, size);
+
+    memcpy(dst, stagingAllocation.mapped, (size_t)size);
 
-    vkFreeCommandBuffers(context->device, commandPool, 1, &commandBuffer);
+    destroyBuffer(context, stagingBuffer, stagingAllocation);
 }
 
+// Command buffers are recorded on first use and resubmitted after that. Called again
+// when the swapchain is recreated, which changes the framebuffers they reference.
 void createCommandBuffers(Context* context) {
-    context->commandBuffers = (VkCommandBuffer*)malloc(sizeof(VkCommandBuffer) * context->MAX_FRAMES_IN_FLIGHT);
+    uint32_t commandBufferCount = context->MAX_FRAMES_IN_FLIGHT * context->swapChainImageCount * context->MAX_FRAMES_IN_FLIGHT;
+    context->commandBuffers = (VkCommandBuffer*)malloc(sizeof(VkCommandBuffer) * commandBufferCount);
+    context->commandBuffersRecorded = (bool*)calloc(commandBufferCount, sizeof(bool));
 
     VkCommandBufferAllocateInfo allocInfo = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
         .commandPool = context->commandPool,
         .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = context->MAX_FRAMES_IN_FLIGHT
+        .commandBufferCount = commandBufferCount
     };
     VkResult result = vkAllocateCommandBuffers(context->device, &allocInfo, context->commandBuffers);
     checkErr(result, "failed to allocate command buffers!");
@@ -867,129 +1025,213 @@ void createCommandBuffers(Context* context) {
 void createSyncObjects(Context* context) {
     context->imageAvailableSemaphores = (VkSemaphore*)malloc(sizeof(VkSemaphore) * context->MAX_FRAMES_IN_FLIGHT);
     context->renderFinishedSemaphores = (VkSemaphore*)malloc(sizeof(VkSemaphore) * context->MAX_FRAMES_IN_FLIGHT);
-    context->computeFinishedSemaphores = (VkSemaphore*)malloc(sizeof(VkSemaphore) * context->MAX_FRAMES_IN_FLIGHT);
-    context->inFlightFences = (VkFence*)malloc(sizeof(VkFence) * context->MAX_FRAMES_IN_FLIGHT);
-    context->computeInFlightFences = (VkFence*)malloc(sizeof(VkFence) * context->MAX_FRAMES_IN_FLIGHT);
 
     VkSemaphoreCreateInfo semaphoreInfo = {
         .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO
     };
 
-    VkFenceCreateInfo fenceInfo = {
-        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-        .flags = VK_FENCE_CREATE_SIGNALED_BIT
-    };
-
+    // The swapchain only accepts binary semaphores
     for (uint32_t i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
         if (vkCreateSemaphore(context->device, &semaphoreInfo, NULL, &context->imageAvailableSemaphores[i]) != VK_SUCCESS ||
-            vkCreateSemaphore(context->device, &semaphoreInfo, NULL, &context->renderFinishedSemaphores[i]) != VK_SUCCESS ||
-            vkCreateFence(context->device, &fenceInfo, NULL, &context->inFlightFences[i]) != VK_SUCCESS) {
-            printf("failed to create graphics semaphores or fence!\n");
-            exit(1);
-        }
-        if (vkCreateSemaphore(context->device, &semaphoreInfo, NULL, &context->computeFinishedSemaphores[i]) != VK_SUCCESS ||
-            vkCreateFence(context->device, &fenceInfo, NULL, &context->computeInFlightFences[i]) != VK_SUCCESS) {
-            printf("failed to create compute semaphores or fence!");
+            vkCreateSemaphore(context->device, &semaphoreInfo, NULL, &context->renderFinishedSemaphores[i]) != VK_SUCCESS) {
+            printf("failed to create graphics semaphores!\n");
             exit(1);
         }
     }
+
+    // Submission n signals value n on each timeline, replacing the per frame fences
+    VkSemaphoreTypeCreateInfo timelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue = 0
+    };
+    semaphoreInfo.pNext = &timelineInfo;
+    if (vkCreateSemaphore(context->device, &semaphoreInfo, NULL, &context->computeTimeline) != VK_SUCCESS ||
+        vkCreateSemaphore(context->device, &semaphoreInfo, NULL, &context->graphicsTimeline) != VK_SUCCESS) {
+        printf("failed to create timeline semaphores!\n");
+        exit(1);
+    }
 }
 
 
 void createShaderStorageBuffers(Context* context) {
 
-    // Initial particle positions on a circle
-    Particle* particles = (Particle*)malloc(context->PARTICLE_COUNT * sizeof(Particle));
-
-    #define frand ((float)rand() / (float)RAND_MAX)
-    #define rands(x) (rand() > RAND_MAX / 2 ? -x : x)
-    for (int i = 0; i < context->PARTICLE_COUNT; i++) {
-        particles[i].pos.x = rands(frand);
-        particles[i].pos.y = rands(frand);
-        particles[i].vel.x = rands(frand);
-        particles[i].vel.y = rands(frand);
-        particles[i].mss = rands(frand);
-        particles[i].col.x = 1.0f;
-        particles[i].col.y = 0.0f;
-        particles[i].col.z = 1.0f;
-    }
-
     VkDeviceSize bufferSize = sizeof(Particle) * context->PARTICLE_COUNT;
 
-    // Create a staging buffer used to upload data to the gpu
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(context->physicalDevice, 
-        context->device, 
-        bufferSize, 
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
-        &stagingBuffer, 
-        &stagingBufferMemory);
-
-    void* data;
-    vkMapMemory(context->device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, particles, (size_t)bufferSize);
-    vkUnmapMemory(context->device, stagingBufferMemory);
+    // A restart is staged straight out of the mapped checkpoint, without a copy on the host
+    Particle* generated = NULL;
+    CheckpointView checkpoint = { 0 };
+    const Particle* particles;
+    const Particle* previousParticles = NULL;
+    if (context->restartPath != NULL) {
+        checkpoint = mapCheckpoint(context);
+        particles = checkpoint.particles;
+        previousParticles = checkpoint.previousParticles;
+    }
+    else {
+        generated = (Particle*)malloc(context->PARTICLE_COUNT * sizeof(Particle));
+        // uniform or clustered, see InitialConditions and particles.c
+        generateParticles(generated, context->PARTICLE_COUNT, context->initialConditions);
+        particles = generated;
+    }
 
     context->shaderStorageBuffers = (VkBuffer*)malloc(sizeof(VkBuffer) * context->MAX_FRAMES_IN_FLIGHT);
-    context->shaderStorageBuffersMemory = (VkDeviceMemory*)malloc(sizeof(VkDeviceMemory) * context->MAX_FRAMES_IN_FLIGHT);
+    context->shaderStorageBufferAllocations = (Allocation*)malloc(sizeof(Allocation) * context->MAX_FRAMES_IN_FLIGHT);
 
-    // Copy initial particle data to all storage buffers
+    // Exclusive to the compute family. The transfer queue fills them and hands them over below,
+    // a graphics queue in another family draws copies of them, see vkOwnership.c.
     for (uint32_t i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
-        createBuffer(context->physicalDevice,
-            context->device, 
+        createBuffer(context,
             bufferSize,
-            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
+            ALLOCATION_STRATEGY_LINEAR,
             &context->shaderStorageBuffers[i], 
-            &context->shaderStorageBuffersMemory[i]);
-        copyBuffer(context, context->commandPool, stagingBuffer, context->shaderStorageBuffers[i], bufferSize);
+            &context->shaderStorageBufferAllocations[i]);
     }
 
-    vkDestroyBuffer(context->device, stagingBuffer, NULL);
-    vkFreeMemory(context->device, stagingBufferMemory, NULL);
-    free(particles);
+    // Only the compute queue touches the accelerations, initializeAccelerations fills them
+    VkDeviceSize accelerationBufferSize = sizeof(vec2) * context->PARTICLE_COUNT;
+    context->accelerationBuffers = (VkBuffer*)malloc(sizeof(VkBuffer) * context->MAX_FRAMES_IN_FLIGHT);
+    context->accelerationBufferAllocations = (Allocation*)malloc(sizeof(Allocation) * context->MAX_FRAMES_IN_FLIGHT);
+    for (uint32_t i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
+        createBuffer(context,
+            accelerationBufferSize,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            ALLOCATION_STRATEGY_LINEAR,
+            &context->accelerationBuffers[i],
+            &context->accelerationBufferAllocations[i]);
+    }
+
+    if (context->integrator == INTEGRATOR_YOSHIDA) {
+        createBuffer(context, bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            ALLOCATION_STRATEGY_LINEAR, &context->scratchParticleBuffer, &context->scratchParticleBufferAllocation);
+        createBuffer(context, accelerationBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            ALLOCATION_STRATEGY_LINEAR, &context->scratchAccelerationBuffer, &context->scratchAccelerationBufferAllocation);
+    }
+
+    // Every chunk is staged once and copied into all storage buffers. An Euler checkpoint
+    // restores the previous step into the buffers the first step doesn't read.
+    double uploadStart = getTime();
+    if (previousParticles != NULL) {
+        uint32_t latest = context->MAX_FRAMES_IN_FLIGHT - 1;
+        stageUpload(context, &context->shaderStorageBuffers[latest], 1, 0, particles, bufferSize);
+        stageUpload(context, context->shaderStorageBuffers, latest, 0, previousParticles, bufferSize);
+    }
+    else {
+        stageUpload(context, context->shaderStorageBuffers, context->MAX_FRAMES_IN_FLIGHT, 0, particles, bufferSize);
+    }
+    bool separateTransfer = context->queueFamilyIndices.transferFamily != context->queueFamilyIndices.computeFamily;
+    if (separateTransfer) {
+        releaseStagedBuffers(context, context->shaderStorageBuffers, context->MAX_FRAMES_IN_FLIGHT, context->queueFamilyIndices.computeFamily);
+    }
+    finishStagingUploads(context);
+    if (separateTransfer) {
+        acquireTransferredBuffers(context, context->shaderStorageBuffers, context->MAX_FRAMES_IN_FLIGHT);
+    }
+    if (context->printStats) {
+        printf("Uploaded %.1lf MiB to %u storage buffers in %.1lf ms\n", bufferSize / (1024.0 * 1024.0), context->MAX_FRAMES_IN_FLIGHT, (getTime() - uploadStart) * 1000.0);
+    }
+    if (checkpoint.file != NULL) {
+        unmapCheckpoint(&checkpoint);
+    }
+    free(generated);
+
+    // The first step reads the last buffer and writes buffer 0
+    context->latestBuffer = context->MAX_FRAMES_IN_FLIGHT - 1;
 }
 
 void createComputePipeline(Context* context) {
+    const char* compShaderName = computeKernelShaderName(context->computeKernel);
+    printf("Compute kernel: %s\t workgroup %u\t tile %u\t unroll %u\n", compShaderName,
+        context->computeTuning.workgroupSize, context->computeTuning.tileSize, context->computeTuning.unroll);
 
-    char* compShaderCode = NULL;
-    uint32_t compShaderCodeSize = (uint32_t)readFile("shaders/compiled/comp.spv", &compShaderCode);
+    context->computePipelineLayout = createDirectPipelineLayout(context);
 
-    VkShaderModule compShaderModule = createShaderModule(context->device, compShaderCode, compShaderCodeSize);
+    VkShaderModule compShaderModule = loadShaderModule(context, compShaderName);
+    context->computePipeline = createDirectComputePipeline(context, compShaderModule, context->computePipelineLayout, context->computeTuning, context->PARTICLE_COUNT);
+    vkDestroyShaderModule(context->device, compShaderModule, NULL);
+}
 
-    VkPipelineShaderStageCreateInfo computeShaderStageInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
-        .module = compShaderModule,
-        .pName = "main"
+// Barnes-Hut only uses the reference kernel to compare against
+const char* computeKernelShaderName(ComputeKernel kernel) {
+    switch (kernel) {
+    case COMPUTE_KERNEL_TILED:
+        return "comp_tiled";
+    case COMPUTE_KERNEL_REFERENCE:
+    default:
+        return "comp";
+    }
+}
+
+VkPipelineLayout createDirectPipelineLayout(Context* context) {
+    VkPushConstantRange pushConstantRange = {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = sizeof(IntegratorPushConstants)
     };
-    
 
     VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
         .setLayoutCount = 1,
-        .pSetLayouts = &context->computeDescriptorSetLayout
+        .pSetLayouts = &context->computeDescriptorSetLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstantRange
     };
-    
-    VkResult result = vkCreatePipelineLayout(context->device, &pipelineLayoutInfo, NULL, &context->computePipelineLayout);
+
+    VkPipelineLayout layout;
+    VkResult result = vkCreatePipelineLayout(context->device, &pipelineLayoutInfo, NULL, &layout);
     checkErr(result, "failed to create compute pipeline layout!");
+    return layout;
+}
+
+// The particle count and tuning are specialization constants, so the driver compiles the
+// loops with constant bounds. Also used by the autotuner for every candidate.
+VkPipeline createDirectComputePipeline(Context* context, VkShaderModule shaderModule, VkPipelineLayout layout, ComputeTuning tuning, uint32_t particleCount) {
+    // a specialized bool is a 32 bit VkBool32
+    uint32_t constants[5] = { particleCount, tuning.workgroupSize, tuning.tileSize, tuning.unroll, context->integrator != INTEGRATOR_EULER };
+    VkSpecializationMapEntry mapEntries[5];
+    for (uint32_t i = 0; i < 5; i++) {
+        mapEntries[i].constantID = i;
+        mapEntries[i].offset = i * sizeof(uint32_t);
+        mapEntries[i].size = sizeof(uint32_t);
+    }
+    VkSpecializationInfo specializationInfo = {
+        .mapEntryCount = 5,
+        .pMapEntries = mapEntries,
+        .dataSize = sizeof(constants),
+        .pData = constants
+    };
 
     VkComputePipelineCreateInfo pipelineInfo = {
         .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-        .layout = context->computePipelineLayout,
-        .stage = computeShaderStageInfo
+        .layout = layout,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = shaderModule,
+            .pName = "main",
+            .pSpecializationInfo = &specializationInfo
+        }
     };
 
-    result = vkCreateComputePipelines(context->device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &context->computePipeline);
+    VkPipeline pipeline;
+    VkResult result = vkCreateComputePipelines(context->device, context->pipelineCache, 1, &pipelineInfo, NULL, &pipeline);
     checkErr(result, "failed to create compute pipeline!");
+    return pipeline;
+}
 
-    vkDestroyShaderModule(context->device, compShaderModule, NULL);
+// Rounded up, the shaders mask the invocations past the last particle
+uint32_t computeGroupCount(uint32_t particleCount, ComputeTuning tuning) {
+    return (particleCount + tuning.workgroupSize - 1) / tuning.workgroupSize;
 }
 
 void createComputeDescriptorSets(Context* context) {
-    VkDescriptorSetLayout* layouts = (VkDescriptorSetLayout*)malloc(sizeof(VkDescriptorSetLayout) * context->MAX_FRAMES_IN_FLIGHT);
-    for (int i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
+    // Yoshida adds the two sets through the scratch buffers for every frame slot
+    uint32_t substepSetCount = context->integrator == INTEGRATOR_YOSHIDA ? 2 * context->MAX_FRAMES_IN_FLIGHT : 0;
+    uint32_t setCount = context->MAX_FRAMES_IN_FLIGHT + substepSetCount;
+    VkDescriptorSetLayout* layouts = (VkDescriptorSetLayout*)malloc(sizeof(VkDescriptorSetLayout) * setCount);
+    for (uint32_t i = 0; i < setCount; i++) {
         layouts[i] = context->computeDescriptorSetLayout;
     }
 
@@ -1004,67 +1246,72 @@ void createComputeDescriptorSets(Context* context) {
     VkResult result = vkAllocateDescriptorSets(context->device, &allocInfo, context->computeDescriptorSets);
     checkErr(result, "failed to allocate descriptor sets!");
 
-    for (size_t i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
-        VkDescriptorBufferInfo uniformBufferInfo = {
-            .buffer = context->uniformBuffers[i],
-            .offset = 0,
-            .range = sizeof(UniformBufferObject)
-        };
+    for (uint32_t i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
+        uint32_t previous = (i + context->MAX_FRAMES_IN_FLIGHT - 1) % context->MAX_FRAMES_IN_FLIGHT;
+        writeComputeDescriptorSet(context, context->computeDescriptorSets[i], computeUniformBuffer(context, i),
+            context->shaderStorageBuffers[previous], context->shaderStorageBuffers[i],
+            context->accelerationBuffers[previous], context->accelerationBuffers[i], context->PARTICLE_COUNT);
+    }
 
-        VkWriteDescriptorSet descriptorWrites[3] = { 0 };
-        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[0].dstSet = context->computeDescriptorSets[i];
-        descriptorWrites[0].dstBinding = 0;
-        descriptorWrites[0].dstArrayElement = 0;
-        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites[0].descriptorCount = 1;
-        descriptorWrites[0].pBufferInfo = &uniformBufferInfo;
-
-        VkDescriptorBufferInfo storageBufferInfoLastFrame = {
-            .buffer = context->shaderStorageBuffers[(i - 1) % context->MAX_FRAMES_IN_FLIGHT],
-            .offset = 0,
-            .range = sizeof(Particle) * context->PARTICLE_COUNT
-        };
+    if (substepSetCount > 0) {
+        allocInfo.descriptorSetCount = substepSetCount;
+        context->substepDescriptorSets = (VkDescriptorSet*)malloc(sizeof(VkDescriptorSet) * substepSetCount);
+        result = vkAllocateDescriptorSets(context->device, &allocInfo, context->substepDescriptorSets);
+        checkErr(result, "failed to allocate substep descriptor sets!");
+
+        for (uint32_t i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
+            writeComputeDescriptorSet(context, context->substepDescriptorSets[2 * i], computeUniformBuffer(context, i),
+                context->shaderStorageBuffers[i], context->scratchParticleBuffer,
+                context->accelerationBuffers[i], context->scratchAccelerationBuffer, context->PARTICLE_COUNT);
+            writeComputeDescriptorSet(context, context->substepDescriptorSets[2 * i + 1], computeUniformBuffer(context, i),
+                context->scratchParticleBuffer, context->shaderStorageBuffers[i],
+                context->scratchAccelerationBuffer, context->accelerationBuffers[i], context->PARTICLE_COUNT);
+        }
+    }
+    free(layouts);
+}
 
-        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[1].dstSet = context->computeDescriptorSets[i];
-        descriptorWrites[1].dstBinding = 1;
-        descriptorWrites[1].dstArrayElement = 0;
-        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        descriptorWrites[1].descriptorCount = 1;
-        descriptorWrites[1].pBufferInfo = &storageBufferInfoLastFrame;
-
-        VkDescriptorBufferInfo storageBufferInfoCurrentFrame = {
-            .buffer = context->shaderStorageBuffers[i],
-            .offset = 0,
-            .range = sizeof(Particle) * context->PARTICLE_COUNT
-        };
-        
-        descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[2].dstSet = context->computeDescriptorSets[i];
-        descriptorWrites[2].dstBinding = 2;
-        descriptorWrites[2].dstArrayElement = 0;
-        descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        descriptorWrites[2].descriptorCount = 1;
-        descriptorWrites[2].pBufferInfo = &storageBufferInfoCurrentFrame;
+// Also used by the autotuner for its scratch buffers
+void writeComputeDescriptorSet(Context* context, VkDescriptorSet descriptorSet, VkBuffer uniformBuffer,
+    VkBuffer particlesIn, VkBuffer particlesOut, VkBuffer accelerationsIn, VkBuffer accelerationsOut, uint32_t particleCount) {
+    VkDescriptorBufferInfo bufferInfos[5] = {
+        { .buffer = uniformBuffer, .offset = 0, .range = sizeof(UniformBufferObject) },
+        { .buffer = particlesIn, .offset = 0, .range = sizeof(Particle) * particleCount },
+        { .buffer = particlesOut, .offset = 0, .range = sizeof(Particle) * particleCount },
+        { .buffer = accelerationsIn, .offset = 0, .range = sizeof(vec2) * particleCount },
+        { .buffer = accelerationsOut, .offset = 0, .range = sizeof(vec2) * particleCount }
+    };
 
-        vkUpdateDescriptorSets(context->device, 3, descriptorWrites, 0, NULL);
+    VkWriteDescriptorSet descriptorWrites[5] = { 0 };
+    for (uint32_t b = 0; b < 5; b++) {
+        descriptorWrites[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[b].dstSet = descriptorSet;
+        descriptorWrites[b].dstBinding = b;
+        descriptorWrites[b].dstArrayElement = 0;
+        descriptorWrites[b].descriptorType = b == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[b].descriptorCount = 1;
+        descriptorWrites[b].pBufferInfo = &bufferInfos[b];
     }
+
+    vkUpdateDescriptorSets(context->device, 5, descriptorWrites, 0, NULL);
 }
 
 void createDescriptorPool(Context* context) {
+    // one set per frame slot, three per slot with Yoshida, see createComputeDescriptorSets
+    uint32_t setCount = context->MAX_FRAMES_IN_FLIGHT * (context->integrator == INTEGRATOR_YOSHIDA ? 3 : 1);
+
     VkDescriptorPoolSize poolSizes[2] = { 0 };
     poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = context->MAX_FRAMES_IN_FLIGHT;
+    poolSizes[0].descriptorCount = setCount;
 
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    poolSizes[1].descriptorCount = context->MAX_FRAMES_IN_FLIGHT * 2;
+    poolSizes[1].descriptorCount = setCount * 4;
 
     VkDescriptorPoolCreateInfo poolInfo = {
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
         .poolSizeCount = 2,
         .pPoolSizes = poolSizes,
-        .maxSets = context->MAX_FRAMES_IN_FLIGHT,
+        .maxSets = setCount,
     };
     
     VkResult result = vkCreateDescriptorPool(context->device, &poolInfo, NULL, &context->descriptorPool);
@@ -1075,35 +1322,93 @@ void createUniformBuffers(Context* context) {
     VkDeviceSize bufferSize = sizeof(UniformBufferObject);
 
     context->uniformBuffers = (VkBuffer*)malloc(sizeof(VkBuffer) * context->MAX_FRAMES_IN_FLIGHT);
-    context->uniformBuffersMemory = (VkDeviceMemory*)malloc(sizeof(VkDeviceMemory) * context->MAX_FRAMES_IN_FLIGHT);
+    context->uniformBufferAllocations = (Allocation*)malloc(sizeof(Allocation) * context->MAX_FRAMES_IN_FLIGHT);
     context->uniformBuffersMapped = (void**)malloc(sizeof(void*) * context->MAX_FRAMES_IN_FLIGHT);
 
     for (size_t i = 0; i < context->MAX_FRAMES_IN_FLIGHT; i++) {
-        createBuffer(context->physicalDevice, 
-            context->device, bufferSize, 
+        createBuffer(context,
+            bufferSize, 
             VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 
             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
+            ALLOCATION_STRATEGY_LINEAR,
             &context->uniformBuffers[i], 
-            &context->uniformBuffersMemory[i]);
+            &context->uniformBufferAllocations[i]);
 
-        vkMapMemory(context->device, context->uniformBuffersMemory[i], 0, bufferSize, 0, &context->uniformBuffersMapped[i]);
+        context->uniformBuffersMapped[i] = context->uniformBufferAllocations[i].mapped;
+
+        // Written once: with substeps every submission binds both descriptor sets, so no
+        // uniform buffer is ever idle between frames
+        updateUniformBuffer(context->timeStep, context->uniformBuffersMapped, (uint32_t)i);
     }
 }
 
 void createComputeCommandBuffers(Context* context) {
-    context->computeCommandBuffers = (VkCommandBuffer*)malloc(sizeof(VkCommandBuffer) * context->MAX_FRAMES_IN_FLIGHT);
+    uint32_t commandBufferCount = context->MAX_FRAMES_IN_FLIGHT * context->MAX_FRAMES_IN_FLIGHT;
+    context->computeCommandBuffers = (VkCommandBuffer*)malloc(sizeof(VkCommandBuffer) * commandBufferCount);
+    context->computeCommandBufferSteps = (uint32_t*)calloc(commandBufferCount, sizeof(uint32_t));
 
     VkCommandBufferAllocateInfo allocInfo = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .commandPool = context->commandPool,
+        .commandPool = context->computeCommandPool,
         .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = context->MAX_FRAMES_IN_FLIGHT
+        .commandBufferCount = commandBufferCount
     };
     
     VkResult result = vkAllocateCommandBuffers(context->device, &allocInfo, context->computeCommandBuffers);
     checkErr(result, "failed to allocate compute command buffers!");
 }
 
+// The first kick-drift-kick step reads the accelerations of its input. They are computed
+// by one dispatch with a step scale of 0, which leaves the particles unchanged; checkpoints
+// don't store them, so this also runs after a restart.
+void initializeAccelerations(Context* context) {
+    VkCommandBufferAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandPool = context->computeCommandPool,
+        .commandBufferCount = 1
+    };
+
+    VkCommandBuffer commandBuffer;
+    vkAllocateCommandBuffers(context->device, &allocInfo, &commandBuffer);
+
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        if (context->adaptiveTimeStep) {
+            recordTimeStepReset(context, commandBuffer);
+        }
+
+        // all storage buffers hold the initial state, so this set writes the latest buffer's accelerations
+        IntegratorPushConstants pushConstants = {
+            .stepScale = 0.0f
+        };
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context->computePipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context->computePipelineLayout, 0, 1, &context->computeDescriptorSets[context->latestBuffer], 0, NULL);
+        vkCmdPushConstants(commandBuffer, context->computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(IntegratorPushConstants), &pushConstants);
+        vkCmdDispatch(commandBuffer, computeGroupCount(context->PARTICLE_COUNT, context->computeTuning), 1, 1);
+
+        // the first step already depends on the initial accelerations
+        if (context->adaptiveTimeStep) {
+            recordTimeStepUpdate(context, commandBuffer, context->latestBuffer, false);
+        }
+
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &commandBuffer
+    };
+
+    vkQueueSubmit(context->computeQueue, 1, &submitInfo, VK_NULL_HANDLE);
+    vkQueueWaitIdle(context->computeQueue);
+
+    vkFreeCommandBuffers(context->device, context->computeCommandPool, 1, &commandBuffer);
+}
 
 // MOVE !!!!!
 void checkErr(VkResult result, char* msg) {
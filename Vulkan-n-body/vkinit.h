@@ -27,7 +27,7 @@ bool checkDeviceExtensionSupport(VkPhysicalDevice device);
 QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device, VkSurfaceKHR surface);
 
 void createLogicalDevice(Context* app);
-void getFamilyDeviceQueues(VkDeviceQueueCreateInfo* queues, QueueFamilyIndices indices);
+uint32_t getFamilyDeviceQueues(VkDeviceQueueCreateInfo* queues, QueueFamilyIndices indices, bool headless);
 
 void createSwapChain(Context* app);
 SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device, VkSurfaceKHR surface);
@@ -43,18 +43,21 @@ void createRenderPass(Context* context);
 void createComputeDescriptorSetLayout(Context* context);
 
 void createGraphicsPipeline(Context* context);
-uint32_t readFile(const char* filename, char** buffer);
-VkShaderModule createShaderModule(VkDevice device, uint8_t* code, uint32_t codeSize);
-void getBindingDescriptions(VkVertexInputBindingDescription* bindingDescriptions);
-void getAttributeDescriptions(VkVertexInputAttributeDescription* attribute_descriptions);
+VkShaderModule loadShaderModule(Context* context, const char* name);
+VkShaderModule createShaderModule(VkDevice device, const uint32_t* code, size_t codeSize);
+void getBindingDescriptions(VkVertexInputBindingDescription* bindingDescriptions, bool renderStream);
+void getAttributeDescriptions(VkVertexInputAttributeDescription* attribute_descriptions, bool renderStream);
 
 void createFramebuffers(Context* context);
 
 void createCommandPool(Context* context);
 
-void createBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer* buffer, VkDeviceMemory* bufferMemory);
+void createBuffer(Context* context, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, AllocationStrategy strategy, VkBuffer* buffer, Allocation* allocation);
+void destroyBuffer(Context* context, VkBuffer buffer, Allocation allocation);
 uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties);
-void copyBuffer(Context* context, VkCommandPool commandPool, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+VkMemoryPropertyFlags readbackMemoryProperties(VkPhysicalDevice physicalDevice);
+void copyBuffer(Context* context, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+void readbackBuffer(Context* context, VkBuffer srcBuffer, VkDeviceSize size, void* dst);
 
 void createCommandBuffers(Context* context);
 
@@ -62,11 +65,18 @@ void createSyncObjects(Context* context);
 
 void createShaderStorageBuffers(Context* context);
 void createComputePipeline(Context* context);
+const char* computeKernelShaderName(ComputeKernel kernel);
+VkPipelineLayout createDirectPipelineLayout(Context* context);
+VkPipeline createDirectComputePipeline(Context* context, VkShaderModule shaderModule, VkPipelineLayout layout, ComputeTuning tuning, uint32_t particleCount);
+uint32_t computeGroupCount(uint32_t particleCount, ComputeTuning tuning);
 void createComputeDescriptorSets(Context* context);
+void writeComputeDescriptorSet(Context* context, VkDescriptorSet descriptorSet, VkBuffer uniformBuffer,
+    VkBuffer particlesIn, VkBuffer particlesOut, VkBuffer accelerationsIn, VkBuffer accelerationsOut, uint32_t particleCount);
 void createDescriptorPool(Context* context);
 void createUniformBuffers(Context* context);
 
 void createComputeCommandBuffers(Context* context);
+void initializeAccelerations(Context* context);
 
 void checkErr(VkResult result, char* msg);
 